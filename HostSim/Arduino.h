@@ -0,0 +1,248 @@
+//      ******************************************************************
+//      *                                                                *
+//      *            Host replacement for the Arduino core header        *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// This header stands in for <Arduino.h> when the slave firmware is compiled on a
+// Linux host.  It provides just the part of the Arduino core and the ATMega 2560
+// register file that the firmware uses.  Everything here is backed by the simulated
+// hardware in SimHardware.cpp: a virtual clock, the 11 IO ports, the external
+// interrupts, Timer 1 and USART 2.
+// Test harnesses drive the simulation through SimHardware.h.
+//
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+//
+// Arduino types
+//
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+
+//
+// Arduino constants
+//
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define PI 3.1415926535897932384626433832795
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+
+//
+// Arduino math helpers, templates rather than the usual macros so that they don't
+// collide with the C++ standard library used by the harnesses
+//
+template <class T, class L> inline auto min(const T &a, const L &b) -> decltype(a < b ? a : b)
+{
+  return((b < a) ? b : a);
+}
+
+template <class T, class L> inline auto max(const T &a, const L &b) -> decltype(a < b ? a : b)
+{
+  return((a < b) ? b : a);
+}
+
+template <class T, class L, class H> inline T constrain(const T &x, const L &lo, const H &hi)
+{
+  return((x < lo) ? lo : ((x > hi) ? hi : x));
+}
+
+
+//
+// Arduino core functions
+//
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+
+//
+// arithmetic takes no virtual time on the host, the firmware marks the parts of its
+// inner loops that are slow on the AVR with the clock cycles they take there
+//
+void simChargeCycles(unsigned long cycles);
+
+#define AVR_CYCLES(cycles) simChargeCycles(cycles)
+
+
+//
+// status register and interrupt control, bit 7 of SREG is the global interrupt flag
+//
+extern volatile uint8_t SREG;
+
+#define SREG_I 7
+
+void cli(void);
+void sei(void);
+
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+
+//
+// external interrupts INT0 - INT5, numbered as the Arduino core does for the Mega
+// 2560: 0 and 1 on pins 2 and 3, 2 - 5 on pins 21 down to 18.  Only the edge modes are
+// simulated.
+//
+#define NOT_AN_INTERRUPT -1
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : (((p) >= 18 && (p) <= 21) ? 23 - (p) : NOT_AN_INTERRUPT)))
+
+void attachInterrupt(uint8_t interruptNumber, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interruptNumber);
+
+
+//
+// program memory is ordinary memory on the host
+//
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+
+
+//
+// interrupt service routines are plain functions on the host, SimHardware.cpp calls
+// them when the simulated peripheral raises the interrupt
+//
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+
+
+//
+// IO port registers
+//
+const uint8_t SIM_NUMBER_OF_PORTS = 11;
+
+extern volatile uint8_t simPortOutputRegisters[SIM_NUMBER_OF_PORTS];
+extern volatile uint8_t simPortDirectionRegisters[SIM_NUMBER_OF_PORTS];
+
+#define PORTA simPortOutputRegisters[0]
+#define PORTB simPortOutputRegisters[1]
+#define PORTC simPortOutputRegisters[2]
+#define PORTD simPortOutputRegisters[3]
+#define PORTE simPortOutputRegisters[4]
+#define PORTF simPortOutputRegisters[5]
+#define PORTG simPortOutputRegisters[6]
+#define PORTH simPortOutputRegisters[7]
+#define PORTJ simPortOutputRegisters[8]
+#define PORTK simPortOutputRegisters[9]
+#define PORTL simPortOutputRegisters[10]
+
+
+//
+// pin to port mapping, ports are numbered from 1 as on the AVR so that NOT_A_PIN (0)
+// can be told apart
+//
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t *portOutputRegister(uint8_t port);
+
+
+//
+// Timer 1 registers, these are objects so that the simulation knows when the timer is
+// started, reloaded or given a new compare value
+//
+class SimTimerRegister
+{
+  public:
+    SimTimerRegister(int registerNumber);
+    operator uint16_t() const;
+    SimTimerRegister &operator=(uint16_t value);
+    SimTimerRegister &operator|=(uint16_t value);
+    SimTimerRegister &operator&=(uint16_t value);
+
+  private:
+    int registerNumber;
+};
+
+extern SimTimerRegister TCCR1A;
+extern SimTimerRegister TCCR1B;
+extern SimTimerRegister TCNT1;
+extern SimTimerRegister OCR1A;
+extern SimTimerRegister TIMSK1;
+extern SimTimerRegister TIFR1;
+
+#define WGM10 0
+#define WGM11 1
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+
+#define TOIE1 0
+#define OCIE1A 1
+
+#define TOV1 0
+#define OCF1A 1
+
+
+//
+// USART 2 registers, the data register is an object so that reading it pulls the next
+// received byte and writing it starts a transmission
+//
+class SimUsartDataRegister
+{
+  public:
+    operator uint8_t() const;
+    SimUsartDataRegister &operator=(uint8_t c);
+};
+
+extern SimUsartDataRegister UDR2;
+extern volatile uint8_t UCSR2A;
+extern volatile uint8_t UCSR2B;
+extern volatile uint8_t UCSR2C;
+extern volatile uint8_t UBRR2H;
+extern volatile uint8_t UBRR2L;
+
+#define RXC2 7
+#define TXC2 6
+#define UDRE2 5
+#define FE2 4
+#define DOR2 3
+#define UPE2 2
+#define U2X2 1
+#define MPCM2 0
+
+#define RXCIE2 7
+#define TXCIE2 6
+#define UDRIE2 5
+#define RXEN2 4
+#define TXEN2 3
+#define UCSZ22 2
+#define RXB82 1
+#define TXB82 0
+
+// ------------------------------------ End ---------------------------------
+#endif
@@ -0,0 +1,767 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                             BusSim                             *
+//      *                                                                *
+//      *      Several simulated slaves sharing one RS-485 line          *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Puts a master and any number of simulated boards on one half duplex RS-485 line and
+// runs a scripted master workload against them.  Each board is a separate copy of
+// libSimBoard.so (the Slave sketch on SimHardware), so every board runs the real
+// firmware with its own state, and each one runs on its own stack so that a sketch
+// that delays or busy waits simply hands control back to the bus.
+//
+// The boards and the master advance together in small time quanta.  The line is
+// modeled this way:
+//    * A byte is on the line from its start bit to its stop bit.  A board's byte only
+//      gets onto the line if its transmitter enable pin (transmitEnablePin in
+//      SerialSlave) is on for the whole byte.  The master drives the line from the
+//      start of its first byte to the end of its last.
+//    * If any other transmitter is enabled while a byte is on the line the byte
+//      collides and nobody receives it.
+//    * Every other node receives each good byte after the propagation delay.
+//
+// The master behaves like SlaveMaster.py: it sends one command, waits for the
+// response (or a 100ms timeout), retries up to 3 times, pauses for its own turnaround
+// and moves on to the next command in the workload.
+//
+// Usage:
+//    busSim [-a addresses] [-n slaves] [-b baudRate] [-t seconds] [-g masterGap]
+//           [-p propagationDelay] [-q quantum] [-w workload] [-l library]
+//
+//    -a  comma separated slave addresses (default 15,17,18)
+//    -n  use this many slaves at addresses 1 - n instead
+//    -b  baud rate (default 115200)
+//    -t  virtual seconds to run (default 1)
+//    -g  master's pause between a response and its next command in us (default 500)
+//    -p  propagation delay along the cable in ns (default 500, about 100m)
+//    -q  time quantum in ns (default 2000)
+//    -w  workload file, one command per line: address command [data bytes ...],
+//        numbers in decimal or 0x hex, # starts a comment.  The default workload
+//        echoes 4 bytes from each slave in turn.
+//    -l  path of libSimBoard.so (default: next to this program)
+//
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <ucontext.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "SimBoard.h"
+
+
+const uint8_t MASTER_COMMAND_HEADER_BYTE_1 = 0xAA;
+const uint8_t MASTER_COMMAND_HEADER_BYTE_2 = 0x55;
+const uint8_t SLAVE_RESPONSE_RECEIVED_COMMAND = 0xA9;
+const uint8_t SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA = 0xAC;
+const uint8_t SLAVE_RESPONSE_RESEND_COMMAND = 0xB8;
+const uint8_t MASTER_COMMAND_BROADCAST_ADDRESS = 0;
+
+const unsigned long long MASTER_TIMEOUT_PERIOD_InNS = 100000000ULL;
+const unsigned long long MASTER_START_TIME_InNS = 1000000ULL;
+const int MASTER_SEND_ATTEMPTS = 3;
+
+const uint8_t TRANSMITTER_ENABLE_PIN = 40;
+
+const size_t BOARD_STACK_SIZE = 256 * 1024;
+
+const unsigned long long NEVER = ~0ULL;
+
+
+//
+// values for masterState
+//
+const int MASTER_STATE_READY_TO_SEND = 0;
+const int MASTER_STATE_WAITING_FOR_RESPONSE = 1;
+const int MASTER_STATE_PAUSING = 2;
+
+
+typedef struct workloadCommand {
+  uint8_t address;
+  uint8_t command;
+  std::vector<uint8_t> data;
+} WorkloadCommand;
+
+
+typedef struct driverInterval {
+  unsigned long long onTime_InNS;
+  unsigned long long offTime_InNS;
+} DriverInterval;
+
+
+typedef struct lineByte {
+  int source;
+  uint8_t c;
+  unsigned long long startTime_InNS;
+  unsigned long long endTime_InNS;
+} LineByte;
+
+
+//
+// a node on the bus, node 0 is the master, the rest are boards
+//
+typedef struct node {
+  uint8_t address;
+  const SimBoardInterface *board;
+  ucontext_t context;
+  std::vector<char> stack;
+  std::vector<DriverInterval> driverIntervals;
+  unsigned long long bytesSentTime_InNS;
+  unsigned long commandsAnswered;
+  unsigned long timeouts;
+  unsigned long resendRequests;
+  std::vector<unsigned long long> latencies_InNS;
+} Node;
+
+
+//
+// variables global to this module
+//
+static std::vector<Node> nodes;
+static ucontext_t busContext;
+static Node *runningNode;
+
+static unsigned long long busTime_InNS;
+static unsigned long long propagationDelay_InNS;
+static std::vector<LineByte> bytesOnTheLine;
+static unsigned long long lastBusyTime_InNS;
+static unsigned long long busyTime_InNS;
+static std::vector<unsigned long long> idleGaps_InNS;
+static unsigned long collisions;
+
+static int masterState;
+static size_t workloadIndex;
+static int masterAttempt;
+static int masterTargetNode;
+static unsigned long long masterCommandStartTime_InNS;
+static unsigned long long masterLastByteTime_InNS;
+static unsigned long long masterNextSendTime_InNS;
+static std::vector<uint8_t> masterResponse;
+static unsigned long masterCommandsSent;
+static unsigned long masterRetries;
+
+
+
+// ---------------------------------------------------------------------------------
+//                                      The line
+// ---------------------------------------------------------------------------------
+
+//
+// check if a node's transmitter was enabled at any time during the given period
+//
+static bool driverEnabledDuring(Node &node, unsigned long long startTime_InNS, unsigned long long endTime_InNS)
+{
+  for (size_t i = node.driverIntervals.size(); i-- > 0; )
+  {
+    DriverInterval &interval = node.driverIntervals[i];
+    if (interval.offTime_InNS <= startTime_InNS)
+      break;
+    if (interval.onTime_InNS < endTime_InNS)
+      return(true);
+  }
+  return(false);
+}
+
+
+
+//
+// put a byte on the line, it is delivered once every node has reached its end time
+//
+static void transmitByte(int source, uint8_t c, unsigned long long startTime_InNS, unsigned long long endTime_InNS)
+{
+  LineByte lineByte;
+
+  lineByte.source = source;
+  lineByte.c = c;
+  lineByte.startTime_InNS = startTime_InNS;
+  lineByte.endTime_InNS = endTime_InNS;
+  bytesOnTheLine.push_back(lineByte);
+  nodes[source].bytesSentTime_InNS += endTime_InNS - startTime_InNS;
+}
+
+
+
+static void masterReceiveByte(uint8_t c, unsigned long long time_InNS);
+
+
+//
+// deliver every byte that finished before the given time, checking for collisions
+//
+static void deliverBytes(unsigned long long time_InNS)
+{
+  std::vector<LineByte> remainingBytes;
+  bool collided;
+
+  std::sort(bytesOnTheLine.begin(), bytesOnTheLine.end(),
+    [](const LineByte &a, const LineByte &b) { return(a.endTime_InNS < b.endTime_InNS); });
+
+  for (LineByte &lineByte : bytesOnTheLine)
+  {
+    if (lineByte.endTime_InNS > time_InNS)
+    {
+      remainingBytes.push_back(lineByte);
+      continue;
+    }
+
+    //
+    // keep track of how busy the line is and the gaps between transmissions
+    //
+    if (lineByte.startTime_InNS > lastBusyTime_InNS)
+    {
+      if (lastBusyTime_InNS > 0)
+        idleGaps_InNS.push_back(lineByte.startTime_InNS - lastBusyTime_InNS);
+      busyTime_InNS += lineByte.endTime_InNS - lineByte.startTime_InNS;
+    }
+    else if (lineByte.endTime_InNS > lastBusyTime_InNS)
+      busyTime_InNS += lineByte.endTime_InNS - lastBusyTime_InNS;
+    if (lineByte.endTime_InNS > lastBusyTime_InNS)
+      lastBusyTime_InNS = lineByte.endTime_InNS;
+
+    //
+    // a byte that overlaps another enabled transmitter is lost
+    //
+    collided = false;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+      if (((int) i != lineByte.source) &&
+          driverEnabledDuring(nodes[i], lineByte.startTime_InNS, lineByte.endTime_InNS))
+        collided = true;
+    }
+    if (collided)
+    {
+      collisions++;
+      continue;
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+      if ((int) i == lineByte.source)
+        continue;
+      if (i == 0)
+        masterReceiveByte(lineByte.c, lineByte.endTime_InNS + propagationDelay_InNS);
+      else
+        nodes[i].board->receiveAt(lineByte.c, lineByte.endTime_InNS + propagationDelay_InNS);
+    }
+  }
+
+  bytesOnTheLine.swap(remainingBytes);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                     The boards
+// ---------------------------------------------------------------------------------
+
+static void boardTransmitted(void *context, uint8_t c, bool driverEnabled,
+                             unsigned long long startTime_InNS, unsigned long long endTime_InNS)
+{
+  if (driverEnabled)
+    transmitByte((int) (intptr_t) context, c, startTime_InNS, endTime_InNS);
+}
+
+
+
+static void boardDriverEnableChanged(void *context, uint8_t level, unsigned long long time_InNS)
+{
+  Node &node = nodes[(int) (intptr_t) context];
+  DriverInterval interval;
+
+  if (level == HIGH)
+  {
+    interval.onTime_InNS = time_InNS;
+    interval.offTime_InNS = NEVER;
+    node.driverIntervals.push_back(interval);
+  }
+  else if (!node.driverIntervals.empty() && (node.driverIntervals.back().offTime_InNS == NEVER))
+    node.driverIntervals.back().offTime_InNS = time_InNS;
+}
+
+
+
+static void boardYield(void *context)
+{
+  swapcontext(&nodes[(int) (intptr_t) context].context, &busContext);
+}
+
+
+
+static void boardEntry(void)
+{
+  runningNode->board->run();
+}
+
+
+
+//
+// load a private copy of the board library, the copy is needed because the dynamic
+// loader hands back the same instance when a library is opened twice
+//
+static const SimBoardInterface *loadBoard(const char *libraryPath)
+{
+  char copyPath[] = "/tmp/simBoardXXXXXX";
+  int sourceFd, copyFd;
+  char buffer[65536];
+  ssize_t count;
+  void *library;
+  const SimBoardInterface *(*getInterface)(void);
+
+  sourceFd = open(libraryPath, O_RDONLY);
+  copyFd = mkstemp(copyPath);
+  if ((sourceFd < 0) || (copyFd < 0))
+  {
+    perror(libraryPath);
+    return(NULL);
+  }
+  while((count = read(sourceFd, buffer, sizeof(buffer))) > 0)
+  {
+    if (write(copyFd, buffer, count) != count)
+      break;
+  }
+  close(sourceFd);
+  close(copyFd);
+
+  library = dlopen(copyPath, RTLD_NOW | RTLD_LOCAL);
+  unlink(copyPath);
+  if (library == NULL)
+  {
+    fprintf(stderr, "%s\n", dlerror());
+    return(NULL);
+  }
+
+  getInterface = (const SimBoardInterface *(*)(void)) dlsym(library, SIM_BOARD_INTERFACE_FUNCTION);
+  return(getInterface ? getInterface() : NULL);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                     The master
+// ---------------------------------------------------------------------------------
+
+//
+// send a command packet, driving the line for its duration
+//
+static void masterSendCommand(const WorkloadCommand &command, unsigned long long byteTime_InNS)
+{
+  std::vector<uint8_t> packet;
+  uint8_t checksum;
+  unsigned long long time_InNS;
+  DriverInterval interval;
+
+  packet.push_back(MASTER_COMMAND_HEADER_BYTE_1);
+  packet.push_back(MASTER_COMMAND_HEADER_BYTE_2);
+  packet.push_back(command.address);
+  packet.push_back(command.command);
+  packet.push_back(command.data.size());
+  checksum = command.address + command.command + command.data.size();
+  for (uint8_t c : command.data)
+  {
+    packet.push_back(c);
+    checksum += c;
+  }
+  packet.push_back(checksum);
+
+  time_InNS = busTime_InNS;
+  interval.onTime_InNS = time_InNS;
+  for (uint8_t c : packet)
+  {
+    transmitByte(0, c, time_InNS, time_InNS + byteTime_InNS);
+    time_InNS += byteTime_InNS;
+  }
+  interval.offTime_InNS = time_InNS;
+  nodes[0].driverIntervals.push_back(interval);
+
+  masterLastByteTime_InNS = time_InNS;
+  masterResponse.clear();
+  masterCommandsSent++;
+}
+
+
+
+//
+// check if the master has a complete response
+//  Exit:  0 if not complete, else the response type
+//
+static uint8_t masterResponseComplete(void)
+{
+  if (masterResponse.size() < 2)
+    return(0);
+  if (masterResponse[0] != masterResponse[1])
+    return(SLAVE_RESPONSE_RESEND_COMMAND);
+  if (masterResponse[0] == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA)
+  {
+    if ((masterResponse.size() < 3) || (masterResponse.size() < (size_t) masterResponse[2] + 4))
+      return(0);
+  }
+  return(masterResponse[0]);
+}
+
+
+
+static void masterReceiveByte(uint8_t c, unsigned long long time_InNS)
+{
+  if (masterState != MASTER_STATE_WAITING_FOR_RESPONSE)
+    return;
+
+  masterResponse.push_back(c);
+  masterLastByteTime_InNS = time_InNS;
+}
+
+
+
+//
+// run the master's state machine for the current time
+//
+static void runMaster(const std::vector<WorkloadCommand> &workload, unsigned long long byteTime_InNS,
+                      unsigned long long masterGap_InNS)
+{
+  uint8_t responseType;
+  Node *target;
+
+  switch(masterState)
+  {
+    case MASTER_STATE_READY_TO_SEND:
+    {
+      const WorkloadCommand &command = workload[workloadIndex];
+
+      masterTargetNode = 0;
+      for (size_t i = 1; i < nodes.size(); i++)
+      {
+        if (nodes[i].address == command.address)
+          masterTargetNode = i;
+      }
+
+      if (masterAttempt == 0)
+        masterCommandStartTime_InNS = busTime_InNS;
+      else
+        masterRetries++;
+      masterSendCommand(command, byteTime_InNS);
+
+      //
+      // nobody answers a broadcast, so go straight on to the next command
+      //
+      if (command.address == MASTER_COMMAND_BROADCAST_ADDRESS)
+      {
+        workloadIndex = (workloadIndex + 1) % workload.size();
+        masterNextSendTime_InNS = masterLastByteTime_InNS + masterGap_InNS;
+        masterState = MASTER_STATE_PAUSING;
+        break;
+      }
+      masterState = MASTER_STATE_WAITING_FOR_RESPONSE;
+      break;
+    }
+
+    case MASTER_STATE_WAITING_FOR_RESPONSE:
+    {
+      target = masterTargetNode ? &nodes[masterTargetNode] : NULL;
+      responseType = masterResponseComplete();
+
+      if ((responseType == SLAVE_RESPONSE_RECEIVED_COMMAND) ||
+          (responseType == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA))
+      {
+        if (target != NULL)
+        {
+          target->commandsAnswered++;
+          target->latencies_InNS.push_back(masterLastByteTime_InNS - masterCommandStartTime_InNS);
+        }
+        masterAttempt = MASTER_SEND_ATTEMPTS;
+      }
+      else if (responseType == SLAVE_RESPONSE_RESEND_COMMAND)
+      {
+        if (target != NULL)
+          target->resendRequests++;
+        masterAttempt++;
+      }
+      else if (busTime_InNS >= masterLastByteTime_InNS + MASTER_TIMEOUT_PERIOD_InNS)
+      {
+        if (target != NULL)
+          target->timeouts++;
+        masterAttempt++;
+      }
+      else
+        break;
+
+      //
+      // move on to the next command once this one succeeded or ran out of attempts
+      //
+      if (masterAttempt >= MASTER_SEND_ATTEMPTS)
+      {
+        masterAttempt = 0;
+        workloadIndex = (workloadIndex + 1) % workload.size();
+      }
+      masterNextSendTime_InNS = masterLastByteTime_InNS + masterGap_InNS;
+      masterState = MASTER_STATE_PAUSING;
+      break;
+    }
+
+    case MASTER_STATE_PAUSING:
+    {
+      if (busTime_InNS >= masterNextSendTime_InNS)
+        masterState = MASTER_STATE_READY_TO_SEND;
+      break;
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                    Main program
+// ---------------------------------------------------------------------------------
+
+//
+// read the workload file
+//  Exit:  false returned on error
+//
+static bool readWorkload(const char *path, std::vector<WorkloadCommand> &workload)
+{
+  FILE *file;
+  char line[512];
+  char *token;
+  std::vector<long> numbers;
+  WorkloadCommand command;
+
+  file = fopen(path, "r");
+  if (file == NULL)
+  {
+    perror(path);
+    return(false);
+  }
+
+  while(fgets(line, sizeof(line), file) != NULL)
+  {
+    if (strchr(line, '#') != NULL)
+      *strchr(line, '#') = 0;
+
+    numbers.clear();
+    for (token = strtok(line, " \t\r\n,"); token != NULL; token = strtok(NULL, " \t\r\n,"))
+      numbers.push_back(strtol(token, NULL, 0));
+    if (numbers.empty())
+      continue;
+
+    if (numbers.size() < 2)
+    {
+      fprintf(stderr, "%s: each line needs an address and a command\n", path);
+      fclose(file);
+      return(false);
+    }
+
+    command.address = numbers[0];
+    command.command = numbers[1];
+    command.data.assign(numbers.begin() + 2, numbers.end());
+    workload.push_back(command);
+  }
+
+  fclose(file);
+  return(!workload.empty());
+}
+
+
+
+//
+// print count, mean and percentiles of a list of times
+//
+static void printTimes(const char *label, std::vector<unsigned long long> times_InNS)
+{
+  double total = 0;
+
+  if (times_InNS.empty())
+  {
+    printf("  %-16s none\n", label);
+    return;
+  }
+
+  std::sort(times_InNS.begin(), times_InNS.end());
+  for (unsigned long long time_InNS : times_InNS)
+    total += time_InNS;
+
+  printf("  %-16s %8zu   mean %9.1f us   p50 %9.1f us   p99 %9.1f us   max %9.1f us\n",
+    label, times_InNS.size(), total / times_InNS.size() / 1000.0,
+    times_InNS[times_InNS.size() / 2] / 1000.0,
+    times_InNS[(times_InNS.size() * 99) / 100] / 1000.0,
+    times_InNS.back() / 1000.0);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  std::string addressList = "15,17,18";
+  int numberOfSlaves = 0;
+  long baudRate = 115200;
+  double runTime_InSeconds = 1.0;
+  unsigned long long masterGap_InNS = 500000ULL;
+  unsigned long long quantum_InNS = 2000ULL;
+  const char *workloadPath = NULL;
+  std::string libraryPath;
+  int option;
+
+  std::vector<WorkloadCommand> workload;
+  WorkloadCommand command;
+  unsigned long long endTime_InNS;
+  unsigned long long byteTime_InNS;
+  unsigned long long driverOnTime_InNS;
+  char label[32];
+  char *slash;
+
+
+  propagationDelay_InNS = 500;
+  libraryPath = argv[0];
+  slash = strrchr(argv[0], '/');
+  libraryPath = (slash == NULL) ? "." : std::string(argv[0], slash - argv[0]);
+  libraryPath += "/libSimBoard.so";
+
+  while((option = getopt(argc, argv, "a:n:b:t:g:p:q:w:l:")) != -1)
+  {
+    switch(option)
+    {
+      case 'a': addressList = optarg; break;
+      case 'n': numberOfSlaves = atoi(optarg); break;
+      case 'b': baudRate = atol(optarg); break;
+      case 't': runTime_InSeconds = atof(optarg); break;
+      case 'g': masterGap_InNS = (unsigned long long) (atof(optarg) * 1000); break;
+      case 'p': propagationDelay_InNS = atol(optarg); break;
+      case 'q': quantum_InNS = atol(optarg); break;
+      case 'w': workloadPath = optarg; break;
+      case 'l': libraryPath = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-a addresses] [-n slaves] [-b baudRate] [-t seconds] [-g masterGap] "
+          "[-p propagationDelay] [-q quantum] [-w workload] [-l library]\n", argv[0]);
+        return(1);
+    }
+  }
+
+  if (quantum_InNS == 0)
+    quantum_InNS = 1;
+
+  //
+  // the master is node 0, then one node per slave address
+  //
+  nodes.resize(1);
+  if (numberOfSlaves > 0)
+  {
+    for (int i = 1; i <= numberOfSlaves; i++)
+    {
+      nodes.emplace_back();
+      nodes.back().address = i;
+    }
+  }
+  else
+  {
+    for (char *token = strtok(&addressList[0], ","); token != NULL; token = strtok(NULL, ","))
+    {
+      nodes.emplace_back();
+      nodes.back().address = atoi(token);
+    }
+  }
+
+  if (workloadPath != NULL)
+  {
+    if (!readWorkload(workloadPath, workload))
+      return(1);
+  }
+  else
+  {
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+      command.address = nodes[i].address;
+      command.command = 2;
+      command.data.assign({1, 2, 3, 4});
+      workload.push_back(command);
+    }
+  }
+  if (workload.empty())
+  {
+    fprintf(stderr, "no slaves\n");
+    return(1);
+  }
+
+  //
+  // load and start a board for each slave, each on its own stack
+  //
+  for (size_t i = 1; i < nodes.size(); i++)
+  {
+    Node &node = nodes[i];
+
+    node.board = loadBoard(libraryPath.c_str());
+    if (node.board == NULL)
+      return(1);
+    node.board->begin(baudRate, node.address, TRANSMITTER_ENABLE_PIN, (void *) (intptr_t) i,
+      boardTransmitted, boardDriverEnableChanged, boardYield);
+
+    node.stack.resize(BOARD_STACK_SIZE);
+    getcontext(&node.context);
+    node.context.uc_stack.ss_sp = node.stack.data();
+    node.context.uc_stack.ss_size = node.stack.size();
+    node.context.uc_link = NULL;
+    makecontext(&node.context, boardEntry, 0);
+  }
+
+  //
+  // run the bus, advancing the master and every board one quantum at a time
+  //
+  //
+  // the master runs at the baud rate it asked for, the boards at whatever their baud
+  // rate register gives them
+  //
+  endTime_InNS = (unsigned long long) (runTime_InSeconds * 1e9);
+  byteTime_InNS = 10000000000ULL / baudRate;
+  for (busTime_InNS = 0; busTime_InNS < endTime_InNS; busTime_InNS += quantum_InNS)
+  {
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+      runningNode = &nodes[i];
+      nodes[i].board->setAllowedTime(busTime_InNS);
+      swapcontext(&busContext, &nodes[i].context);
+    }
+
+    deliverBytes(busTime_InNS);
+    //
+    // give the boards time to run setup() before the master starts talking
+    //
+    if (busTime_InNS >= MASTER_START_TIME_InNS)
+      runMaster(workload, byteTime_InNS, masterGap_InNS);
+  }
+
+  //
+  // report
+  //
+  printf("RS-485 bus simulation: %zu slaves, %ld baud, %.3f seconds\n", nodes.size() - 1, baudRate,
+    runTime_InSeconds);
+  printf("  line busy:        %.1f%% of the time bytes are on the line\n", 100.0 * busyTime_InNS / endTime_InNS);
+  printf("  collisions:       %lu bytes\n", collisions);
+  printf("  master:           %lu commands sent, %lu retries, %.1f commands/second\n",
+    masterCommandsSent, masterRetries, masterCommandsSent / runTime_InSeconds);
+  printTimes("idle gaps", idleGaps_InNS);
+
+  printf("\n  %-8s %10s %8s %8s %9s %13s %13s\n", "address", "answered", "resends", "timeouts", "overruns",
+    "driver on ms", "sending ms");
+  for (size_t i = 1; i < nodes.size(); i++)
+  {
+    Node &node = nodes[i];
+
+    driverOnTime_InNS = 0;
+    for (DriverInterval &interval : node.driverIntervals)
+      driverOnTime_InNS += ((interval.offTime_InNS == NEVER) ? endTime_InNS : interval.offTime_InNS) - interval.onTime_InNS;
+
+    printf("  %-8d %10lu %8lu %8lu %9lu %13.2f %13.2f\n", node.address, node.commandsAnswered,
+      node.resendRequests, node.timeouts, node.board->getOverrunCount(), driverOnTime_InNS / 1e6,
+      node.bytesSentTime_InNS / 1e6);
+  }
+
+  printf("\n  round trip latency, first command byte to last response byte\n");
+  for (size_t i = 1; i < nodes.size(); i++)
+  {
+    snprintf(label, sizeof(label), "slave %d", nodes[i].address);
+    printTimes(label, nodes[i].latencies_InNS);
+  }
+
+  return(0);
+}
+
+// -------------------------------------- End --------------------------------------
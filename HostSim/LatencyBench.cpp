@@ -0,0 +1,420 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                          LatencyBench                          *
+//      *                                                                *
+//      *      Round trip latency of the serial slave on the host        *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Measures the round trip time the master sees, from the start of the first byte of a
+// command packet to the end of the last byte of the response, on the simulated board
+// running the Slave sketch.  Three sweeps are run:
+//    * echo with 0 to MASTER_COMMAND_MAX_DATA_BYTES data bytes
+//    * echo with 8 data bytes at each of the common baud rates, showing the rate that
+//      SerialSlave::open() actually gets from the baud rate register
+//    * every entry in internalCallables and callables, using the arguments in
+//      CALLABLE_ARGUMENTS
+//
+// Each round trip is split into:
+//    wire        the command packet plus the response packet on the line
+//    callable    the time spent in the callable itself, timed by swapping a wrapper
+//                into the callable table
+//    turnaround  everything else, from the end of the command to the start of the
+//                response less the callable (the ISR, building the response and the
+//                RS-485 transmitter enable delay)
+//
+// Rows whose worst round trip is longer than the master's 100ms timeout are marked
+// with a '*', the master would give up and resend those commands.
+//
+// Usage:
+//    latencyBench [-n frames] [-b baudRate] [-a slaveAddress]
+//
+//    -n  number of command packets for each row (default 100)
+//    -b  baud rate for the payload and callable sweeps (default 115200)
+//    -a  slave address (default 17, the address in Slave.ino)
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "SimHardware.h"
+#include "SerialSlave.h"
+#include "SpeedyStepper.h"
+#include "StepperBank.h"
+
+
+//
+// constants from the packet definitions in SerialSlave.cpp
+//
+const byte MASTER_COMMAND_HEADER_BYTE_1 = 0xAA;
+const byte MASTER_COMMAND_HEADER_BYTE_2 = 0x55;
+const byte SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA = 0xAC;
+
+const unsigned long long MASTER_TIMEOUT_PERIOD_InNS = 100000000ULL;
+const unsigned long long BENCH_GIVE_UP_PERIOD_InNS = 10000000000ULL;
+
+const byte TRANSMITTER_ENABLE_PIN = 40;
+
+//
+// time charged for a pass through loop() that calls nothing that takes time, about
+// what serialSlave.service() costs when there is nothing to do
+//
+const unsigned long long LOOP_MINIMUM_PERIOD_InNS = 1000ULL;
+const byte ECHO_COMMAND = 2;
+const byte ECHO_DATA_LENGTH = 8;
+
+const long BAUD_RATES[] = {9600, 19200, 38400, 57600, 115200, 230400, 250000, 500000, 1000000};
+
+
+//
+// the homing callables run stepper 1 toward the switch on pin 29, the switch closes
+// when the stepper gets this far
+//
+const uint8_t HOME_SWITCH_PIN = 29;
+const long HOME_SWITCH_POSITION_InSteps = 20;
+
+
+//
+// arguments sent to each callable, the steppers' int arguments are sent as 4 bytes
+// since an int is 4 bytes on the host, callables that are not listed get
+// DEFAULT_ARGUMENTS
+//
+typedef struct callableArguments {
+  const char *shortName;
+  byte dataLength;
+  byte data[MASTER_COMMAND_MAX_DATA_BYTES];
+} CallableArguments;
+
+const CallableArguments CALLABLE_ARGUMENTS[] = {
+  {"get_nth_call",     1, {0}},
+  {"echo",             ECHO_DATA_LENGTH, {0, 1, 2, 3, 4, 5, 6, 7}},
+  {"pin_mode",         2, {13, OUTPUT}},
+  {"digital_write",    2, {13, HIGH}},
+  {"digital_read",     1, {13}},
+  {"analog_read",      1, {13}},
+  {"analog_write",     3, {13, 0, 128}},
+  {"moveStepper",      6, {2, 0, 100, 0, 0, 0}},
+  {"blinkLED",         2, {13, 1}},
+  {"toggleLED",        2, {13, 1}},
+  {"moveStepperToPos", 6, {2, 0, 100, 0, 0, 0}},
+  {"moveStepperDeg",   6, {2, 0, 90, 0, 0, 0}},
+  {"moveStepperRev",   6, {2, 0, 1, 0, 0, 0}},
+  {"setStepperSpeed",  6, {2, 0, 0xf4, 0x01, 0, 0}},
+  {"setStepperAccel",  6, {2, 0, 0xf4, 0x01, 0, 0}},
+};
+
+const CallableArguments DEFAULT_ARGUMENTS = {"", 6, {2, 0, 0, 0, 0, 0}};
+
+
+//
+// the callable tables and the sketch, from SerialSlave.cpp and Slave.ino
+//
+extern Callable internalCallables[];
+extern byte numberOfInternalCallables;
+extern byte numberOfExternalCallables;
+
+void setup(void);
+void loop(void);
+
+
+//
+// results for one row of the report
+//
+typedef struct latencyResults {
+  std::vector<unsigned long long> roundTrips_InNS;
+  unsigned long long wireTime_InNS;
+  unsigned long long turnaroundTime_InNS;
+  unsigned long long callableTime_InNS;
+  long answered;
+} LatencyResults;
+
+
+//
+// variables global to this module
+//
+static byte responseBytes[SLAVE_RESPONSE_MAX_DATA_BYTES + 8];
+static int responseLength;
+static unsigned long long responseStartTime_InNS;
+static unsigned long long responseEndTime_InNS;
+
+static Func *timedCallable;
+static unsigned long long callableTime_InNS;
+
+
+
+//
+// keep every byte that made it onto the RS-485 line
+//
+static void collectResponseByte(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                                unsigned long long endTime_InNS)
+{
+  if (!driverEnabled || (responseLength >= (int) sizeof(responseBytes)))
+    return;
+
+  if (responseLength == 0)
+    responseStartTime_InNS = startTime_InNS;
+  responseBytes[responseLength] = c;
+  responseLength++;
+  responseEndTime_InNS = endTime_InNS;
+}
+
+
+
+//
+// check if the bytes collected so far form a complete response packet
+//
+static bool responseComplete(void)
+{
+  if (responseLength < 2)
+    return(false);
+
+  if (responseBytes[0] == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA)
+    return((responseLength >= 3) && (responseLength >= responseBytes[2] + 4));
+  return(true);
+}
+
+
+
+//
+// model the home limit switch, called before the clock moves forward
+//
+static void updateHomeSwitch(unsigned long long time_InNS)
+{
+  simSetPinInput(HOME_SWITCH_PIN,
+    (stepperBank.getAxis(1)->getCurrentPositionInSteps() >= HOME_SWITCH_POSITION_InSteps) ? LOW : HIGH);
+}
+
+
+
+//
+// swapped into the callable table in place of the callable being measured
+//
+static void timeCallable(byte dataLength, byte dataArray[])
+{
+  unsigned long long startTime_InNS = simGetTimeInNS();
+
+  timedCallable(dataLength, dataArray);
+  callableTime_InNS += simGetTimeInNS() - startTime_InNS;
+}
+
+
+
+static Callable *getCallable(int command)
+{
+  if (command < numberOfInternalCallables)
+    return(&internalCallables[command]);
+  return(&callables[command - numberOfInternalCallables]);
+}
+
+
+
+//
+// build a command packet the same way SlaveMaster.py does
+//  Exit:  number of bytes in the packet returned
+//
+static int buildCommandPacket(byte packet[], byte slaveAddress, byte command, byte dataLength, const byte data[])
+{
+  int packetLength = 0;
+  byte checksum;
+
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_1;
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_2;
+  packet[packetLength++] = slaveAddress;
+  packet[packetLength++] = command;
+  packet[packetLength++] = dataLength;
+  checksum = slaveAddress + command + dataLength;
+
+  for (int i = 0; i < dataLength; i++)
+  {
+    packet[packetLength++] = data[i];
+    checksum += data[i];
+  }
+
+  packet[packetLength++] = checksum;
+  return(packetLength);
+}
+
+
+
+//
+// send a command the given number of times, waiting for each response like the master
+//
+static void measureCommand(byte slaveAddress, byte command, byte dataLength, const byte data[], long frames,
+                           LatencyResults &results)
+{
+  byte packet[MASTER_COMMAND_MAX_DATA_BYTES + 8];
+  int packetLength;
+  Callable *callable;
+  unsigned long long startTime_InNS;
+  unsigned long long loopStartTime_InNS;
+  unsigned long long commandEndTime_InNS;
+  unsigned long long byteTime_InNS;
+
+  results.roundTrips_InNS.clear();
+  results.wireTime_InNS = 0;
+  results.turnaroundTime_InNS = 0;
+  results.callableTime_InNS = 0;
+  results.answered = 0;
+
+  callable = getCallable(command);
+  timedCallable = callable->call;
+  callable->call = timeCallable;
+
+  packetLength = buildCommandPacket(packet, slaveAddress, command, dataLength, data);
+  byteTime_InNS = simUsartGetByteTimeInNS();
+
+  for (long frame = 0; frame < frames; frame++)
+  {
+    responseLength = 0;
+    callableTime_InNS = 0;
+    startTime_InNS = simGetTimeInNS();
+    commandEndTime_InNS = startTime_InNS + packetLength * byteTime_InNS;
+    simUsartReceive(packet, packetLength);
+
+    while(!(responseComplete() && !simUsartReceivePending() && !simUsartTransmitBusy()))
+    {
+      if (simGetTimeInNS() - startTime_InNS >= BENCH_GIVE_UP_PERIOD_InNS)
+        break;
+      loopStartTime_InNS = simGetTimeInNS();
+      loop();
+      if (simGetTimeInNS() == loopStartTime_InNS)
+        simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+    }
+
+    if (!responseComplete())
+      continue;
+
+    results.answered++;
+    results.roundTrips_InNS.push_back(responseEndTime_InNS - startTime_InNS);
+    results.wireTime_InNS += (commandEndTime_InNS - startTime_InNS) + (responseEndTime_InNS - responseStartTime_InNS);
+    results.callableTime_InNS += callableTime_InNS;
+    results.turnaroundTime_InNS += responseStartTime_InNS - commandEndTime_InNS - callableTime_InNS;
+  }
+
+  callable->call = timedCallable;
+}
+
+
+
+//
+// print one row of results after the given label
+//
+static void printResults(LatencyResults &results)
+{
+  std::vector<unsigned long long> &times = results.roundTrips_InNS;
+
+  if (results.answered == 0)
+  {
+    printf("  no response\n");
+    return;
+  }
+
+  std::sort(times.begin(), times.end());
+  printf(" %10.1f %10.1f %10.1f%c %10.1f %10.1f %10.1f\n",
+    times[times.size() / 2] / 1000.0,
+    times[(times.size() * 99) / 100] / 1000.0,
+    times.back() / 1000.0,
+    (times.back() > MASTER_TIMEOUT_PERIOD_InNS) ? '*' : ' ',
+    results.wireTime_InNS / 1000.0 / results.answered,
+    results.turnaroundTime_InNS / 1000.0 / results.answered,
+    results.callableTime_InNS / 1000.0 / results.answered);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  long frames = 100;
+  long baudRate = 115200;
+  int slaveAddress = 17;
+  int option;
+
+  byte data[MASTER_COMMAND_MAX_DATA_BYTES];
+  LatencyResults results;
+  const CallableArguments *arguments;
+  const char *header = "    p50 us     p99 us     max us     wire us  turnaround   callable";
+
+
+  while((option = getopt(argc, argv, "n:b:a:")) != -1)
+  {
+    switch(option)
+    {
+      case 'n': frames = atol(optarg); break;
+      case 'b': baudRate = atol(optarg); break;
+      case 'a': slaveAddress = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n frames] [-b baudRate] [-a slaveAddress]\n", argv[0]);
+        return(1);
+    }
+  }
+
+  //
+  // power up the board, then reopen the port with the settings for this run
+  //
+  simReset();
+  setup();
+  serialSlave.open(baudRate, slaveAddress, TRANSMITTER_ENABLE_PIN);
+  simUsartSetDriverEnablePin(TRANSMITTER_ENABLE_PIN);
+  simUsartSetTransmitHook(collectResponseByte);
+  simSetWaitHook(updateHomeSwitch);
+
+  for (int i = 0; i < MASTER_COMMAND_MAX_DATA_BYTES; i++)
+    data[i] = i;
+
+  printf("Round trip latency, %ld packets per row, times are means unless marked p50/p99/max\n", frames);
+
+  //
+  // echo with each payload size
+  //
+  printf("\necho at %ld baud (%lu actual)\n", baudRate, simUsartGetBaudRate());
+  printf("  %-22s%s\n", "data bytes", header);
+  for (int dataLength = 0; dataLength <= MASTER_COMMAND_MAX_DATA_BYTES; dataLength++)
+  {
+    measureCommand(slaveAddress, ECHO_COMMAND, dataLength, data, frames, results);
+    printf("  %-22d", dataLength);
+    printResults(results);
+  }
+
+  //
+  // echo at each baud rate
+  //
+  printf("\necho with %d data bytes at each baud rate\n", ECHO_DATA_LENGTH);
+  printf("  %-8s%-14s%s\n", "baud", "actual", header);
+  for (long rate : BAUD_RATES)
+  {
+    serialSlave.open(rate, slaveAddress, TRANSMITTER_ENABLE_PIN);
+    measureCommand(slaveAddress, ECHO_COMMAND, ECHO_DATA_LENGTH, data, frames, results);
+    printf("  %-8ld%-8lu%+5.1f%%", rate, simUsartGetBaudRate(),
+      100.0 * ((double) simUsartGetBaudRate() - rate) / rate);
+    printResults(results);
+  }
+
+  //
+  // every callable
+  //
+  serialSlave.open(baudRate, slaveAddress, TRANSMITTER_ENABLE_PIN);
+  printf("\ncallables at %ld baud\n", baudRate);
+  printf("  %-3s %-18s%s\n", "#", "name", header);
+  for (int command = 0; command < numberOfInternalCallables + numberOfExternalCallables; command++)
+  {
+    arguments = &DEFAULT_ARGUMENTS;
+    for (const CallableArguments &entry : CALLABLE_ARGUMENTS)
+    {
+      if (strcmp(entry.shortName, getCallable(command)->shortName) == 0)
+        arguments = &entry;
+    }
+
+    measureCommand(slaveAddress, command, arguments->dataLength, arguments->data, frames, results);
+    printf("  %-3d %-18s", command, getCallable(command)->shortName);
+    printResults(results);
+  }
+
+  return(0);
+}
+
+// -------------------------------------- End --------------------------------------
@@ -0,0 +1,645 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                        SerialSlaveBench                        *
+//      *                                                                *
+//      *       Packet rate and ISR cost of SerialSlave on the host      *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Runs the Slave sketch on the simulated hardware and plays the part of the master:
+// it sends command packets into USART 2 and collects the responses that the UDRE ISR
+// shifts out.  At the end it reports how many packets per second the link carries in
+// virtual time (bounded by the baud rate and the slave's turnaround), how many the
+// firmware could process per second of host CPU time, and the cost of each ISR.  The
+// RX ISR runs once a byte, so its cost is the cost per byte of receiving; its virtual
+// time is the AVR clock cycles charged for the frame check.
+//
+// With -q each command carries a sequence number and is sent a second time once it has
+// been answered, the way the master tries again when it loses a response.  The second
+// copy must get the first response back unchanged, from the slave's saved copy rather
+// than by running the command again.
+//
+// With -w the commands are sequenced and sent in windows: a burst of that many packets
+// back to back, then their responses read in order, the way SlaveMaster's
+// send_command_async() pipelines them.  With -q as well the whole burst is sent twice.
+// The wire time is the same either way, windows save the master's turnaround between
+// reading a response and sending again, which -t adds (a USB serial adapter takes about
+// a millisecond).
+//
+// With -o each full window is followed in the same burst by one packet more, whose
+// sequence takes the place in the window of the first packet while that one's response
+// is still held.  The slave must drop it rather than lose the held response, so the
+// window's responses must all come back in order and nothing more.  It is sent again as
+// the first packet of the next window, the way the master tries again.  -u makes the
+// slave wait longer for the line to go quiet before it sends, so the responses are held
+// longer (serialBench -w 4 -o -u 2000).
+//
+// With -m each packet is a batch of that many copies of the command, run by the slave
+// one after the other and answered with one response, the way SlaveMaster's Batch
+// sends them.  The link rate is then in commands rather than packets.
+//
+// Usage:
+//    serialBench [-n frames] [-b baudRate] [-a slaveAddress] [-c command] [-l dataLength] [-k] [-q] 
+//                [-w window] [-t turnaroundUS] [-m batchRecords] [-o] [-u quietUS]
+//
+//    -n  number of command packets to send (default 10000)
+//    -b  baud rate passed to SerialSlave::open() (default 115200)
+//    -a  slave address (default 17, the address in Slave.ino)
+//    -c  command number (default 2, "echo")
+//    -l  number of data bytes in each command packet (default 8)
+//    -k  check the packets with a CRC-16 rather than the 8 bit checksum
+//    -q  number the packets with a sequence and send each one twice
+//    -w  number of sequenced packets sent before reading their responses (1 - 4)
+//    -t  time the master takes from reading a response to sending again, in us (default 0)
+//    -m  number of commands in each packet, sent as a batch
+//    -o  send a packet past each full window (-w 4), it must be dropped
+//    -u  time the line must be quiet before the slave sends a held response, in us
+//        (default 2 byte times)
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include "SimHardware.h"
+#include "SerialSlave.h"
+
+
+//
+// constants from the packet definitions in SerialSlave.cpp
+//
+const byte MASTER_COMMAND_HEADER_BYTE_1 = 0xAA;
+const byte MASTER_COMMAND_HEADER_BYTE_2 = 0x55;
+const byte MASTER_COMMAND_HEADER_BYTE_2_CRC = 0x5A;
+const byte MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED = 0x56;
+const byte MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED = 0x5B;
+const byte MASTER_COMMAND_BATCH = 0xFF;
+const byte SLAVE_RESPONSE_RECEIVED_COMMAND = 0xA9;
+const byte SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA = 0xAC;
+const byte SLAVE_RESPONSE_RESEND_COMMAND = 0xB8;
+
+const unsigned long long MASTER_TIMEOUT_PERIOD_InNS = 100000000ULL;
+
+const byte TRANSMITTER_ENABLE_PIN = 40;
+
+//
+// time charged for a pass through loop() that calls nothing that takes time, about
+// what serialSlave.service() costs when there is nothing to do
+//
+const unsigned long long LOOP_MINIMUM_PERIOD_InNS = 1000ULL;
+
+
+//
+// most packets the slave takes in a window, SEQUENCE_WINDOW_SIZE in SerialSlave.cpp
+//
+const int MAX_WINDOW = 4;
+
+
+//
+// the sketch
+//
+void setup(void);
+void loop(void);
+
+
+//
+// response collected from the transmit hook
+//
+static byte responseBytes[(SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES + 8) * MAX_WINDOW];
+static int responseLength;
+static unsigned long long responseEndTime_InNS;
+static bool useCRC = false;
+static bool useSequence = false;
+static bool repeatPackets = false;
+static unsigned long long masterTurnaround_InNS = 0;
+static bool overflowWindows = false;
+
+
+//
+// from SerialSlave.cpp, -u sets it
+//
+extern unsigned long lineQuietPeriod_InUS;
+
+
+//
+// keep every byte that made it onto the RS-485 line
+//
+static void collectResponseByte(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                                unsigned long long endTime_InNS)
+{
+  if (!driverEnabled || (responseLength >= (int) sizeof(responseBytes)))
+    return;
+
+  responseBytes[responseLength] = c;
+  responseLength++;
+  responseEndTime_InNS = endTime_InNS;
+}
+
+
+
+//
+// find the length of the first response packet in the bytes collected so far
+//  Exit:  0 if it is not complete, else its number of bytes
+//
+static int responsePacketLength(void)
+{
+  int checkLength = useCRC ? 2 : 1;
+  int sequenceLength = useSequence ? 1 : 0;
+  int packetLength = 2;
+
+  if (responseLength < 2)
+    return(0);
+
+  if (responseBytes[0] == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA)
+  {
+    if (responseLength < 3 + sequenceLength)
+      return(0);
+    packetLength = responseBytes[2 + sequenceLength] + 3 + sequenceLength + checkLength;
+  }
+  else if (responseBytes[0] == SLAVE_RESPONSE_RECEIVED_COMMAND)
+    packetLength = 2 + sequenceLength;
+
+  if (responseLength < packetLength)
+    return(0);
+  return(packetLength);
+}
+
+
+
+//
+// check if the bytes collected so far form a complete response packet
+//  Exit:  0 if not complete, else the response type
+//
+static byte responseComplete(void)
+{
+  if (responsePacketLength() == 0)
+    return(0);
+  return(responseBytes[0]);
+}
+
+
+
+//
+// drop the first response packet from the bytes collected, once it has been checked
+//
+static void removeResponse(void)
+{
+  int packetLength = responsePacketLength();
+
+  memmove(responseBytes, responseBytes + packetLength, responseLength - packetLength);
+  responseLength -= packetLength;
+}
+
+
+
+//
+// CRC-16/MODBUS of a run of bytes, worked out a bit at a time
+//
+static uint16_t crc16(const byte data[], int dataLength)
+{
+  uint16_t crc = 0xFFFF;
+
+  for (int i = 0; i < dataLength; i++)
+  {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+  }
+  return(crc);
+}
+
+
+
+//
+// check the checksum or CRC of a response that came with data
+//  Exit:  true returned if it is good
+//
+static bool responseCheckGood(void)
+{
+  int checkedLength = (useSequence ? 2 : 1) + responseBytes[useSequence ? 3 : 2];
+  byte checksum = 0;
+  uint16_t crc;
+
+  if (useCRC)
+  {
+    crc = crc16(&responseBytes[2], checkedLength);
+    return((responseBytes[checkedLength + 2] == (crc & 0xff)) && (responseBytes[checkedLength + 3] == (crc >> 8)));
+  }
+
+  for (int i = 0; i < checkedLength; i++)
+    checksum += responseBytes[i + 2];
+  return(responseBytes[checkedLength + 2] == checksum);
+}
+
+
+
+//
+// build a command packet the same way SlaveMaster.py does
+//  Enter:  sequence = sequence number of the packet, used with -q
+//  Exit:   number of bytes in the packet returned
+//
+static int buildCommandPacket(byte packet[], byte slaveAddress, byte sequence, byte command, 
+  byte dataLength, byte data[])
+{
+  int packetLength = 0;
+  byte checksum;
+  uint16_t crc;
+
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_1;
+  if (useSequence)
+    packet[packetLength++] = useCRC ? MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED : MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED;
+  else
+    packet[packetLength++] = useCRC ? MASTER_COMMAND_HEADER_BYTE_2_CRC : MASTER_COMMAND_HEADER_BYTE_2;
+  packet[packetLength++] = slaveAddress;
+  checksum = slaveAddress;
+  if (useSequence)
+  {
+    packet[packetLength++] = sequence;
+    checksum += sequence;
+  }
+  packet[packetLength++] = command;
+  packet[packetLength++] = dataLength;
+  checksum += command + dataLength;
+
+  for (int i = 0; i < dataLength; i++)
+  {
+    packet[packetLength++] = data[i];
+    checksum += data[i];
+  }
+
+  if (useCRC)
+  {
+    crc = crc16(&packet[2], packetLength - 2);
+    packet[packetLength++] = crc & 0xff;
+    packet[packetLength++] = crc >> 8;
+  }
+  else
+    packet[packetLength++] = checksum;
+  return(packetLength);
+}
+
+
+
+//
+// run the sketch while the master turns around from reading to sending
+//
+static void waitForMasterTurnaround(void)
+{
+  unsigned long long endTime_InNS = simGetTimeInNS() + masterTurnaround_InNS;
+
+  while(simGetTimeInNS() < endTime_InNS)
+  {
+    loop();
+    simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+  }
+}
+
+
+
+//
+// send a packet to the slave and run the sketch until the response is complete, or until
+// the master would give up
+//  Enter:  startTime_InNS = the time the master started on the packet
+//
+static void exchangePacket(const byte packet[], int packetLength, unsigned long long startTime_InNS)
+{
+  unsigned long long loopStartTime_InNS;
+
+  responseLength = 0;
+  waitForMasterTurnaround();
+  simUsartReceive(packet, packetLength);
+
+  while(true)
+  {
+    loopStartTime_InNS = simGetTimeInNS();
+    loop();
+    if (simGetTimeInNS() == loopStartTime_InNS)
+      simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+
+    if (responseComplete() && !simUsartReceivePending() && !simUsartTransmitBusy())
+      break;
+
+    if (simGetTimeInNS() - startTime_InNS >= MASTER_TIMEOUT_PERIOD_InNS)
+      break;
+  }
+}
+
+
+
+//
+// send a window of sequenced packets back to back, then run the sketch until all of
+// their responses are in, or until the master would give up
+//  Enter:  firstSequence = sequence of the first packet in the window
+//          windowSize = number of packets
+//          overflow = true to send one more packet behind a full window, which must not
+//            be answered
+//  Exit:   number of responses in order with good checks returned, each one that came
+//          wrong adds to badResponses
+//
+static int exchangeWindow(byte slaveAddress, byte firstSequence, int windowSize, byte command, 
+  byte dataLength, byte data[], bool overflow, long &badResponses)
+{
+  byte burst[(MASTER_BATCH_MAX_DATA_BYTES + 8) * (MAX_WINDOW + 1)];
+  int burstLength = 0;
+  int responses = 0;
+  unsigned long long startTime_InNS;
+  unsigned long long loopStartTime_InNS;
+  unsigned long long quietEndTime_InNS;
+
+  for (int i = 0; i < windowSize; i++)
+    burstLength += buildCommandPacket(burst + burstLength, slaveAddress, firstSequence + i, command, dataLength, data);
+  overflow = overflow && (windowSize == MAX_WINDOW);
+  if (overflow)
+    burstLength += buildCommandPacket(burst + burstLength, slaveAddress, firstSequence + MAX_WINDOW, command, dataLength, data);
+
+  responseLength = 0;
+  startTime_InNS = simGetTimeInNS();
+  waitForMasterTurnaround();
+  simUsartReceive(burst, burstLength);
+
+  while(responses < windowSize)
+  {
+    loopStartTime_InNS = simGetTimeInNS();
+    loop();
+    if (simGetTimeInNS() == loopStartTime_InNS)
+      simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+
+    while(responseComplete() && (responses < windowSize))
+    {
+      if ((responseComplete() == SLAVE_RESPONSE_RESEND_COMMAND) || 
+        (responseBytes[2] != (byte) (firstSequence + responses)) ||
+        ((responseComplete() == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA) && !responseCheckGood()))
+        badResponses++;
+      removeResponse();
+      responses++;
+    }
+
+    if (simGetTimeInNS() - startTime_InNS >= MASTER_TIMEOUT_PERIOD_InNS)
+      break;
+  }
+
+  while(simUsartTransmitBusy())
+  {
+    loop();
+    simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+  }
+
+  //
+  // the packet past the window must not get a response, one would have started once
+  // the line had been quiet after the last
+  //
+  if (overflow)
+  {
+    quietEndTime_InNS = simGetTimeInNS() + 2ULL * lineQuietPeriod_InUS * 1000ULL + simUsartGetByteTimeInNS() * 4;
+    while(simGetTimeInNS() < quietEndTime_InNS)
+    {
+      loop();
+      simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+    }
+    if (responseLength > 0)
+      badResponses++;
+  }
+  return(responses);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  long frames = 10000;
+  long baudRate = 115200;
+  int slaveAddress = 17;
+  int command = 2;
+  int dataLength = 8;
+  int option;
+
+  byte data[MASTER_BATCH_MAX_DATA_BYTES];
+  byte packet[MASTER_BATCH_MAX_DATA_BYTES + 8];
+  int packetLength;
+  unsigned long long startTime_InNS;
+  byte firstResponseBytes[sizeof(responseBytes)];
+  int firstResponseLength;
+  unsigned long long roundTripTime_InNS;
+  unsigned long long totalRoundTripTime_InNS = 0;
+  unsigned long long maxRoundTripTime_InNS = 0;
+  unsigned long long totalHostTime_InNS;
+  long answered = 0;
+  long resendRequests = 0;
+  long timeouts = 0;
+  long badResponses = 0;
+  long replays = 0;
+  int windowSize = 0;
+  int batchRecords = 0;
+  int commandsPerPacket = 1;
+  int burstSize;
+  int responses;
+  long quietPeriod_InUS = 0;
+  const SimInterruptStatistics *statistics;
+
+
+  while((option = getopt(argc, argv, "n:b:a:c:l:kqw:t:m:ou:")) != -1)
+  {
+    switch(option)
+    {
+      case 'n': frames = atol(optarg); break;
+      case 'b': baudRate = atol(optarg); break;
+      case 'a': slaveAddress = atoi(optarg); break;
+      case 'c': command = atoi(optarg); break;
+      case 'l': dataLength = atoi(optarg); break;
+      case 'k': useCRC = true; break;
+      case 'q': useSequence = true; repeatPackets = true; break;
+      case 'w': windowSize = atoi(optarg); useSequence = true; break;
+      case 't': masterTurnaround_InNS = atol(optarg) * 1000ULL; break;
+      case 'm': batchRecords = atoi(optarg); break;
+      case 'o': overflowWindows = true; break;
+      case 'u': quietPeriod_InUS = atol(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n frames] [-b baudRate] [-a slaveAddress] [-c command] [-l dataLength] [-k] [-q] [-w window] [-t turnaroundUS] [-m batchRecords] [-o] [-u quietUS]\n", argv[0]);
+        return(1);
+    }
+  }
+
+  if ((dataLength < 0) || (dataLength > MASTER_COMMAND_MAX_DATA_BYTES))
+  {
+    fprintf(stderr, "data length must be 0 - %d\n", MASTER_COMMAND_MAX_DATA_BYTES);
+    return(1);
+  }
+
+  if ((windowSize < 0) || (windowSize > MAX_WINDOW))
+  {
+    fprintf(stderr, "window must be 1 - %d\n", MAX_WINDOW);
+    return(1);
+  }
+
+  if (overflowWindows && (windowSize != MAX_WINDOW))
+  {
+    fprintf(stderr, "-o needs a full window, -w %d\n", MAX_WINDOW);
+    return(1);
+  }
+
+  if ((batchRecords < 0) || (batchRecords * (dataLength + 2) > MASTER_BATCH_MAX_DATA_BYTES))
+  {
+    fprintf(stderr, "a batch holds at most %d bytes of records\n", MASTER_BATCH_MAX_DATA_BYTES);
+    return(1);
+  }
+
+  //
+  // power up the board, then reopen the port with the settings for this run
+  //
+  simReset();
+  setup();
+  serialSlave.open(baudRate, slaveAddress, TRANSMITTER_ENABLE_PIN);
+  simUsartSetDriverEnablePin(TRANSMITTER_ENABLE_PIN);
+  simUsartSetTransmitHook(collectResponseByte);
+  if (quietPeriod_InUS > 0)
+    lineQuietPeriod_InUS = quietPeriod_InUS;
+  simClearInterruptStatistics();
+
+  for (int i = 0; i < dataLength; i++)
+    data[i] = i;
+
+  //
+  // a batch packet holds a record for each copy of the command, its number, its data
+  // length and the data
+  //
+  if (batchRecords > 0)
+  {
+    for (int record = batchRecords - 1; record >= 0; record--)
+    {
+      memmove(data + record * (dataLength + 2) + 2, data, dataLength);
+      data[record * (dataLength + 2)] = command;
+      data[record * (dataLength + 2) + 1] = dataLength;
+    }
+    command = MASTER_COMMAND_BATCH;
+    dataLength = batchRecords * (dataLength + 2);
+    commandsPerPacket = batchRecords;
+  }
+  packetLength = buildCommandPacket(packet, slaveAddress, 0, command, dataLength, data);
+
+  //
+  // send the packets a window at a time, reading the responses after each burst
+  //
+  for (long frame = 0; (windowSize > 0) && (frame < frames); frame += windowSize)
+  {
+    burstSize = (int) std::min((long) windowSize, frames - frame);
+    startTime_InNS = simGetTimeInNS();
+    responses = exchangeWindow(slaveAddress, frame, burstSize, command, dataLength, data, overflowWindows, badResponses);
+    answered += responses;
+    timeouts += burstSize - responses;
+
+    roundTripTime_InNS = responseEndTime_InNS - startTime_InNS;
+    totalRoundTripTime_InNS += roundTripTime_InNS;
+    if (roundTripTime_InNS > maxRoundTripTime_InNS)
+      maxRoundTripTime_InNS = roundTripTime_InNS;
+
+    if (repeatPackets)
+      replays += exchangeWindow(slaveAddress, frame, burstSize, command, dataLength, data, false, badResponses);
+  }
+
+  //
+  // send the packets one at a time, waiting for each response like the master does
+  //
+  for (long frame = 0; (windowSize == 0) && (frame < frames); frame++)
+  {
+    if (useSequence)
+      packetLength = buildCommandPacket(packet, slaveAddress, frame, command, dataLength, data);
+
+    startTime_InNS = simGetTimeInNS();
+    exchangePacket(packet, packetLength, startTime_InNS);
+
+    if (!responseComplete())
+    {
+      timeouts++;
+      continue;
+    }
+
+    if (responseComplete() == SLAVE_RESPONSE_RESEND_COMMAND)
+      resendRequests++;
+    else
+      answered++;
+
+    if ((responseComplete() == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA) && !responseCheckGood())
+      badResponses++;
+
+    roundTripTime_InNS = responseEndTime_InNS - startTime_InNS;
+    totalRoundTripTime_InNS += roundTripTime_InNS;
+    if (roundTripTime_InNS > maxRoundTripTime_InNS)
+      maxRoundTripTime_InNS = roundTripTime_InNS;
+
+    //
+    // send the same packet again, it must be answered with the same response
+    //
+    if (repeatPackets && (responseComplete() != SLAVE_RESPONSE_RESEND_COMMAND))
+    {
+      firstResponseLength = responseLength;
+      memcpy(firstResponseBytes, responseBytes, responseLength);
+      exchangePacket(packet, packetLength, simGetTimeInNS());
+
+      if ((responseLength == firstResponseLength) && (memcmp(responseBytes, firstResponseBytes, responseLength) == 0))
+        replays++;
+      else
+        badResponses++;
+    }
+  }
+
+  //
+  // report
+  //
+  totalHostTime_InNS = 0;
+  for (int vector = 0; vector < SIM_NUMBER_OF_VECTORS; vector++)
+    totalHostTime_InNS += simGetInterruptStatistics(vector)->totalHostTime_InNS;
+
+  printf("SerialSlave host benchmark\n");
+  printf("  baud rate:          %ld requested, %lu actual\n", baudRate, simUsartGetBaudRate());
+  printf("  command packet:     command %d, %d data bytes, %d bytes on the wire, %s%s\n", command, dataLength,
+    packetLength, useCRC ? "CRC-16" : "8 bit checksum", useSequence ? ", sequenced" : "");
+  printf("  packets:            %ld sent, %ld answered, %ld resend requests, %ld timeouts, %ld bad responses\n",
+    frames, answered, resendRequests, timeouts, badResponses);
+  if (repeatPackets)
+    printf("  sequenced:          %ld repeated packets answered with the saved response\n", replays);
+  printf("  receive overruns:   %lu\n", simUsartGetOverrunCount());
+
+  if (answered + resendRequests > 0)
+  {
+    if (windowSize > 0)
+    {
+      printf("  window round trip:  %.1f us mean, %.1f us max\n",
+        totalRoundTripTime_InNS / 1000.0 / ((frames + windowSize - 1) / windowSize), maxRoundTripTime_InNS / 1000.0);
+      printf("  link rate:          %.0f packets/second (virtual time, windows of %d)\n",
+        answered * 1e9 / totalRoundTripTime_InNS, windowSize);
+    }
+    else
+    {
+      printf("  round trip:         %.1f us mean, %.1f us max\n",
+        totalRoundTripTime_InNS / 1000.0 / (answered + resendRequests), maxRoundTripTime_InNS / 1000.0);
+      printf("  link rate:          %.0f packets/second (virtual time, stop and wait)\n",
+        (answered + resendRequests) * 1e9 / totalRoundTripTime_InNS);
+    }
+    if (batchRecords > 0)
+      printf("  command rate:       %.0f commands/second (virtual time, batches of %d)\n",
+        answered * commandsPerPacket * 1e9 / totalRoundTripTime_InNS, batchRecords);
+  }
+  if (totalHostTime_InNS > 0)
+    printf("  host rate:          %.0f packets/second (host CPU time in the ISRs)\n",
+      frames * 1e9 / totalHostTime_InNS);
+
+  printf("  %-20s %10s %12s %12s %14s %14s\n", "ISR", "calls", "mean ns", "worst ns", "mean virt ns", "worst virt us");
+  for (int vector = 0; vector < SIM_NUMBER_OF_VECTORS; vector++)
+  {
+    statistics = simGetInterruptStatistics(vector);
+    printf("  %-20s %10lu %12.0f %12llu %14.0f %14.1f\n",
+      statistics->name,
+      statistics->count,
+      statistics->count ? (double) statistics->totalHostTime_InNS / statistics->count : 0.0,
+      statistics->maxHostTime_InNS,
+      statistics->count ? (double) statistics->totalVirtualTime_InNS / statistics->count : 0.0,
+      statistics->maxVirtualTime_InNS / 1000.0);
+  }
+
+  return(((timeouts == 0) && (badResponses == 0)) ? 0 : 2);
+}
+
+// -------------------------------------- End --------------------------------------
@@ -0,0 +1,621 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                         SerialSlaveFuzz                        *
+//      *                                                                *
+//      *      Fuzz harness for the SerialSlave receive state machine    *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Feeds arbitrary bytes into USART 2 of the simulated board at the line rate, as
+// ISR(USART2_RX_vect) would see them on a noisy RS-485 line, then sends valid probe
+// packets until one gets through.  Each input checks that:
+//    * the state machine never leaves its states or overruns its buffers (the build
+//      uses the address and undefined behavior sanitizers to catch the rest)
+//    * framing always recovers, a probe packet is accepted within MAX_PROBE_PACKETS
+//
+// A command other than the probe that runs once the probes start is a false accept:
+// a packet started by the noise swallowed probe bytes and its 8 bit checksum matched
+// by chance.  These are counted rather than treated as failures, they are a property
+// of the checksum, roughly 1 in 256 packets that end up misframed.
+//
+// Every callable is replaced with a stub that only counts the call, so the harness
+// tests the framing and command dispatch rather than the stepper code, and a command
+// like blinkLED can't spend seconds of virtual time on one input.
+//
+// Before that, the harness gives a callable a name longer than a response holds and
+// asks for it with get_nth_call.  The name must come back cut off at
+// SLAVE_RESPONSE_MAX_DATA_BYTES, and returns() must not write past returnData, which
+// the sanitizers catch.
+//
+// The harness has the libFuzzer entry point LLVMFuzzerTestOneInput().  Built with
+// clang and SIM_LIBFUZZER defined ("make fuzz-libfuzzer CXX=clang++") it is coverage
+// guided by libFuzzer.  Otherwise the main() below drives it:
+//
+//    fuzzSlave [-r runs] [-s seed] [-m maxLength] [file ...]
+//
+//    -r  number of generated inputs (default 100000)
+//    -s  random seed (default 1)
+//    -m  maximum length of a generated input in bytes (default 64)
+//    file  replay these inputs instead of generating them (crash files or a corpus)
+//
+// Generated inputs mix random noise with valid, corrupted and truncated packets, checked
+// with the checksum or a CRC and some with a sequence, so that every state is reached and
+// repeated sequences are replayed.  Some packets are batches of random records.  An input that fails a check is written to
+// fuzzSlave-crash.bin before the harness aborts.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "SimHardware.h"
+#include "SerialSlave.h"
+
+
+//
+// constants from the packet definitions in SerialSlave.cpp
+//
+const byte MASTER_COMMAND_HEADER_BYTE_1 = 0xAA;
+const byte MASTER_COMMAND_HEADER_BYTE_2 = 0x55;
+const byte MASTER_COMMAND_HEADER_BYTE_2_CRC = 0x5A;
+const byte MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED = 0x56;
+const byte MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED = 0x5B;
+const byte MASTER_COMMAND_BATCH = 0xFF;
+const byte SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA = 0xAC;
+const byte SLAVE_RESPONSE_RESEND_COMMAND = 0xB8;
+const byte SLAVE_STATE_WAITING_FOR_SEQUENCE_BYTE = 9;    // the last state
+
+const long FUZZ_BAUD_RATE = 115200;
+const byte FUZZ_SLAVE_ADDRESS = 17;
+const byte TRANSMITTER_ENABLE_PIN = 40;
+
+//
+// the probe is an echo packet with data that the noise is unlikely to copy.  A packet
+// the noise starts can take in probes until it is as long as the longest batch packet,
+// the next probe after that must get through.
+//
+const byte PROBE_COMMAND = 2;
+const byte PROBE_DATA[] = {'P', 'R', 'O', 'B'};
+const int PROBE_PACKET_BYTES = sizeof(PROBE_DATA) + 6;
+const int LONGEST_PACKET_BYTES = MASTER_BATCH_MAX_DATA_BYTES + 8;
+const int MAX_PROBE_PACKETS = (LONGEST_PACKET_BYTES + PROBE_PACKET_BYTES - 1) / PROBE_PACKET_BYTES + 1;
+
+//
+// get_nth_call, and the name it is asked for, longer than returnData
+//
+const byte GET_NTH_CALLABLE_COMMAND = 1;
+const char LONG_CALLABLE_NAME[] = "a_callable_name_longer_than_one_response";
+
+
+//
+// the callable tables and the receive state, from SerialSlave.cpp and Slave.ino
+//
+extern Callable internalCallables[];
+extern byte numberOfInternalCallables;
+extern byte numberOfExternalCallables;
+extern byte slaveState;
+extern byte dataArrayFromMasterIdx;
+extern volatile byte commandQueueHead;
+extern volatile byte commandQueueTail;
+
+
+//
+// statistics over every input
+//
+typedef struct fuzzStatistics {
+  unsigned long inputs;
+  unsigned long long bytes;
+  unsigned long commandsRun;
+  unsigned long resendResponses;
+  unsigned long overruns;
+  unsigned long probePacketsSent;
+  unsigned long probePacketsDropped;
+  unsigned long falseAccepts;
+  std::vector<unsigned long> resyncBytes;
+} FuzzStatistics;
+
+
+//
+// variables global to this module
+//
+static FuzzStatistics statistics;
+static bool probing;
+static bool probeAccepted;
+static unsigned long spuriousCommands;
+static bool startOfResponse;
+static const uint8_t *currentInput;
+static size_t currentInputSize;
+static byte responseBytes[SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES + 8];
+static int responseLength;
+
+
+
+//
+// write the input that failed to a file and stop
+//
+static void fail(const char *message)
+{
+  FILE *file;
+
+  fprintf(stderr, "fuzzSlave: %s\n", message);
+  file = fopen("fuzzSlave-crash.bin", "wb");
+  if (file != NULL)
+  {
+    fwrite(currentInput, 1, currentInputSize, file);
+    fclose(file);
+    fprintf(stderr, "fuzzSlave: input written to fuzzSlave-crash.bin\n");
+  }
+  abort();
+}
+
+
+
+//
+// replaces every callable, counts the commands that got through
+//
+static void stubCallable(byte dataLength, byte dataArray[])
+{
+  if (!probing)
+  {
+    statistics.commandsRun++;
+    return;
+  }
+
+  if ((dataLength == sizeof(PROBE_DATA)) && (memcmp(dataArray, PROBE_DATA, sizeof(PROBE_DATA)) == 0))
+    probeAccepted = true;
+  else
+    spuriousCommands++;
+}
+
+
+
+//
+// count the resend requests in the slave's responses
+//
+static void watchResponse(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                          unsigned long long endTime_InNS)
+{
+  if (startOfResponse && (c == SLAVE_RESPONSE_RESEND_COMMAND))
+    statistics.resendResponses++;
+  startOfResponse = false;
+}
+
+
+
+//
+// advance the clock until the slave has read and run every command and finished
+// responding
+//
+static void runUntilQuiet(void)
+{
+  unsigned long long byteTime_InNS = simUsartGetByteTimeInNS();
+
+  do
+  {
+    simAdvanceTimeInNS(byteTime_InNS);
+    serialSlave.service();
+
+    if (slaveState > SLAVE_STATE_WAITING_FOR_SEQUENCE_BYTE)
+      fail("receive state out of range");
+    if (dataArrayFromMasterIdx > MASTER_BATCH_MAX_DATA_BYTES)
+      fail("receive buffer overrun");
+    if (!simUsartTransmitBusy())
+      startOfResponse = true;
+  } while(simUsartReceivePending() || simUsartTransmitBusy() || (commandQueueHead != commandQueueTail));
+}
+
+
+
+//
+// keep the bytes of a response, for the checks that read it
+//
+static void collectResponse(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                            unsigned long long endTime_InNS)
+{
+  if (!driverEnabled || (responseLength >= (int) sizeof(responseBytes)))
+    return;
+
+  responseBytes[responseLength] = c;
+  responseLength++;
+}
+
+
+
+//
+// ask the sketch for the name of a callable that is longer than a response holds, the
+// response must carry the first SLAVE_RESPONSE_MAX_DATA_BYTES of it
+//
+static void checkLongCallableName(void)
+{
+  byte packet[MASTER_COMMAND_MAX_DATA_BYTES + 8];
+  int packetLength = 0;
+  const char *shortName;
+
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_1;
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_2;
+  packet[packetLength++] = FUZZ_SLAVE_ADDRESS;
+  packet[packetLength++] = GET_NTH_CALLABLE_COMMAND;
+  packet[packetLength++] = 1;
+  packet[packetLength++] = numberOfInternalCallables;
+  packet[packetLength++] = FUZZ_SLAVE_ADDRESS + GET_NTH_CALLABLE_COMMAND + 1 + numberOfInternalCallables;
+  currentInput = packet;
+  currentInputSize = packetLength;
+
+  shortName = callables[0].shortName;
+  callables[0].shortName = LONG_CALLABLE_NAME;
+
+  simReset();
+  serialSlave.open(FUZZ_BAUD_RATE, FUZZ_SLAVE_ADDRESS, TRANSMITTER_ENABLE_PIN);
+  simUsartSetDriverEnablePin(TRANSMITTER_ENABLE_PIN);
+  simUsartSetTransmitHook(collectResponse);
+  responseLength = 0;
+  simUsartReceive(packet, packetLength);
+  runUntilQuiet();
+
+  callables[0].shortName = shortName;
+
+  if ((responseLength != SLAVE_RESPONSE_MAX_DATA_BYTES + 4) ||
+    (responseBytes[0] != SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA) ||
+    (responseBytes[2] != SLAVE_RESPONSE_MAX_DATA_BYTES) ||
+    (memcmp(&responseBytes[3], LONG_CALLABLE_NAME, SLAVE_RESPONSE_MAX_DATA_BYTES) != 0))
+    fail("a long callable name was not cut off at the end of the response");
+}
+
+
+
+static int buildProbePacket(byte packet[])
+{
+  int packetLength = 0;
+  byte checksum;
+
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_1;
+  packet[packetLength++] = MASTER_COMMAND_HEADER_BYTE_2;
+  packet[packetLength++] = FUZZ_SLAVE_ADDRESS;
+  packet[packetLength++] = PROBE_COMMAND;
+  packet[packetLength++] = sizeof(PROBE_DATA);
+  checksum = FUZZ_SLAVE_ADDRESS + PROBE_COMMAND + sizeof(PROBE_DATA);
+
+  for (byte c : PROBE_DATA)
+  {
+    packet[packetLength++] = c;
+    checksum += c;
+  }
+
+  packet[packetLength++] = checksum;
+  return(packetLength);
+}
+
+
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  checkLongCallableName();
+
+  for (int command = 0; command < numberOfInternalCallables; command++)
+    internalCallables[command].call = stubCallable;
+  for (int command = 0; command < numberOfExternalCallables; command++)
+    callables[command].call = stubCallable;
+  return(0);
+}
+
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  byte probePacket[MASTER_COMMAND_MAX_DATA_BYTES + 8];
+  int probePacketLength;
+  int probePackets;
+  unsigned long overrunsBefore;
+
+  currentInput = data;
+  currentInputSize = size;
+
+  //
+  // power up the slave and send it the noise
+  //
+  simReset();
+  serialSlave.open(FUZZ_BAUD_RATE, FUZZ_SLAVE_ADDRESS, TRANSMITTER_ENABLE_PIN);
+  simUsartSetDriverEnablePin(TRANSMITTER_ENABLE_PIN);
+  simUsartSetTransmitHook(watchResponse);
+  startOfResponse = true;
+
+  probing = false;
+  overrunsBefore = simUsartGetOverrunCount();
+  simUsartReceive(data, size);
+  runUntilQuiet();
+
+  //
+  // then send probes until one is accepted
+  //
+  probing = true;
+  probeAccepted = false;
+  spuriousCommands = 0;
+  probePacketLength = buildProbePacket(probePacket);
+
+  for (probePackets = 1; probePackets <= MAX_PROBE_PACKETS; probePackets++)
+  {
+    simUsartReceive(probePacket, probePacketLength);
+    runUntilQuiet();
+    if (probeAccepted)
+      break;
+  }
+
+  if (!probeAccepted)
+    fail("framing did not recover");
+
+  statistics.inputs++;
+  statistics.bytes += size;
+  statistics.overruns += simUsartGetOverrunCount() - overrunsBefore;
+  statistics.probePacketsSent += probePackets;
+  statistics.probePacketsDropped += probePackets - 1;
+  statistics.falseAccepts += spuriousCommands;
+  statistics.resyncBytes.push_back((probePackets - 1) * probePacketLength);
+  return(0);
+}
+
+
+#ifndef SIM_LIBFUZZER
+
+//
+// random numbers for the generator
+//
+static unsigned long randomState;
+
+static unsigned long nextRandom(void)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 7;
+  randomState ^= randomState << 17;
+  return(randomState);
+}
+
+
+
+//
+// CRC-16/MODBUS of the packet bytes from the address on, worked out a bit at a time
+// rather than with the slave's table
+//
+static uint16_t crc16(const uint8_t data[], int dataLength)
+{
+  uint16_t crc = 0xFFFF;
+
+  for (int i = 0; i < dataLength; i++)
+  {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+  }
+  return(crc);
+}
+
+
+
+//
+// append a packet to the input, the way the master builds one but with random fields,
+// checked with either the checksum or a CRC and with or without a sequence, some of them
+// batches whose records are random too
+//
+static void appendPacket(std::vector<uint8_t> &input)
+{
+  byte address;
+  byte command;
+  byte dataLength;
+  byte checksum;
+  bool checkedWithCRC;
+  bool sequenced;
+  size_t addressIdx;
+  size_t dataStart;
+  int recordLength;
+  uint16_t crc;
+
+  switch(nextRandom() % 3)
+  {
+    case 0: address = FUZZ_SLAVE_ADDRESS; break;
+    case 1: address = 0; break;
+    default: address = nextRandom(); break;
+  }
+  if ((nextRandom() % 8) == 0)
+  {
+    command = MASTER_COMMAND_BATCH;
+    dataLength = nextRandom() % (MASTER_BATCH_MAX_DATA_BYTES + 3);
+  }
+  else
+  {
+    command = nextRandom() % 48;
+    dataLength = nextRandom() % (MASTER_COMMAND_MAX_DATA_BYTES + 3);
+  }
+  checkedWithCRC = (nextRandom() % 4) == 0;
+  sequenced = (nextRandom() % 4) == 0;
+
+  input.push_back(MASTER_COMMAND_HEADER_BYTE_1);
+  if (sequenced)
+    input.push_back(checkedWithCRC ? MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED : MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED);
+  else
+    input.push_back(checkedWithCRC ? MASTER_COMMAND_HEADER_BYTE_2_CRC : MASTER_COMMAND_HEADER_BYTE_2);
+  addressIdx = input.size();
+  input.push_back(address);
+  checksum = address;
+  if (sequenced)
+  {
+    input.push_back(nextRandom() % 4);
+    checksum += input.back();
+  }
+  input.push_back(command);
+  input.push_back(dataLength);
+  checksum += command + dataLength;
+  dataStart = input.size();
+  while(input.size() < dataStart + dataLength)
+  {
+    if (command == MASTER_COMMAND_BATCH)
+    {
+      input.push_back(nextRandom() % 48);
+      recordLength = nextRandom() % 6;
+      input.push_back(recordLength);
+      for (int i = 0; i < recordLength; i++)
+        input.push_back(nextRandom());
+    }
+    else
+      input.push_back(nextRandom());
+  }
+  input.resize(dataStart + dataLength);
+  for (size_t i = dataStart; i < input.size(); i++)
+    checksum += input[i];
+
+  if (checkedWithCRC)
+  {
+    crc = crc16(&input[addressIdx], input.size() - addressIdx);
+    input.push_back(crc & 0xff);
+    input.push_back(crc >> 8);
+  }
+  else
+    input.push_back(checksum);
+}
+
+
+
+//
+// build an input from noise and packets, some of them corrupted or cut short
+//
+static void generateInput(std::vector<uint8_t> &input, size_t maxLength)
+{
+  size_t packetStart;
+
+  input.clear();
+  while(input.size() < maxLength)
+  {
+    switch(nextRandom() % 4)
+    {
+      case 0:
+      {
+        for (int count = 1 + nextRandom() % 8; count > 0; count--)
+          input.push_back(nextRandom());
+        break;
+      }
+
+      case 1:
+      {
+        appendPacket(input);
+        break;
+      }
+
+      case 2:
+      {
+        packetStart = input.size();
+        appendPacket(input);
+        input[packetStart + nextRandom() % (input.size() - packetStart)] ^= 1 << (nextRandom() % 8);
+        break;
+      }
+
+      case 3:
+      {
+        packetStart = input.size();
+        appendPacket(input);
+        input.resize(packetStart + 1 + nextRandom() % (input.size() - packetStart));
+        break;
+      }
+    }
+  }
+  input.resize(maxLength);
+}
+
+
+
+static bool readInput(const char *path, std::vector<uint8_t> &input)
+{
+  FILE *file;
+  int c;
+
+  file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    perror(path);
+    return(false);
+  }
+
+  input.clear();
+  while((c = fgetc(file)) != EOF)
+    input.push_back(c);
+  fclose(file);
+  return(true);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  long runs = 100000;
+  unsigned long seed = 1;
+  size_t maxLength = 64;
+  int option;
+
+  std::vector<uint8_t> input;
+  std::vector<unsigned long> &resyncBytes = statistics.resyncBytes;
+  double totalResyncBytes;
+
+
+  while((option = getopt(argc, argv, "r:s:m:")) != -1)
+  {
+    switch(option)
+    {
+      case 'r': runs = atol(optarg); break;
+      case 's': seed = strtoul(optarg, NULL, 0); break;
+      case 'm': maxLength = atol(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-r runs] [-s seed] [-m maxLength] [file ...]\n", argv[0]);
+        return(1);
+    }
+  }
+
+  LLVMFuzzerInitialize(&argc, &argv);
+
+  if (optind < argc)
+  {
+    for (int i = optind; i < argc; i++)
+    {
+      if (!readInput(argv[i], input))
+        return(1);
+      LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+  }
+  else
+  {
+    randomState = seed ? seed : 1;
+    for (long run = 0; run < runs; run++)
+    {
+      generateInput(input, 1 + nextRandom() % maxLength);
+      LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+  }
+
+  //
+  // report
+  //
+  totalResyncBytes = 0;
+  for (unsigned long count : resyncBytes)
+    totalResyncBytes += count;
+  std::sort(resyncBytes.begin(), resyncBytes.end());
+
+  printf("SerialSlave receive framing fuzz\n");
+  printf("  inputs:             %lu, %llu bytes of noise\n", statistics.inputs, statistics.bytes);
+  printf("  commands run:       %lu by the noise\n", statistics.commandsRun);
+  printf("  resend responses:   %lu\n", statistics.resendResponses);
+  printf("  receive overruns:   %lu\n", statistics.overruns);
+  printf("  false accepts:      %lu commands run by misframed packets\n", statistics.falseAccepts);
+  printf("  probe packets:      %lu sent, %lu dropped\n", statistics.probePacketsSent,
+    statistics.probePacketsDropped);
+  if (!resyncBytes.empty())
+    printf("  resync:             %.2f bytes mean, %lu p99, %lu max, after the noise ends\n",
+      totalResyncBytes / resyncBytes.size(), resyncBytes[(resyncBytes.size() * 99) / 100],
+      resyncBytes.back());
+
+  return(0);
+}
+
+#endif
+
+// -------------------------------------- End --------------------------------------
@@ -0,0 +1,147 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                            SimBoard                            *
+//      *                                                                *
+//      *         One simulated board in a loadable shared library       *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+#include "SimBoard.h"
+#include "SerialSlave.h"
+
+
+//
+// the sketch
+//
+void setup(void);
+void loop(void);
+
+
+const unsigned long long LOOP_MINIMUM_PERIOD_InNS = 1000ULL;
+
+
+//
+// variables global to this module
+//
+static long boardBaudRate;
+static uint8_t boardSlaveAddress;
+static uint8_t boardTransmitterEnablePin;
+static void *harnessContext;
+static SimBoardTransmitHandler *harnessTransmitHandler;
+static SimBoardDriverEnableHandler *harnessDriverEnableHandler;
+static SimBoardYieldFunction *harnessYieldFunction;
+static unsigned long long allowedTime_InNS;
+static bool receivedWhileWaiting;
+
+
+//
+// pass bytes shifted out by USART 2 to the harness
+//
+static void forwardTransmittedByte(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                                   unsigned long long endTime_InNS)
+{
+  harnessTransmitHandler(harnessContext, c, driverEnabled, startTime_InNS, endTime_InNS);
+}
+
+
+
+//
+// pass changes of the RS-485 transmitter enable pin to the harness
+//
+static void forwardPinChange(uint8_t pin, uint8_t level, unsigned long long time_InNS)
+{
+  if (pin == boardTransmitterEnablePin)
+    harnessDriverEnableHandler(harnessContext, level, time_InNS);
+}
+
+
+
+//
+// called before the board's clock moves forward, hands control back to the harness
+// until it is allowed to get there, or until a byte arrives that needs handling first
+//
+static void waitForHarness(unsigned long long time_InNS)
+{
+  receivedWhileWaiting = false;
+  while((time_InNS > allowedTime_InNS) && !receivedWhileWaiting)
+    harnessYieldFunction(harnessContext);
+}
+
+
+
+static void begin(long baudRate, uint8_t slaveAddress, uint8_t transmitterEnablePin, void *context,
+                  SimBoardTransmitHandler *transmitHandler, SimBoardDriverEnableHandler *driverEnableHandler,
+                  SimBoardYieldFunction *yieldFunction)
+{
+  boardBaudRate = baudRate;
+  boardSlaveAddress = slaveAddress;
+  boardTransmitterEnablePin = transmitterEnablePin;
+  harnessContext = context;
+  harnessTransmitHandler = transmitHandler;
+  harnessDriverEnableHandler = driverEnableHandler;
+  harnessYieldFunction = yieldFunction;
+  allowedTime_InNS = 0;
+}
+
+
+
+static void run(void)
+{
+  unsigned long long loopStartTime_InNS;
+
+  simReset();
+  simSetWaitHook(waitForHarness);
+  simSetPinChangeHook(forwardPinChange);
+  simUsartSetDriverEnablePin(boardTransmitterEnablePin);
+  simUsartSetTransmitHook(forwardTransmittedByte);
+
+  setup();
+  serialSlave.open(boardBaudRate, boardSlaveAddress, boardTransmitterEnablePin);
+
+  while(true)
+  {
+    loopStartTime_InNS = simGetTimeInNS();
+    loop();
+    if (simGetTimeInNS() == loopStartTime_InNS)
+      simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+  }
+}
+
+
+
+static void setAllowedTime(unsigned long long time_InNS)
+{
+  allowedTime_InNS = time_InNS;
+}
+
+
+
+static void receiveAt(uint8_t c, unsigned long long arrivalTime_InNS)
+{
+  simUsartReceiveAt(c, arrivalTime_InNS);
+  receivedWhileWaiting = true;
+}
+
+
+
+static const SimBoardInterface boardInterface = {
+  begin,
+  run,
+  setAllowedTime,
+  simGetTimeInNS,
+  receiveAt,
+  simUsartGetByteTimeInNS,
+  simUsartGetOverrunCount,
+  simGetInterruptStatistics
+};
+
+
+
+extern "C" const SimBoardInterface *simBoardGetInterface(void)
+{
+  return(&boardInterface);
+}
+
+// -------------------------------------- End --------------------------------------
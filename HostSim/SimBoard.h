@@ -0,0 +1,66 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   Header file for SimBoard.cpp                 *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// A complete simulated board, the Slave sketch plus SimHardware, packaged in a shared
+// library.  The firmware keeps all of its state in globals, so a harness that needs more
+// than one board loads a separate copy of the library for each one and talks to it
+// through the interface below.
+//
+
+#ifndef SimBoard_h
+#define SimBoard_h
+
+#include "SimHardware.h"
+
+
+//
+// functions the harness supplies, context is the value given to begin()
+//
+typedef void SimBoardTransmitHandler(void *context, uint8_t c, bool driverEnabled,
+                                     unsigned long long startTime_InNS, unsigned long long endTime_InNS);
+typedef void SimBoardDriverEnableHandler(void *context, uint8_t level, unsigned long long time_InNS);
+typedef void SimBoardYieldFunction(void *context);
+
+
+//
+// the interface exported by each copy of the board library
+//
+typedef struct simBoardInterface {
+  //
+  // set up the board, nothing runs until run() is called
+  //
+  void (*begin)(long baudRate, uint8_t slaveAddress, uint8_t transmitterEnablePin, void *context,
+                SimBoardTransmitHandler *transmitHandler, SimBoardDriverEnableHandler *driverEnableHandler,
+                SimBoardYieldFunction *yieldFunction);
+
+  //
+  // power up and run the sketch, this never returns, so the harness runs it on its own
+  // stack.  Each time the board's clock would pass the allowed time it calls the yield
+  // function, and carries on when the harness moves the allowed time forward.
+  //
+  void (*run)(void);
+  void (*setAllowedTime)(unsigned long long time_InNS);
+
+  unsigned long long (*getTimeInNS)(void);
+  void (*receiveAt)(uint8_t c, unsigned long long arrivalTime_InNS);
+  unsigned long long (*getByteTimeInNS)(void);
+  unsigned long (*getOverrunCount)(void);
+  const SimInterruptStatistics *(*getInterruptStatistics)(int vector);
+} SimBoardInterface;
+
+
+//
+// name of the function that returns the interface, for dlsym()
+//
+#define SIM_BOARD_INTERFACE_FUNCTION "simBoardGetInterface"
+
+extern "C" const SimBoardInterface *simBoardGetInterface(void);
+
+// ------------------------------------ End ---------------------------------
+#endif
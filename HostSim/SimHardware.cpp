@@ -0,0 +1,1187 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                          SimHardware                           *
+//      *                                                                *
+//      *          Simulated ATMega 2560 for host builds of Slave        *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// This module implements the functions declared in the host Arduino.h on top of a
+// virtual clock.  Nothing happens in real time: the clock only moves forward when the
+// firmware delays, calls a core function that has a cost (micros(), digitalWrite(),
+// digitalRead()), charges the cycles of slow arithmetic with AVR_CYCLES(), or when the
+// harness advances it.
+//
+// Peripherals are modeled closely enough to run the serial slave unmodified:
+//    * IO ports A - L with the Mega 2560 digital pin map.  Pins can be changed either
+//      with digitalWrite() or by writing the PORTx registers directly.
+//    * The external interrupts on pins 2, 3 and 18 - 21, set up with attachInterrupt()
+//      and raised by the edges the harness makes with simSetPinInput().
+//    * Timer 1 in normal and CTC mode with the compare A interrupt, clocked from the
+//      prescaler.  The counter is computed from the virtual clock when it is read.
+//    * USART 2 with its 2 byte receive FIFO (bytes are lost with an overrun if the
+//      RX ISR does not keep up), the transmit data register and shift register, and
+//      a baud rate taken from UBRR2 and the U2X2 bit.
+//    * The global interrupt flag in SREG.  Interrupts are dispatched from the virtual
+//      clock when the flag is set, and it is cleared while an ISR runs, so an ISR that
+//      delays holds off all other interrupts just as it does on the AVR.  An ISR that
+//      sets the flag again can be interrupted, also as on the AVR.
+//
+// Usage in a harness:
+//        simReset();
+//        setup();
+//        simUsartReceive(packet, sizeof(packet));
+//        simAdvanceTimeInNS(2000000);
+//
+
+#include <time.h>
+#include <deque>
+#include "SimHardware.h"
+
+
+//
+// the Mega 2560 digital pin map, port index (0 = A ... 10 = L) and bit number for
+// every pin
+//
+static const uint8_t pinToPort[SIM_NUMBER_OF_PINS] = {
+  4, 4, 4, 4, 6, 4, 7, 7, 7, 7,           //  0 -  9
+  1, 1, 1, 1, 8, 8, 7, 7, 3, 3,           // 10 - 19
+  3, 3, 0, 0, 0, 0, 0, 0, 0, 0,           // 20 - 29
+  2, 2, 2, 2, 2, 2, 2, 2, 3, 6,           // 30 - 39
+  6, 6, 10, 10, 10, 10, 10, 10, 10, 10,   // 40 - 49
+  1, 1, 1, 1, 5, 5, 5, 5, 5, 5,           // 50 - 59
+  5, 5, 9, 9, 9, 9, 9, 9, 9, 9            // 60 - 69
+};
+
+static const uint8_t pinToBit[SIM_NUMBER_OF_PINS] = {
+  0, 1, 4, 5, 5, 3, 3, 4, 5, 6,           //  0 -  9
+  4, 5, 6, 7, 1, 0, 1, 0, 3, 2,           // 10 - 19
+  1, 0, 0, 1, 2, 3, 4, 5, 6, 7,           // 20 - 29
+  7, 6, 5, 4, 3, 2, 1, 0, 7, 2,           // 30 - 39
+  1, 0, 7, 6, 5, 4, 3, 2, 1, 0,           // 40 - 49
+  3, 2, 1, 0, 0, 1, 2, 3, 4, 5,           // 50 - 59
+  6, 7, 0, 1, 2, 3, 4, 5, 6, 7            // 60 - 69
+};
+
+const int NO_PIN = -1;
+
+const unsigned long long NEVER = ~0ULL;
+
+const unsigned long CPU_CLOCK_RATE = 16000000L;
+const unsigned long long CPU_CLOCK_PERIOD_InPS = 62500ULL;
+const unsigned long long INTERRUPT_RESPONSE_InNS = 8 * CPU_CLOCK_PERIOD_InPS / 1000;  // vectoring plus the jump
+
+
+//
+// the pin of each external interrupt, in the Arduino numbering
+//
+static const uint8_t externalInterruptPins[SIM_NUMBER_OF_EXTERNAL_INTERRUPTS] = {2, 3, 21, 20, 19, 18};
+
+
+//
+// Timer 1 registers that are objects
+//
+const int TIMER1_REGISTER_TCCR1A = 0;
+const int TIMER1_REGISTER_TCCR1B = 1;
+const int TIMER1_REGISTER_TCNT1 = 2;
+const int TIMER1_REGISTER_OCR1A = 3;
+const int TIMER1_REGISTER_TIMSK1 = 4;
+const int TIMER1_REGISTER_TIFR1 = 5;
+
+
+//
+// registers
+//
+volatile uint8_t SREG;
+volatile uint8_t simPortOutputRegisters[SIM_NUMBER_OF_PORTS];
+volatile uint8_t simPortDirectionRegisters[SIM_NUMBER_OF_PORTS];
+
+SimTimerRegister TCCR1A(TIMER1_REGISTER_TCCR1A);
+SimTimerRegister TCCR1B(TIMER1_REGISTER_TCCR1B);
+SimTimerRegister TCNT1(TIMER1_REGISTER_TCNT1);
+SimTimerRegister OCR1A(TIMER1_REGISTER_OCR1A);
+SimTimerRegister TIMSK1(TIMER1_REGISTER_TIMSK1);
+SimTimerRegister TIFR1(TIMER1_REGISTER_TIFR1);
+
+SimUsartDataRegister UDR2;
+volatile uint8_t UCSR2A;
+volatile uint8_t UCSR2B;
+volatile uint8_t UCSR2C;
+volatile uint8_t UBRR2H;
+volatile uint8_t UBRR2L;
+
+
+//
+// interrupt service routines, weak so that firmware without a given ISR still links
+//
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void USART2_RX_vect(void) __attribute__((weak));
+extern "C" void USART2_UDRE_vect(void) __attribute__((weak));
+
+
+//
+// variables global to this module
+//
+static unsigned long long currentTime_InNS;
+static unsigned long long callCost_InNS[SIM_NUMBER_OF_COSTS];
+
+static int portBitToPin[SIM_NUMBER_OF_PORTS][8];
+static uint8_t lastPortOutputs[SIM_NUMBER_OF_PORTS];
+static int8_t pinInputLevel[SIM_NUMBER_OF_PINS];
+static SimPinChangeHook *pinChangeHook;
+
+static void (*externalInterruptHandlers[SIM_NUMBER_OF_EXTERNAL_INTERRUPTS])(void);
+static uint8_t externalInterruptModes[SIM_NUMBER_OF_EXTERNAL_INTERRUPTS];
+static uint8_t externalInterruptFlags;
+
+static SimWaitHook *waitHook;
+
+static SimInterruptStatistics interruptStatistics[SIM_NUMBER_OF_VECTORS];
+
+static uint8_t timer1ControlA;
+static uint8_t timer1ControlB;
+static uint16_t timer1Compare;
+static uint8_t timer1InterruptMask;
+static uint8_t timer1Flags;
+static uint16_t timer1StoppedCount;
+static long long timer1ZeroTime_InNS;         // when the counter was last 0
+static uint16_t timer1LastTop;
+static unsigned long long timer1NextMatchTime_InNS;
+
+typedef struct scheduledByte {
+  unsigned long long arrivalTime_InNS;
+  uint8_t c;
+} ScheduledByte;
+
+static std::deque<ScheduledByte> usartReceiveSchedule;
+static uint8_t usartReceiveFIFO[2];
+static uint8_t usartReceiveFIFOCount;
+static unsigned long usartOverrunCount;
+static bool usartTransmitDataRegisterFull;
+static uint8_t usartTransmitDataRegister;
+static bool usartShiftRegisterBusy;
+static uint8_t usartShiftRegister;
+static bool usartShiftDriverEnabled;
+static unsigned long long usartShiftStartTime_InNS;
+static unsigned long long usartShiftEndTime_InNS;
+static int usartDriverEnablePin;
+static SimUsartTransmitHook *usartTransmitHook;
+
+
+//
+// forward function declarations
+//
+static void processEventsDueNow(void);
+static unsigned long long getNextEventTime(void);
+static void samplePorts(void);
+static void usartStartShifting(uint8_t c, unsigned long long startTime_InNS);
+static unsigned long long timer1GetTickPeriodInPS(void);
+static uint16_t timer1GetCount(void);
+static void timer1SetCount(uint16_t count);
+static void timer1ScheduleNextMatch(void);
+
+
+// ---------------------------------------------------------------------------------
+//                                Simulation control
+// ---------------------------------------------------------------------------------
+
+//
+// put the simulated board in its power up state with interrupts enabled, as they are
+// once the Arduino core has initialized
+//
+void simReset(void)
+{
+  currentTime_InNS = 0;
+  SREG = 1 << SREG_I;
+
+  for (int port = 0; port < SIM_NUMBER_OF_PORTS; port++)
+  {
+    simPortOutputRegisters[port] = 0;
+    simPortDirectionRegisters[port] = 0;
+    lastPortOutputs[port] = 0;
+    for (int bit = 0; bit < 8; bit++)
+      portBitToPin[port][bit] = NO_PIN;
+  }
+  for (int pin = 0; pin < SIM_NUMBER_OF_PINS; pin++)
+  {
+    portBitToPin[pinToPort[pin]][pinToBit[pin]] = pin;
+    pinInputLevel[pin] = -1;
+  }
+  pinChangeHook = NULL;
+
+  for (int interruptNumber = 0; interruptNumber < SIM_NUMBER_OF_EXTERNAL_INTERRUPTS; interruptNumber++)
+    externalInterruptHandlers[interruptNumber] = NULL;
+  externalInterruptFlags = 0;
+
+  callCost_InNS[SIM_COST_MICROS] = 3500;
+  callCost_InNS[SIM_COST_DIGITAL_WRITE] = 3400;
+  callCost_InNS[SIM_COST_DIGITAL_READ] = 3000;
+  callCost_InNS[SIM_COST_THOUSAND_AVR_CYCLES] = 1000 * CPU_CLOCK_PERIOD_InPS / 1000;
+
+  timer1ControlA = 0;
+  timer1ControlB = 0;
+  timer1Compare = 0;
+  timer1InterruptMask = 0;
+  timer1Flags = 0;
+  timer1StoppedCount = 0;
+  timer1ZeroTime_InNS = 0;
+  timer1LastTop = 0xFFFF;
+  timer1NextMatchTime_InNS = NEVER;
+
+  UCSR2A = 1 << UDRE2;
+  UCSR2B = 0;
+  UCSR2C = 0x06;
+  UBRR2H = 0;
+  UBRR2L = 0;
+  usartReceiveSchedule.clear();
+  usartReceiveFIFOCount = 0;
+  usartOverrunCount = 0;
+  usartTransmitDataRegisterFull = false;
+  usartShiftRegisterBusy = false;
+  usartDriverEnablePin = NO_PIN;
+  usartTransmitHook = NULL;
+
+  waitHook = NULL;
+  simClearInterruptStatistics();
+}
+
+
+
+//
+// get the virtual time since reset
+//
+unsigned long long simGetTimeInNS(void)
+{
+  return(currentTime_InNS);
+}
+
+
+
+//
+// move the virtual clock forward, processing hardware events and interrupts as it goes
+//
+void simAdvanceTimeInNS(unsigned long long period_InNS)
+{
+  simAdvanceTimeToNS(currentTime_InNS + period_InNS);
+}
+
+
+
+//
+// move the virtual clock forward to the given time
+//
+void simAdvanceTimeToNS(unsigned long long time_InNS)
+{
+  unsigned long long nextEventTime_InNS;
+  unsigned long long waitUntil_InNS;
+
+  while(true)
+  {
+    samplePorts();
+    simServiceInterrupts();
+
+    //
+    // give a harness running in real time the chance to wait for the wall clock and to
+    // schedule bytes that arrive in the meantime
+    //
+    nextEventTime_InNS = getNextEventTime();
+    if (waitHook != NULL)
+    {
+      waitUntil_InNS = (nextEventTime_InNS < time_InNS) ? nextEventTime_InNS : time_InNS;
+      if (waitUntil_InNS > currentTime_InNS)
+      {
+        waitHook(waitUntil_InNS);
+        nextEventTime_InNS = getNextEventTime();
+      }
+    }
+
+    if ((nextEventTime_InNS == NEVER) || (nextEventTime_InNS > time_InNS))
+      break;
+
+    if (nextEventTime_InNS > currentTime_InNS)
+      currentTime_InNS = nextEventTime_InNS;
+    processEventsDueNow();
+  }
+
+  if (currentTime_InNS < time_InNS)
+    currentTime_InNS = time_InNS;
+  simServiceInterrupts();
+}
+
+
+
+//
+// run every interrupt that is pending, highest priority first, as long as the
+// global interrupt flag is set.  This is called again from inside an ISR that sets
+// the flag, letting the other interrupts nest.
+//
+void simServiceInterrupts(void)
+{
+  int vector;
+  int interruptNumber;
+  void (*isr)(void);
+  struct timespec hostStart, hostEnd;
+  unsigned long long virtualStart_InNS;
+  unsigned long long hostPeriod_InNS;
+  SimInterruptStatistics *statistics;
+
+  while(SREG & (1 << SREG_I))
+  {
+    //
+    // find the highest priority interrupt that is pending
+    //
+    if (externalInterruptFlags != 0)
+    {
+      vector = SIM_VECTOR_EXTERNAL_INTERRUPT;
+      for (interruptNumber = 0; !(externalInterruptFlags & (1 << interruptNumber)); interruptNumber++)
+        ;
+      isr = externalInterruptHandlers[interruptNumber];
+      externalInterruptFlags &= ~(1 << interruptNumber);
+    }
+    else if ((timer1InterruptMask & (1 << OCIE1A)) && (timer1Flags & (1 << OCF1A)))
+    {
+      vector = SIM_VECTOR_TIMER1_COMPA;
+      isr = TIMER1_COMPA_vect;
+      timer1Flags &= ~(1 << OCF1A);
+    }
+    else if ((UCSR2B & (1 << RXCIE2)) && (usartReceiveFIFOCount > 0))
+    {
+      vector = SIM_VECTOR_USART2_RX;
+      isr = USART2_RX_vect;
+    }
+    else if ((UCSR2B & (1 << UDRIE2)) && !usartTransmitDataRegisterFull)
+    {
+      vector = SIM_VECTOR_USART2_UDRE;
+      isr = USART2_UDRE_vect;
+    }
+    else
+      return;
+
+    //
+    // an enabled interrupt without an ISR resets the AVR, treat it as a harness bug
+    //
+    if (isr == NULL)
+      abort();
+
+    //
+    // run the ISR with interrupts disabled, the same as the AVR does, after the clocks
+    // it takes to get to it
+    //
+    statistics = &interruptStatistics[vector];
+    SREG &= ~(1 << SREG_I);
+    simAdvanceTimeInNS(INTERRUPT_RESPONSE_InNS);
+    virtualStart_InNS = currentTime_InNS;
+    clock_gettime(CLOCK_MONOTONIC, &hostStart);
+
+    isr();
+
+    clock_gettime(CLOCK_MONOTONIC, &hostEnd);
+    SREG |= (1 << SREG_I);
+
+    hostPeriod_InNS = (unsigned long long) (hostEnd.tv_sec - hostStart.tv_sec) * 1000000000ULL +
+                      hostEnd.tv_nsec - hostStart.tv_nsec;
+    statistics->count++;
+    statistics->totalHostTime_InNS += hostPeriod_InNS;
+    statistics->totalVirtualTime_InNS += currentTime_InNS - virtualStart_InNS;
+    if (hostPeriod_InNS > statistics->maxHostTime_InNS)
+      statistics->maxHostTime_InNS = hostPeriod_InNS;
+    if (currentTime_InNS - virtualStart_InNS > statistics->maxVirtualTime_InNS)
+      statistics->maxVirtualTime_InNS = currentTime_InNS - virtualStart_InNS;
+  }
+}
+
+
+
+//
+// set how much virtual time one of the Arduino core functions takes
+//
+void simSetCallCostInNS(int cost, unsigned long long cost_InNS)
+{
+  if ((cost >= 0) && (cost < SIM_NUMBER_OF_COSTS))
+    callCost_InNS[cost] = cost_InNS;
+}
+
+
+
+//
+// install a function that is called each time the virtual clock is about to move
+// forward, a harness that runs in real time blocks in it until the wall clock reaches
+// the given time, receiving bytes with simUsartReceiveAt() as they come in
+//
+void simSetWaitHook(SimWaitHook *hook)
+{
+  waitHook = hook;
+}
+
+
+
+//
+// get the statistics for one interrupt vector
+//
+const SimInterruptStatistics *simGetInterruptStatistics(int vector)
+{
+  return(&interruptStatistics[vector]);
+}
+
+
+
+//
+// zero the interrupt statistics
+//
+void simClearInterruptStatistics(void)
+{
+  static const char *names[SIM_NUMBER_OF_VECTORS] = {"INTn_vect", "TIMER1_COMPA_vect",
+                                                        "USART2_RX_vect", "USART2_UDRE_vect"};
+
+  for (int vector = 0; vector < SIM_NUMBER_OF_VECTORS; vector++)
+  {
+    memset(&interruptStatistics[vector], 0, sizeof(SimInterruptStatistics));
+    interruptStatistics[vector].name = names[vector];
+  }
+}
+
+
+
+//
+// find the time of the next scheduled hardware event
+//
+static unsigned long long getNextEventTime(void)
+{
+  unsigned long long nextEventTime_InNS = NEVER;
+
+  if (!usartReceiveSchedule.empty())
+    nextEventTime_InNS = usartReceiveSchedule.front().arrivalTime_InNS;
+
+  if (usartShiftRegisterBusy && (usartShiftEndTime_InNS < nextEventTime_InNS))
+    nextEventTime_InNS = usartShiftEndTime_InNS;
+
+  if (timer1NextMatchTime_InNS < nextEventTime_InNS)
+    nextEventTime_InNS = timer1NextMatchTime_InNS;
+
+  return(nextEventTime_InNS);
+}
+
+
+
+//
+// update the peripherals for every event that is due at the current time
+//
+static void processEventsDueNow(void)
+{
+  ScheduledByte scheduledByte;
+  bool driverEnabled;
+
+  //
+  // raise the Timer 1 compare flag, in CTC mode the counter goes back to 0 on the next
+  // timer clock
+  //
+  if (timer1NextMatchTime_InNS <= currentTime_InNS)
+  {
+    timer1Flags |= (1 << OCF1A);
+    if (timer1ControlB & (1 << WGM12))
+    {
+      timer1LastTop = timer1Compare;
+      timer1ZeroTime_InNS = (long long) timer1NextMatchTime_InNS +
+                            (long long) (timer1GetTickPeriodInPS() / 1000ULL);
+    }
+    timer1ScheduleNextMatch();
+  }
+
+  //
+  // move received bytes into the receive FIFO, overrunning if the FIFO is full
+  //
+  while(!usartReceiveSchedule.empty() &&
+        (usartReceiveSchedule.front().arrivalTime_InNS <= currentTime_InNS))
+  {
+    scheduledByte = usartReceiveSchedule.front();
+    usartReceiveSchedule.pop_front();
+
+    if (!(UCSR2B & (1 << RXEN2)))
+      continue;
+
+    if (usartReceiveFIFOCount < sizeof(usartReceiveFIFO))
+    {
+      usartReceiveFIFO[usartReceiveFIFOCount] = scheduledByte.c;
+      usartReceiveFIFOCount++;
+      UCSR2A |= (1 << RXC2);
+    }
+    else
+    {
+      usartOverrunCount++;
+      UCSR2A |= (1 << DOR2);
+    }
+  }
+
+  //
+  // finish shifting out the transmitted byte, then start the next one if there is one
+  //
+  if (usartShiftRegisterBusy && (usartShiftEndTime_InNS <= currentTime_InNS))
+  {
+    usartShiftRegisterBusy = false;
+    UCSR2A |= (1 << TXC2);
+
+    driverEnabled = usartShiftDriverEnabled;
+    if ((usartDriverEnablePin != NO_PIN) && (simGetPinLevel(usartDriverEnablePin) != HIGH))
+      driverEnabled = false;
+    if (usartTransmitHook != NULL)
+      usartTransmitHook(usartShiftRegister, driverEnabled, usartShiftStartTime_InNS, usartShiftEndTime_InNS);
+
+    if (usartTransmitDataRegisterFull)
+    {
+      usartTransmitDataRegisterFull = false;
+      UCSR2A |= (1 << UDRE2);
+      usartStartShifting(usartTransmitDataRegister, usartShiftEndTime_InNS);
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                     IO pins
+// ---------------------------------------------------------------------------------
+
+//
+// get the level of a pin, either as driven by the firmware or from the outside
+//
+int simGetPinLevel(uint8_t pin)
+{
+  uint8_t port;
+  uint8_t bitMask;
+
+  if (pin >= SIM_NUMBER_OF_PINS)
+    return(LOW);
+
+  port = pinToPort[pin];
+  bitMask = 1 << pinToBit[pin];
+
+  //
+  // an output pin reads back what the port register drives
+  //
+  if (simPortDirectionRegisters[port] & bitMask)
+    return((simPortOutputRegisters[port] & bitMask) ? HIGH : LOW);
+
+  //
+  // an input pin reads the external level if there is one, else the pull-up if it is
+  // enabled
+  //
+  if (pinInputLevel[pin] >= 0)
+    return(pinInputLevel[pin]);
+  return((simPortOutputRegisters[port] & bitMask) ? HIGH : LOW);
+}
+
+
+
+//
+// check if the firmware has configured a pin as an output
+//
+bool simIsPinOutput(uint8_t pin)
+{
+  if (pin >= SIM_NUMBER_OF_PINS)
+    return(false);
+  return((simPortDirectionRegisters[pinToPort[pin]] & (1 << pinToBit[pin])) != 0);
+}
+
+
+
+//
+// drive an input pin from outside of the board (a switch or sensor), an edge on a pin
+// with an external interrupt attached raises the interrupt
+//
+void simSetPinInput(uint8_t pin, int level)
+{
+  int oldLevel;
+  int newLevel;
+  uint8_t mode;
+
+  if (pin >= SIM_NUMBER_OF_PINS)
+    return;
+
+  oldLevel = simGetPinLevel(pin);
+  pinInputLevel[pin] = (level == LOW) ? LOW : HIGH;
+  newLevel = simGetPinLevel(pin);
+  if (newLevel == oldLevel)
+    return;
+
+  for (int interruptNumber = 0; interruptNumber < SIM_NUMBER_OF_EXTERNAL_INTERRUPTS; interruptNumber++)
+  {
+    if ((externalInterruptPins[interruptNumber] != pin) || (externalInterruptHandlers[interruptNumber] == NULL))
+      continue;
+
+    mode = externalInterruptModes[interruptNumber];
+    if ((mode == CHANGE) || ((mode == RISING) && (newLevel == HIGH)) || ((mode == FALLING) && (newLevel == LOW)))
+      externalInterruptFlags |= (1 << interruptNumber);
+  }
+}
+
+
+
+//
+// stop driving an input pin, leaving it floating or pulled up
+//
+void simReleasePinInput(uint8_t pin)
+{
+  if (pin < SIM_NUMBER_OF_PINS)
+    pinInputLevel[pin] = -1;
+}
+
+
+
+//
+// install a function that is called each time an output pin changes level
+//
+void simSetPinChangeHook(SimPinChangeHook *hook)
+{
+  pinChangeHook = hook;
+}
+
+
+
+//
+// look for port bits that have changed since the last time, reporting each one as a pin
+// change, this catches writes made directly to the PORTx registers
+//
+static void samplePorts(void)
+{
+  uint8_t changedBits;
+  int pin;
+
+  for (int port = 0; port < SIM_NUMBER_OF_PORTS; port++)
+  {
+    changedBits = simPortOutputRegisters[port] ^ lastPortOutputs[port];
+    if (changedBits == 0)
+      continue;
+
+    lastPortOutputs[port] = simPortOutputRegisters[port];
+    for (int bit = 0; bit < 8; bit++)
+    {
+      if (!(changedBits & (1 << bit)))
+        continue;
+
+      pin = portBitToPin[port][bit];
+      if ((pin != NO_PIN) && (pinChangeHook != NULL) && simIsPinOutput(pin))
+        pinChangeHook(pin, (lastPortOutputs[port] >> bit) & 1, currentTime_InNS);
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                     Timer 1
+// ---------------------------------------------------------------------------------
+
+//
+// get the period of one timer clock from the prescaler, 0 if the timer is stopped
+//
+static unsigned long long timer1GetTickPeriodInPS(void)
+{
+  static const unsigned long long prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+  return(prescalers[timer1ControlB & 0x07] * CPU_CLOCK_PERIOD_InPS);
+}
+
+
+
+//
+// get the timer count at the current time
+//
+static uint16_t timer1GetCount(void)
+{
+  unsigned long long tickPeriod_InPS;
+  long long ticks;
+
+  tickPeriod_InPS = timer1GetTickPeriodInPS();
+  if (tickPeriod_InPS == 0)
+    return(timer1StoppedCount);
+
+  //
+  // between a compare match and the next timer clock the count is still at the top
+  //
+  ticks = ((long long) currentTime_InNS - timer1ZeroTime_InNS) * 1000LL / (long long) tickPeriod_InPS;
+  if (ticks < 0)
+    return(timer1LastTop);
+  return((uint16_t) ticks);
+}
+
+
+
+//
+// set the timer count as of the current time
+//
+static void timer1SetCount(uint16_t count)
+{
+  unsigned long long tickPeriod_InPS;
+
+  timer1StoppedCount = count;
+  tickPeriod_InPS = timer1GetTickPeriodInPS();
+  timer1ZeroTime_InNS = (long long) currentTime_InNS - (long long) (count * tickPeriod_InPS / 1000ULL);
+  timer1ScheduleNextMatch();
+}
+
+
+
+//
+// find when the count will next equal the compare register.  If the count is already
+// past it, the counter has to run up to 0xFFFF and wrap around first.
+//
+static void timer1ScheduleNextMatch(void)
+{
+  unsigned long long tickPeriod_InPS;
+  long long ticks;
+  long long matchTicks;
+
+  tickPeriod_InPS = timer1GetTickPeriodInPS();
+  if (tickPeriod_InPS == 0)
+  {
+    timer1NextMatchTime_InNS = NEVER;
+    return;
+  }
+
+  ticks = ((long long) currentTime_InNS - timer1ZeroTime_InNS) * 1000LL / (long long) tickPeriod_InPS;
+  while (ticks >= 0x10000)
+  {
+    timer1ZeroTime_InNS += (long long) (0x10000ULL * tickPeriod_InPS / 1000ULL);
+    ticks -= 0x10000;
+  }
+
+  if (ticks < timer1Compare)
+    matchTicks = timer1Compare;
+  else
+    matchTicks = 0x10000LL + timer1Compare;
+  timer1NextMatchTime_InNS = (unsigned long long) (timer1ZeroTime_InNS +
+                             (long long) (matchTicks * tickPeriod_InPS / 1000ULL));
+  if (timer1NextMatchTime_InNS < currentTime_InNS)
+    timer1NextMatchTime_InNS = currentTime_InNS;
+}
+
+
+
+SimTimerRegister::SimTimerRegister(int registerNumber)
+{
+  this->registerNumber = registerNumber;
+}
+
+
+
+//
+// read a Timer 1 register
+//
+SimTimerRegister::operator uint16_t() const
+{
+  switch(registerNumber)
+  {
+    case TIMER1_REGISTER_TCCR1A:
+      return(timer1ControlA);
+    case TIMER1_REGISTER_TCCR1B:
+      return(timer1ControlB);
+    case TIMER1_REGISTER_TCNT1:
+      return(timer1GetCount());
+    case TIMER1_REGISTER_OCR1A:
+      return(timer1Compare);
+    case TIMER1_REGISTER_TIMSK1:
+      return(timer1InterruptMask);
+    case TIMER1_REGISTER_TIFR1:
+      return(timer1Flags);
+  }
+  return(0);
+}
+
+
+
+//
+// write a Timer 1 register, changing the clock or the mode keeps the current count
+//
+SimTimerRegister &SimTimerRegister::operator=(uint16_t value)
+{
+  uint16_t count;
+
+  switch(registerNumber)
+  {
+    case TIMER1_REGISTER_TCCR1A:
+    case TIMER1_REGISTER_TCCR1B:
+      count = timer1GetCount();
+      if (registerNumber == TIMER1_REGISTER_TCCR1A)
+        timer1ControlA = (uint8_t) value;
+      else
+        timer1ControlB = (uint8_t) value;
+      timer1SetCount(count);
+      break;
+
+    case TIMER1_REGISTER_TCNT1:
+      timer1SetCount(value);
+      break;
+
+    case TIMER1_REGISTER_OCR1A:
+      timer1Compare = value;
+      timer1ScheduleNextMatch();
+      break;
+
+    case TIMER1_REGISTER_TIMSK1:
+      timer1InterruptMask = (uint8_t) value;
+      break;
+
+    case TIMER1_REGISTER_TIFR1:
+      timer1Flags &= ~value;          // flags are cleared by writing a 1 to them
+      break;
+  }
+  return(*this);
+}
+
+
+
+SimTimerRegister &SimTimerRegister::operator|=(uint16_t value)
+{
+  return(*this = (uint16_t) (*this | value));
+}
+
+
+
+SimTimerRegister &SimTimerRegister::operator&=(uint16_t value)
+{
+  return(*this = (uint16_t) (*this & value));
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                     USART 2
+// ---------------------------------------------------------------------------------
+
+//
+// get the baud rate the USART is actually running at, which differs from the one
+// requested by the rounding of UBRR2
+//
+unsigned long simUsartGetBaudRate(void)
+{
+  unsigned long divisor;
+
+  divisor = ((unsigned long) UBRR2H << 8 | UBRR2L) + 1;
+  if (UCSR2A & (1 << U2X2))
+    return(CPU_CLOCK_RATE / 8 / divisor);
+  else
+    return(CPU_CLOCK_RATE / 16 / divisor);
+}
+
+
+
+//
+// get the time to send or receive one byte: start bit, 8 data bits and 1 stop bit
+//
+unsigned long long simUsartGetByteTimeInNS(void)
+{
+  unsigned long divisor;
+  unsigned long long clocksPerBit;
+
+  divisor = ((unsigned long) UBRR2H << 8 | UBRR2L) + 1;
+  clocksPerBit = (UCSR2A & (1 << U2X2)) ? 8ULL * divisor : 16ULL * divisor;
+  return(10ULL * clocksPerBit * 1000000000ULL / CPU_CLOCK_RATE);
+}
+
+
+
+//
+// send bytes to the board as the master would, back to back at the USART's baud rate
+// following anything already on its way
+//
+void simUsartReceive(const uint8_t *data, int dataLength)
+{
+  unsigned long long startTime_InNS;
+  unsigned long long byteTime_InNS;
+
+  startTime_InNS = currentTime_InNS;
+  if (!usartReceiveSchedule.empty() && (usartReceiveSchedule.back().arrivalTime_InNS > startTime_InNS))
+    startTime_InNS = usartReceiveSchedule.back().arrivalTime_InNS;
+
+  byteTime_InNS = simUsartGetByteTimeInNS();
+  for (int i = 0; i < dataLength; i++)
+  {
+    startTime_InNS += byteTime_InNS;
+    simUsartReceiveAt(data[i], startTime_InNS);
+  }
+}
+
+
+
+//
+// schedule one byte to finish arriving at the given time
+//
+void simUsartReceiveAt(uint8_t c, unsigned long long arrivalTime_InNS)
+{
+  ScheduledByte scheduledByte;
+
+  scheduledByte.arrivalTime_InNS = arrivalTime_InNS;
+  scheduledByte.c = c;
+  usartReceiveSchedule.push_back(scheduledByte);
+}
+
+
+
+//
+// check if any bytes sent to the board have not been read by the firmware yet
+//
+bool simUsartReceivePending(void)
+{
+  return(!usartReceiveSchedule.empty() || (usartReceiveFIFOCount > 0));
+}
+
+
+
+//
+// check if the USART is still transmitting
+//
+bool simUsartTransmitBusy(void)
+{
+  return(usartShiftRegisterBusy || usartTransmitDataRegisterFull);
+}
+
+
+
+//
+// set the pin that enables the RS-485 line driver, bytes shifted out while it is not
+// enabled never make it onto the line
+//
+void simUsartSetDriverEnablePin(uint8_t pin)
+{
+  usartDriverEnablePin = pin;
+}
+
+
+
+//
+// install a function that is called each time a byte has been shifted out
+//
+void simUsartSetTransmitHook(SimUsartTransmitHook *hook)
+{
+  usartTransmitHook = hook;
+}
+
+
+
+//
+// get the number of received bytes that were lost because the FIFO was full
+//
+unsigned long simUsartGetOverrunCount(void)
+{
+  return(usartOverrunCount);
+}
+
+
+
+//
+// move a byte into the transmit shift register
+//
+static void usartStartShifting(uint8_t c, unsigned long long startTime_InNS)
+{
+  usartShiftRegister = c;
+  usartShiftRegisterBusy = true;
+  usartShiftStartTime_InNS = startTime_InNS;
+  usartShiftEndTime_InNS = startTime_InNS + simUsartGetByteTimeInNS();
+  usartShiftDriverEnabled = (usartDriverEnablePin == NO_PIN) || (simGetPinLevel(usartDriverEnablePin) == HIGH);
+  UCSR2A &= ~(1 << TXC2);
+}
+
+
+
+//
+// read the USART data register, taking the oldest byte from the receive FIFO
+//
+SimUsartDataRegister::operator uint8_t() const
+{
+  uint8_t c;
+
+  if (usartReceiveFIFOCount == 0)
+    return(usartReceiveFIFO[0]);
+
+  c = usartReceiveFIFO[0];
+  usartReceiveFIFO[0] = usartReceiveFIFO[1];
+  usartReceiveFIFOCount--;
+  if (usartReceiveFIFOCount == 0)
+    UCSR2A &= ~(1 << RXC2);
+  return(c);
+}
+
+
+
+//
+// write the USART data register, the byte goes straight to the shift register when the
+// transmitter is idle
+//
+SimUsartDataRegister &SimUsartDataRegister::operator=(uint8_t c)
+{
+  if (!(UCSR2B & (1 << TXEN2)))
+    return(*this);
+
+  if (!usartShiftRegisterBusy)
+    usartStartShifting(c, currentTime_InNS);
+  else if (!usartTransmitDataRegisterFull)
+  {
+    usartTransmitDataRegister = c;
+    usartTransmitDataRegisterFull = true;
+    UCSR2A &= ~(1 << UDRE2);
+  }
+  return(*this);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                               Arduino core functions
+// ---------------------------------------------------------------------------------
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  uint8_t port;
+  uint8_t bitMask;
+
+  if (pin >= SIM_NUMBER_OF_PINS)
+    return;
+
+  port = pinToPort[pin];
+  bitMask = 1 << pinToBit[pin];
+  if (mode == OUTPUT)
+    simPortDirectionRegisters[port] |= bitMask;
+  else
+  {
+    simPortDirectionRegisters[port] &= ~bitMask;
+    if (mode == INPUT_PULLUP)
+      simPortOutputRegisters[port] |= bitMask;
+    else
+      simPortOutputRegisters[port] &= ~bitMask;
+  }
+  samplePorts();
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  uint8_t port;
+  uint8_t bitMask;
+
+  if (pin < SIM_NUMBER_OF_PINS)
+  {
+    port = pinToPort[pin];
+    bitMask = 1 << pinToBit[pin];
+    if (val == LOW)
+      simPortOutputRegisters[port] &= ~bitMask;
+    else
+      simPortOutputRegisters[port] |= bitMask;
+    samplePorts();
+  }
+
+  simAdvanceTimeInNS(callCost_InNS[SIM_COST_DIGITAL_WRITE]);
+}
+
+
+uint8_t digitalPinToPort(uint8_t pin)
+{
+  if (pin >= SIM_NUMBER_OF_PINS)
+    return(NOT_A_PIN);
+  return(pinToPort[pin] + 1);
+}
+
+
+uint8_t digitalPinToBitMask(uint8_t pin)
+{
+  if (pin >= SIM_NUMBER_OF_PINS)
+    return(0);
+  return(1 << pinToBit[pin]);
+}
+
+
+volatile uint8_t *portOutputRegister(uint8_t port)
+{
+  if ((port == NOT_A_PORT) || (port > SIM_NUMBER_OF_PORTS))
+    return(NULL);
+  return(&simPortOutputRegisters[port - 1]);
+}
+
+
+int digitalRead(uint8_t pin)
+{
+  int level;
+
+  level = simGetPinLevel(pin);
+  simAdvanceTimeInNS(callCost_InNS[SIM_COST_DIGITAL_READ]);
+  return(level);
+}
+
+
+int analogRead(uint8_t pin)
+{
+  return(0);
+}
+
+
+void analogWrite(uint8_t pin, int val)
+{
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, val >= 128 ? HIGH : LOW);
+}
+
+
+unsigned long millis(void)
+{
+  samplePorts();
+  return((unsigned long) (currentTime_InNS / 1000000ULL));
+}
+
+
+unsigned long micros(void)
+{
+  simAdvanceTimeInNS(callCost_InNS[SIM_COST_MICROS]);
+  return((unsigned long) (currentTime_InNS / 1000ULL));
+}
+
+
+void simChargeCycles(unsigned long cycles)
+{
+  simAdvanceTimeInNS((unsigned long long) cycles * callCost_InNS[SIM_COST_THOUSAND_AVR_CYCLES] / 1000ULL);
+}
+
+
+void delay(unsigned long ms)
+{
+  simAdvanceTimeInNS((unsigned long long) ms * 1000000ULL);
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+  simAdvanceTimeInNS((unsigned long long) us * 1000ULL);
+}
+
+
+void attachInterrupt(uint8_t interruptNumber, void (*handler)(void), int mode)
+{
+  if (interruptNumber >= SIM_NUMBER_OF_EXTERNAL_INTERRUPTS)
+    return;
+
+  externalInterruptHandlers[interruptNumber] = handler;
+  externalInterruptModes[interruptNumber] = mode;
+  externalInterruptFlags &= ~(1 << interruptNumber);
+}
+
+
+void detachInterrupt(uint8_t interruptNumber)
+{
+  if (interruptNumber >= SIM_NUMBER_OF_EXTERNAL_INTERRUPTS)
+    return;
+
+  externalInterruptHandlers[interruptNumber] = NULL;
+  externalInterruptFlags &= ~(1 << interruptNumber);
+}
+
+
+void cli(void)
+{
+  SREG &= ~(1 << SREG_I);
+}
+
+
+void sei(void)
+{
+  SREG |= (1 << SREG_I);
+  simServiceInterrupts();
+}
+
+// -------------------------------------- End --------------------------------------
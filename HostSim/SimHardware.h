@@ -0,0 +1,110 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                 Header file for SimHardware.cpp                *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+
+#ifndef SimHardware_h
+#define SimHardware_h
+
+#include "Arduino.h"
+
+
+//
+// number of digital pins on the Mega 2560
+//
+const uint8_t SIM_NUMBER_OF_PINS = 70;
+
+
+//
+// number of external interrupts that have a pin, INT0 - INT5
+//
+const uint8_t SIM_NUMBER_OF_EXTERNAL_INTERRUPTS = 6;
+
+
+//
+// interrupt vectors that the simulation can raise, in priority order (highest first)
+//
+const int SIM_VECTOR_EXTERNAL_INTERRUPT = 0;   // INT0 - INT5, from attachInterrupt()
+const int SIM_VECTOR_TIMER1_COMPA = 1;
+const int SIM_VECTOR_USART2_RX = 2;
+const int SIM_VECTOR_USART2_UDRE = 3;
+const int SIM_NUMBER_OF_VECTORS = 4;
+
+
+//
+// costs charged to the virtual clock by the Arduino core functions, roughly what they
+// take on a 16Mhz ATMega 2560
+//
+const int SIM_COST_MICROS = 0;
+const int SIM_COST_DIGITAL_WRITE = 1;
+const int SIM_COST_DIGITAL_READ = 2;
+const int SIM_COST_THOUSAND_AVR_CYCLES = 3;    // arithmetic marked with AVR_CYCLES()
+const int SIM_NUMBER_OF_COSTS = 4;
+
+
+//
+// statistics kept for each interrupt vector
+//
+typedef struct simInterruptStatistics {
+  const char * name;
+  unsigned long count;
+  unsigned long long totalHostTime_InNS;    // CPU time on this machine
+  unsigned long long maxHostTime_InNS;
+  unsigned long long totalVirtualTime_InNS; // virtual time that passed inside the ISR
+  unsigned long long maxVirtualTime_InNS;
+} SimInterruptStatistics;
+
+
+//
+// hooks the harness can install to watch the hardware
+//
+typedef void SimPinChangeHook(uint8_t pin, uint8_t level, unsigned long long time_InNS);
+typedef void SimUsartTransmitHook(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                                  unsigned long long endTime_InNS);
+typedef void SimWaitHook(unsigned long long time_InNS);
+
+
+//
+// simulation control
+//
+void simReset(void);
+unsigned long long simGetTimeInNS(void);
+void simAdvanceTimeInNS(unsigned long long period_InNS);
+void simAdvanceTimeToNS(unsigned long long time_InNS);
+void simServiceInterrupts(void);
+void simSetCallCostInNS(int cost, unsigned long long cost_InNS);
+void simSetWaitHook(SimWaitHook *hook);
+const SimInterruptStatistics *simGetInterruptStatistics(int vector);
+void simClearInterruptStatistics(void);
+
+
+//
+// IO pins
+//
+int simGetPinLevel(uint8_t pin);
+bool simIsPinOutput(uint8_t pin);
+void simSetPinInput(uint8_t pin, int level);
+void simReleasePinInput(uint8_t pin);
+void simSetPinChangeHook(SimPinChangeHook *hook);
+
+
+//
+// USART 2
+//
+unsigned long simUsartGetBaudRate(void);
+unsigned long long simUsartGetByteTimeInNS(void);
+void simUsartReceive(const uint8_t *data, int dataLength);
+void simUsartReceiveAt(uint8_t c, unsigned long long arrivalTime_InNS);
+bool simUsartReceivePending(void);
+bool simUsartTransmitBusy(void);
+void simUsartSetDriverEnablePin(uint8_t pin);
+void simUsartSetTransmitHook(SimUsartTransmitHook *hook);
+unsigned long simUsartGetOverrunCount(void);
+
+
+// ------------------------------------ End ---------------------------------
+#endif
@@ -0,0 +1,900 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                           StepTiming                           *
+//      *                                                                *
+//      *        Step timing and jitter of SpeedyStepper on the host     *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Drives SpeedyStepper::processMovement() on the simulated board the way a sketch
+// does, polling every axis in a loop until all of the moves are complete, and records
+// the time of every rising edge on each step pin.  The virtual clock only advances by
+// what the Arduino core calls cost (see SimHardware.cpp), so the more axes that are
+// polled the later each one gets to step, the same contention seen on the board.
+// With -t the axes are instead attached to StepperTimer and stepped from the simulated
+// Timer 1 interrupt, while the main loop only waits.  The ISR time per step then gives
+// the highest step rate the board can reach, which -f shows for the fixed point ramp.
+// -g pulses the step lines of the axes that are due together, one write per port.
+// -l moves the axes as one StepperGroup, one ramp steps all of them along a line.
+// -j gives the axes a jerk, so they follow an S-curve rather than a trapezoid.
+// -q splits each move into several queued moves, which should run through as the one.
+// -h homes the axes from the timer instead, against switches on external interrupt
+// pins, with the main loop held up for a while as a slow callable would.  Each axis
+// must still stop within its stopping distance of its switch, and homing an axis on
+// the timer against a switch with no interrupt must fail at once.  The exit status is
+// 1 if not.
+// -e stops the moves with setupStop() once each axis has taken that many steps, while
+// it is still speeding up, and checks that it stops within the distance and time an
+// S-curve (or trapezoid) takes from the speed it had, exiting with 1 if not.
+//
+// Each recorded step is compared two ways:
+//    * With the ideal trapezoid for the move: constant acceleration up to the desired
+//      speed, cruise, then constant deceleration, with the same deceleration distance
+//      that setupMoveInSteps() computes.  This shows the error of the ramp itself.
+//      With -j the ideal is the S-curve with that jerk instead.
+//    * With the schedule the ramp asked for, taken from a reference run of a single
+//      axis with a zero cost model.  The difference in each step period is the jitter
+//      caused by polling and is what the histogram shows.
+//
+// Usage:
+//    stepTiming [-x axes] [-s speed] [-a acceleration] [-d distance] [-w bucketWidth]
+//               [-o trace.csv] [-z] [-t] [-r maxStepRate] [-f] [-g] [-l] [-j jerk]
+//               [-q moves] [-h stallMS] [-e stopStep]
+//
+//    -x  number of axes moving at the same time, on ports 1 - 6 (default 1)
+//    -s  speed in steps/second (default 500)
+//    -a  acceleration in steps/second/second (default 500)
+//    -d  distance of the move in steps (default 2000)
+//    -w  width of the histogram buckets in us (default 10)
+//    -o  write every step to a CSV file: axis, step, time, ideal time, period, ideal period
+//        and the period the ramp scheduled
+//    -z  zero cost model, the Arduino core functions take no virtual time
+//    -t  step from the timer interrupt rather than by polling
+//    -r  maximum aggregate step rate of the timer in steps/second, 0 for no limit
+//        (default 10000)
+//    -f  compute the ramp with fixed point rather than floats
+//    -g  with -t, gang the step pulses of the axes that are due at the same time
+//    -l  move the axes together as a StepperGroup line rather than on their own ramps
+//    -j  jerk in steps/second/second/second for an S-curve, 0 for the trapezoid
+//        (default 0)
+//    -q  number of queued moves the distance is split into (default 1)
+//    -h  home up to 4 axes, holding up the main loop for this many ms once homing
+//        has started, -d, -j and -q don't apply
+//    -e  stop the moves once each axis has taken this many steps
+//
+
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+#include <vector>
+#include "SimHardware.h"
+#include "SpeedyStepper.h"
+#include "StepperTimer.h"
+#include "StepperGroup.h"
+
+
+//
+// step pins of the DPEA board, index 0 is port 1
+//
+const int NUMBER_OF_PORTS = 6;
+const uint8_t STEP_PINS[NUMBER_OF_PORTS] = {34, 31, 5, 44, 7, 12};
+
+const int HISTOGRAM_BUCKETS = 21;
+
+const unsigned long long TIMER_WAIT_PERIOD_InNS = 100000;
+
+const double IDEAL_SCURVE_TIME_STEP_InS = 0.5e-6;
+
+
+//
+// with -h the axes home in the positive direction against switches on these external
+// interrupt pins, the ones the DPEA board leaves free.  A switch closes once its axis
+// has taken HOME_SWITCH_STEPS steps.
+//
+const int HOME_SWITCH_AXES = 4;
+const uint8_t HOME_SWITCH_PINS[HOME_SWITCH_AXES] = {3, 21, 20, 19};
+const uint8_t HOME_POLLED_SWITCH_PIN = 29;
+const long HOME_SWITCH_STEPS = 1000;
+const long HOME_MAX_DISTANCE_InSteps = 100000;
+const unsigned long long HOME_GIVE_UP_PERIOD_InNS = 60000000000ULL;
+const unsigned long long HOME_SETTLE_PERIOD_InNS = 1000000000ULL;
+
+
+//
+// with -e a stop that crawls on longer than this has failed
+//
+const unsigned long long STOP_GIVE_UP_PERIOD_InNS = 60000000000ULL;
+
+
+//
+// variables global to this module
+//
+static std::vector<unsigned long long> stepTimes_InNS[NUMBER_OF_PORTS];
+static std::vector<unsigned long long> referenceStepTimes_InNS;
+static std::vector<double> idealStepTimes_InS;
+
+
+//
+// record the rising edges on the step pins
+//
+static void recordStep(uint8_t pin, uint8_t level, unsigned long long time_InNS)
+{
+  if (level != HIGH)
+    return;
+
+  for (int port = 0; port < NUMBER_OF_PORTS; port++)
+  {
+    if (STEP_PINS[port] == pin)
+      stepTimes_InNS[port].push_back(time_InNS);
+  }
+}
+
+
+
+//
+// record a step, then close the home switch of an axis that has got to it
+//
+static void recordHomingStep(uint8_t pin, uint8_t level, unsigned long long time_InNS)
+{
+  recordStep(pin, level, time_InNS);
+
+  for (int port = 0; port < HOME_SWITCH_AXES; port++)
+  {
+    if ((STEP_PINS[port] == pin) && ((long) stepTimes_InNS[port].size() >= HOME_SWITCH_STEPS))
+      simSetPinInput(HOME_SWITCH_PINS[port], LOW);
+  }
+}
+
+
+
+//
+// compute when the given step would happen on an ideal trapezoid that starts at time 0
+//  Enter:  step = step number, 1 to distance
+//  Exit:   ideal time in seconds
+//
+static double idealTrapezoidStepTime(long step, long distance, double speed, double acceleration)
+{
+  double accelerationDistance;
+  double peakSpeed;
+  double accelerationTime;
+  double moveTime;
+
+  //
+  // the deceleration distance is rounded and capped just like setupMoveInSteps() does it
+  //
+  accelerationDistance = round(speed * speed / (2.0 * acceleration));
+  if (distance <= accelerationDistance * 2)
+    accelerationDistance = distance / 2;
+
+  peakSpeed = sqrt(2.0 * acceleration * accelerationDistance);
+  accelerationTime = peakSpeed / acceleration;
+  moveTime = 2.0 * accelerationTime + (distance - 2.0 * accelerationDistance) / peakSpeed;
+
+  if (step <= accelerationDistance)
+    return(sqrt(2.0 * step / acceleration));
+
+  if (step <= distance - accelerationDistance)
+    return(accelerationTime + (step - accelerationDistance) / peakSpeed);
+
+  return(moveTime - sqrt(2.0 * (distance - step) / acceleration));
+}
+
+
+
+//
+// get the distance an S-curve takes to reach a speed from stopped
+//
+static double sCurveAccelerationDistance(double speed, double acceleration, double jerk)
+{
+  if (speed >= acceleration * acceleration / jerk)
+    return(speed * (speed / acceleration + acceleration / jerk) / 2.0);
+  return(speed * sqrt(speed / jerk));
+}
+
+
+
+//
+// compute when every step of the move happens on the ideal profile, either the
+// trapezoid or, with a jerk, the S-curve.  The S-curve is integrated in small time
+// steps with the jerk of each of its seven parts.
+//
+static void computeIdealStepTimes(long distance, double speed, double acceleration, double jerk)
+{
+  double peakSpeed;
+  double halfDistance;
+  double jerkTime;
+  double constantAccelerationTime;
+  double cruiseTime;
+  double partEndTimes[7];
+  double partJerks[7] = {1, 0, -1, 0, -1, 0, 1};
+  double time, position, velocity, accel, partJerk;
+  double dt = IDEAL_SCURVE_TIME_STEP_InS;
+  double nextPosition;
+  long step;
+  int part;
+
+  idealStepTimes_InS.clear();
+  if (jerk <= 0)
+  {
+    for (step = 1; step <= distance; step++)
+      idealStepTimes_InS.push_back(idealTrapezoidStepTime(step, distance, speed, acceleration));
+    return;
+  }
+
+  //
+  // the peak speed, and the time of each part, the same way setupMoveInSteps() does
+  //
+  peakSpeed = speed;
+  halfDistance = distance / 2.0;
+  if (sCurveAccelerationDistance(peakSpeed, acceleration, jerk) > halfDistance)
+  {
+    peakSpeed = pow(halfDistance * sqrt(jerk), 2.0 / 3.0);
+    if (peakSpeed > acceleration * acceleration / jerk)
+      peakSpeed = (sqrt(acceleration * acceleration / (jerk * jerk) + 8.0 * halfDistance / acceleration) - acceleration / jerk) * acceleration / 2.0;
+  }
+  if (peakSpeed >= acceleration * acceleration / jerk)
+  {
+    jerkTime = acceleration / jerk;
+    constantAccelerationTime = (peakSpeed - acceleration * jerkTime) / acceleration;
+  }
+  else
+  {
+    jerkTime = sqrt(peakSpeed / jerk);
+    constantAccelerationTime = 0;
+  }
+  cruiseTime = (distance - 2.0 * sCurveAccelerationDistance(peakSpeed, acceleration, jerk)) / peakSpeed;
+  if (cruiseTime < 0)
+    cruiseTime = 0;
+
+  partEndTimes[0] = jerkTime;
+  partEndTimes[1] = partEndTimes[0] + constantAccelerationTime;
+  partEndTimes[2] = partEndTimes[1] + jerkTime;
+  partEndTimes[3] = partEndTimes[2] + cruiseTime;
+  partEndTimes[4] = partEndTimes[3] + jerkTime;
+  partEndTimes[5] = partEndTimes[4] + constantAccelerationTime;
+  partEndTimes[6] = partEndTimes[5] + jerkTime;
+
+  //
+  // integrate, noting the time the position passes each whole step
+  //
+  time = 0;
+  position = 0;
+  velocity = 0;
+  accel = 0;
+  part = 0;
+  step = 1;
+  while (step <= distance)
+  {
+    while ((part < 6) && (time >= partEndTimes[part]))
+      part++;
+    partJerk = partJerks[part] * jerk;
+    if ((part == 6) && (time >= partEndTimes[6]))
+      partJerk = 0;
+
+    nextPosition = position + velocity * dt + accel * dt * dt / 2.0 + partJerk * dt * dt * dt / 6.0;
+    velocity += accel * dt + partJerk * dt * dt / 2.0;
+    accel += partJerk * dt;
+    if (velocity <= 0)
+    {
+      //
+      // rounding left the last step short, finish the move where it stopped
+      //
+      for (; step <= distance; step++)
+        idealStepTimes_InS.push_back(time);
+      break;
+    }
+
+    while ((step <= distance) && (nextPosition >= step))
+    {
+      idealStepTimes_InS.push_back(time + dt * (step - position) / (nextPosition - position));
+      step++;
+    }
+    position = nextPosition;
+    time += dt;
+  }
+}
+
+
+
+//
+// get the ideal time of a step worked out by computeIdealStepTimes()
+//  Enter:  step = step number, 1 to distance
+//  Exit:   ideal time in seconds
+//
+static double idealStepTime(long step)
+{
+  if (step < 1)
+    step = 1;
+  if (step > (long) idealStepTimes_InS.size())
+    step = idealStepTimes_InS.size();
+  return(idealStepTimes_InS[step - 1]);
+}
+
+
+
+//
+// move the axes on a freshly reset board, recording every step
+//  Exit:  virtual time the moves started returned
+//
+static unsigned long long runMoves(int axes, double speed, double acceleration, long distance, bool zeroCost,
+  bool timerDriven, bool fixedPoint, bool linear, double jerk, int queuedMoves)
+{
+  SpeedyStepper steppers[NUMBER_OF_PORTS];
+  StepperGroup group;
+  SpeedyStepper *movers[NUMBER_OF_PORTS];
+  int moverCount;
+  long distances[NUMBER_OF_PORTS];
+  unsigned long long moveStartTime_InNS;
+  bool allComplete;
+
+  simReset();
+  if (zeroCost)
+  {
+    for (int cost = 0; cost < SIM_NUMBER_OF_COSTS; cost++)
+      simSetCallCostInNS(cost, 0);
+  }
+
+  for (int axis = 0; axis < NUMBER_OF_PORTS; axis++)
+    stepTimes_InNS[axis].clear();
+
+  for (int axis = 0; axis < axes; axis++)
+  {
+    steppers[axis].connectToPort(axis + 1);
+    steppers[axis].setSpeedInStepsPerSecond(speed);
+    steppers[axis].setAccelerationInStepsPerSecondPerSecond(acceleration);
+    steppers[axis].useFixedPointRamp(fixedPoint);
+    steppers[axis].setJerkInStepsPerSecondPerSecondPerSecond(jerk);
+  }
+  simSetPinChangeHook(recordStep);
+
+  //
+  // either every axis runs its own ramp, or the group runs one ramp for all of them
+  //
+  if (linear)
+  {
+    group.setSpeedInStepsPerSecond(speed);
+    group.setAccelerationInStepsPerSecondPerSecond(acceleration);
+    group.useFixedPointRamp(fixedPoint);
+    group.setJerkInStepsPerSecondPerSecondPerSecond(jerk);
+    for (int axis = 0; axis < axes; axis++)
+    {
+      group.addAxis(steppers[axis]);
+      distances[axis] = distance;
+    }
+    movers[0] = &group;
+    moverCount = 1;
+  }
+  else
+  {
+    for (int axis = 0; axis < axes; axis++)
+      movers[axis] = &steppers[axis];
+    moverCount = axes;
+  }
+
+  if (timerDriven)
+  {
+    for (int mover = 0; mover < moverCount; mover++)
+      stepperTimer.attach(*movers[mover]);
+    stepperTimer.begin();
+  }
+
+  if (linear)
+    group.setupLinearMoveInSteps(distances);
+  else
+  {
+    for (int axis = 0; axis < axes; axis++)
+    {
+      steppers[axis].setupRelativeMoveInSteps(distance / queuedMoves);
+      for (int move = 1; move < queuedMoves; move++)
+        steppers[axis].queueRelativeMoveInSteps(move == queuedMoves - 1 ? distance - (distance / queuedMoves) * move : distance / queuedMoves);
+    }
+  }
+  moveStartTime_InNS = simGetTimeInNS();
+
+  //
+  // the timer steps the axes on its own, just wait for them.  processMovement() only
+  // reports for a timer driven axis, other than starting the next queued move of an
+  // S-curve.
+  //
+  if (timerDriven)
+  {
+    do
+    {
+      simAdvanceTimeInNS(TIMER_WAIT_PERIOD_InNS);
+      allComplete = true;
+      for (int mover = 0; mover < moverCount; mover++)
+      {
+        if (!movers[mover]->processMovement())
+          allComplete = false;
+      }
+    } while(!allComplete);
+
+    for (int mover = 0; mover < moverCount; mover++)
+      stepperTimer.detach(*movers[mover]);
+    return(moveStartTime_InNS);
+  }
+
+  //
+  // run the moves the way a sketch polls them
+  //
+  do
+  {
+    allComplete = true;
+    for (int mover = 0; mover < moverCount; mover++)
+    {
+      if (!movers[mover]->processMovement())
+        allComplete = false;
+    }
+
+    //
+    // with a zero cost model nothing else moves the clock
+    //
+    if (zeroCost)
+      simAdvanceTimeInNS(1000);
+  } while(!allComplete);
+
+  return(moveStartTime_InNS);
+}
+
+
+
+//
+// move the axes and stop them early, checking that each stops within the distance and
+// time the profile takes from its speed.  The acceleration at the stop isn't known
+// from outside, the limits take the most the move allows, which is still far short of
+// the distance to stop from the peak speed of a long move.
+//  Exit:  true returned if every axis did
+//
+static bool stopMovesEarly(int axes, double speed, double acceleration, long distance, bool timerDriven,
+  bool fixedPoint, double jerk, long stopStep)
+{
+  SpeedyStepper steppers[NUMBER_OF_PORTS];
+  bool stopped[NUMBER_OF_PORTS] = {false};
+  double stopSpeed[NUMBER_OF_PORTS];
+  unsigned long long stopTime_InNS[NUMBER_OF_PORTS];
+  bool allComplete;
+  bool passed = true;
+  double rampDownTime;
+  double peakSpeed;
+  double allowedDistance;
+  double allowedTime_InS;
+  long overrun;
+  double stopPeriod_InS;
+  double stop_InS;
+  bool axisPassed;
+  unsigned long long lastStopTime_InNS = 0;
+
+  simReset();
+  for (int axis = 0; axis < NUMBER_OF_PORTS; axis++)
+    stepTimes_InNS[axis].clear();
+
+  for (int axis = 0; axis < axes; axis++)
+  {
+    steppers[axis].connectToPort(axis + 1);
+    steppers[axis].setSpeedInStepsPerSecond(speed);
+    steppers[axis].setAccelerationInStepsPerSecondPerSecond(acceleration);
+    steppers[axis].useFixedPointRamp(fixedPoint);
+    steppers[axis].setJerkInStepsPerSecondPerSecondPerSecond(jerk);
+    if (timerDriven)
+      stepperTimer.attach(steppers[axis]);
+  }
+  simSetPinChangeHook(recordStep);
+  if (timerDriven)
+    stepperTimer.begin();
+
+  for (int axis = 0; axis < axes; axis++)
+    steppers[axis].setupRelativeMoveInSteps(distance);
+
+  do
+  {
+    if (timerDriven)
+      simAdvanceTimeInNS(TIMER_WAIT_PERIOD_InNS);
+    allComplete = true;
+    for (int axis = 0; axis < axes; axis++)
+    {
+      if (!stopped[axis] && ((long) stepTimes_InNS[axis].size() >= stopStep))
+      {
+        stopSpeed[axis] = steppers[axis].getCurrentVelocityInStepsPerSecond();
+        stopTime_InNS[axis] = simGetTimeInNS();
+        steppers[axis].setupStop();
+        stopped[axis] = true;
+        lastStopTime_InNS = stopTime_InNS[axis];
+      }
+      if (!steppers[axis].processMovement())
+        allComplete = false;
+    }
+  } while(!allComplete && ((lastStopTime_InNS == 0) ||
+    (simGetTimeInNS() - lastStopTime_InNS < STOP_GIVE_UP_PERIOD_InNS)));
+
+  printf("SpeedyStepper stopped after %ld of %ld steps, %d ax%s at %.0f steps/s, %.0f steps/s/s%s, %s, %s ramp\n",
+    stopStep, distance, axes, axes == 1 ? "is" : "es", speed, acceleration, jerk > 0 ? ", S-curve" : "",
+    timerDriven ? "timer driven" : "polled", fixedPoint ? "fixed point" : "float");
+  printf("  %-5s %10s %8s %8s %10s %10s  %s\n", "axis", "speed", "overrun", "allowed", "stop ms", "allowed", "");
+  for (int axis = 0; axis < axes; axis++)
+  {
+    //
+    // from the speed at the stop, ramp the acceleration down from its most, then slow
+    // to a stop
+    //
+    if (jerk > 0)
+    {
+      rampDownTime = acceleration / jerk;
+      peakSpeed = stopSpeed[axis] + acceleration * rampDownTime / 2.0;
+      allowedDistance = rampDownTime * (stopSpeed[axis] + acceleration * rampDownTime / 3.0) +
+        sCurveAccelerationDistance(peakSpeed, acceleration, jerk);
+      if (peakSpeed >= acceleration * acceleration / jerk)
+        allowedTime_InS = rampDownTime + peakSpeed / acceleration + acceleration / jerk;
+      else
+        allowedTime_InS = rampDownTime + 2.0 * sqrt(peakSpeed / jerk);
+      stopPeriod_InS = pow(6.0 / jerk, 1.0 / 3.0);
+    }
+    else
+    {
+      allowedDistance = stopSpeed[axis] * stopSpeed[axis] / (2.0 * acceleration);
+      allowedTime_InS = stopSpeed[axis] / acceleration;
+      stopPeriod_InS = 1.0 / sqrt(2.0 * acceleration);
+    }
+    //
+    // the speed read is that of the last step, so allow for a step more than that
+    //
+    allowedDistance = allowedDistance * 1.01 + 2;
+    allowedTime_InS += 2 * stopPeriod_InS;
+
+    overrun = (long) stepTimes_InNS[axis].size() - stopStep;
+    stop_InS = stepTimes_InNS[axis].empty() ? 0.0 : (stepTimes_InNS[axis].back() - stopTime_InNS[axis]) / 1e9;
+    axisPassed = stopped[axis] && steppers[axis].motionComplete() &&
+      (overrun <= allowedDistance) && (stop_InS <= allowedTime_InS) &&
+      (steppers[axis].getCurrentPositionInSteps() == (long) stepTimes_InNS[axis].size());
+    if (!axisPassed)
+      passed = false;
+    printf("  %-5d %10.1f %8ld %8.0f %10.1f %10.1f  %s\n", axis + 1, stopSpeed[axis], overrun, allowedDistance,
+      stop_InS * 1000.0, allowedTime_InS * 1000.0, axisPassed ? "ok" : "FAILED");
+  }
+
+  if (timerDriven)
+  {
+    for (int axis = 0; axis < axes; axis++)
+      stepperTimer.detach(steppers[axis]);
+  }
+  return(passed);
+}
+
+
+
+//
+// home the axes from the timer with the main loop held up, and check that each one
+// stopped past its switch within its stopping distance and with zero at the switch
+//  Exit:  true returned if every axis did
+//
+static bool homeAxes(int axes, double speed, double acceleration, bool fixedPoint, unsigned long stall_InMS)
+{
+  SpeedyStepper steppers[HOME_SWITCH_AXES];
+  unsigned long long homingStartTime_InNS;
+  bool allComplete;
+  bool passed = true;
+  long overrun;
+  long stoppingDistance;
+  long position;
+
+  simReset();
+  for (int axis = 0; axis < NUMBER_OF_PORTS; axis++)
+    stepTimes_InNS[axis].clear();
+
+  for (int axis = 0; axis < axes; axis++)
+  {
+    simSetPinInput(HOME_SWITCH_PINS[axis], HIGH);
+    steppers[axis].connectToPort(axis + 1);
+    steppers[axis].setAccelerationInStepsPerSecondPerSecond(acceleration);
+    steppers[axis].useFixedPointRamp(fixedPoint);
+    stepperTimer.attach(steppers[axis]);
+  }
+  simSetPinChangeHook(recordHomingStep);
+  stepperTimer.begin();
+
+  printf("SpeedyStepper homing, %d ax%s from the timer at %.0f steps/s, %.0f steps/s/s, %s ramp, loop() held up for %lu ms\n",
+    axes, axes == 1 ? "is" : "es", speed, acceleration, fixedPoint ? "fixed point" : "float", stall_InMS);
+
+  //
+  // the timer would step on past a switch that only loop() reads
+  //
+  steppers[0].setupHomeInSteps(1, speed, HOME_MAX_DISTANCE_InSteps, HOME_POLLED_SWITCH_PIN);
+  if (steppers[0].getHomingStatus() != HOME_STATUS_FAILED)
+  {
+    printf("  FAILED: homing against pin %d, which has no interrupt, was started\n", HOME_POLLED_SWITCH_PIN);
+    return(false);
+  }
+  printf("  homing against pin %d, which has no interrupt, failed at once\n", HOME_POLLED_SWITCH_PIN);
+
+  for (int axis = 0; axis < axes; axis++)
+    steppers[axis].setupHomeInSteps(1, speed, HOME_MAX_DISTANCE_InSteps, HOME_SWITCH_PINS[axis]);
+  homingStartTime_InNS = simGetTimeInNS();
+
+  simAdvanceTimeInNS(stall_InMS * 1000000ULL);
+  do
+  {
+    simAdvanceTimeInNS(TIMER_WAIT_PERIOD_InNS);
+    allComplete = true;
+    for (int axis = 0; axis < axes; axis++)
+    {
+      if (!steppers[axis].processMovement())
+        allComplete = false;
+    }
+  } while(!allComplete && (simGetTimeInNS() - homingStartTime_InNS < HOME_GIVE_UP_PERIOD_InNS));
+
+  //
+  // the axes must stay where homing left them
+  //
+  simAdvanceTimeInNS(HOME_SETTLE_PERIOD_InNS);
+  for (int axis = 0; axis < axes; axis++)
+    steppers[axis].processMovement();
+
+  //
+  // the switch closed on step HOME_SWITCH_STEPS, the interrupt latched the position
+  // there and the axis decelerated from the homing speed
+  //
+  stoppingDistance = (long) ceil(speed * speed / (2 * acceleration)) + 1;
+  printf("  %-5s %8s %8s %8s %10s  %s\n", "axis", "steps", "overrun", "allowed", "position", "status");
+  for (int axis = 0; axis < axes; axis++)
+  {
+    overrun = (long) stepTimes_InNS[axis].size() - HOME_SWITCH_STEPS;
+    position = steppers[axis].getCurrentPositionInSteps();
+    if ((steppers[axis].getHomingStatus() != HOME_STATUS_SUCCEEDED) || (overrun > stoppingDistance) ||
+        (labs(position - overrun) > 1))
+      passed = false;
+    printf("  %-5d %8lu %8ld %8ld %10ld  %s\n", axis + 1, (unsigned long) stepTimes_InNS[axis].size(), overrun,
+      stoppingDistance, position, steppers[axis].getHomingStatus() == HOME_STATUS_SUCCEEDED ? "succeeded" : "FAILED");
+  }
+
+  for (int axis = 0; axis < axes; axis++)
+    stepperTimer.detach(steppers[axis]);
+  return(passed);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  int axes = 1;
+  double speed = 500;
+  double acceleration = 500;
+  long distance = 2000;
+  double bucketWidth_InUS = 10;
+  const char *tracePath = NULL;
+  bool zeroCost = false;
+  bool timerDriven = false;
+  unsigned long maximumStepRate = 10000;
+  bool fixedPoint = false;
+  bool ganged = false;
+  bool linear = false;
+  double jerk = 0;
+  int queuedMoves = 1;
+  long homingStall_InMS = -1;
+  long stopStep = 0;
+  const SimInterruptStatistics *statistics;
+  long totalSteps;
+  int option;
+
+  unsigned long long moveStartTime_InNS;
+  FILE *traceFile = NULL;
+  long histogram[HISTOGRAM_BUCKETS] = {0};
+  long histogramMax = 0;
+  double time_InUS, idealTime_InUS;
+  double period_InUS, idealPeriod_InUS, scheduledPeriod_InUS;
+  double jitter_InUS;
+  int bucket;
+
+
+  while((option = getopt(argc, argv, "x:s:a:d:w:o:ztr:fglj:q:h:e:")) != -1)
+  {
+    switch(option)
+    {
+      case 'x': axes = atoi(optarg); break;
+      case 's': speed = atof(optarg); break;
+      case 'a': acceleration = atof(optarg); break;
+      case 'd': distance = atol(optarg); break;
+      case 'w': bucketWidth_InUS = atof(optarg); break;
+      case 'o': tracePath = optarg; break;
+      case 'z': zeroCost = true; break;
+      case 't': timerDriven = true; break;
+      case 'r': maximumStepRate = strtoul(optarg, NULL, 10); break;
+      case 'f': fixedPoint = true; break;
+      case 'g': ganged = true; break;
+      case 'l': linear = true; break;
+      case 'j': jerk = atof(optarg); break;
+      case 'q': queuedMoves = atoi(optarg); break;
+      case 'h': homingStall_InMS = atol(optarg); break;
+      case 'e': stopStep = atol(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-x axes] [-s speed] [-a acceleration] [-d distance] [-w bucketWidth] [-o trace.csv] [-z] [-t] [-r maxStepRate] [-f] [-g] [-l] [-j jerk] [-q moves] [-h stallMS] [-e stopStep]\n", argv[0]);
+        return(1);
+    }
+  }
+
+  if ((axes < 1) || (axes > NUMBER_OF_PORTS) || (speed <= 0) || (acceleration <= 0) || (distance < 1) ||
+      (bucketWidth_InUS <= 0) || (jerk < 0) || (queuedMoves < 1) || (queuedMoves > MOVE_QUEUE_SIZE + 1))
+  {
+    fprintf(stderr, "axes must be 1 - %d, speed, acceleration, distance and bucket width greater than 0, jerk 0 or more, moves 1 - %d\n",
+      NUMBER_OF_PORTS, MOVE_QUEUE_SIZE + 1);
+    return(1);
+  }
+
+  if (homingStall_InMS >= 0)
+  {
+    if (axes > HOME_SWITCH_AXES)
+    {
+      fprintf(stderr, "-h homes at most %d axes\n", HOME_SWITCH_AXES);
+      return(1);
+    }
+    stepperTimer.setMaximumStepRate(maximumStepRate);
+    return(homeAxes(axes, speed, acceleration, fixedPoint, homingStall_InMS) ? 0 : 1);
+  }
+
+  if (stopStep > 0)
+  {
+    stepperTimer.setMaximumStepRate(maximumStepRate);
+    return(stopMovesEarly(axes, speed, acceleration, distance, timerDriven, fixedPoint, jerk, stopStep) ? 0 : 1);
+  }
+
+  if (tracePath != NULL)
+  {
+    traceFile = fopen(tracePath, "w");
+    if (traceFile == NULL)
+    {
+      perror(tracePath);
+      return(1);
+    }
+    fprintf(traceFile, "axis,step,time_us,ideal_time_us,period_us,ideal_period_us,scheduled_period_us\n");
+  }
+
+  //
+  // the reference run gives the step times the ramp asks for when nothing gets in the
+  // way, then run all of the axes with the cost model
+  //
+  computeIdealStepTimes(distance, speed, acceleration, jerk);
+  runMoves(1, speed, acceleration, distance, true, false, false, false, jerk, 1);
+  referenceStepTimes_InNS = stepTimes_InNS[0];
+  stepperTimer.setMaximumStepRate(maximumStepRate);
+  stepperTimer.setGangedStepPulses(ganged);
+  moveStartTime_InNS = runMoves(axes, speed, acceleration, distance, zeroCost, timerDriven, fixedPoint, linear, jerk, queuedMoves);
+
+  //
+  // compare every step with the ideal trapezoid or S-curve
+  //
+  printf("SpeedyStepper step timing, %d ax%s, %ld steps", axes, axes == 1 ? "is" : "es", distance);
+  if (queuedMoves > 1)
+    printf(" in %d queued moves", queuedMoves);
+  printf(" at %.0f steps/s, %.0f steps/s/s%s%s%s%s, %s ramp%s\n",
+    speed, acceleration, jerk > 0 ? ", S-curve" : "",
+    zeroCost ? ", zero cost model" : "",
+    timerDriven ? ", timer driven" : ", polled", (timerDriven && ganged) ? " with ganged pulses" : "",
+    fixedPoint ? "fixed point" : "float", linear ? " for a line" : "");
+  printf("  %-5s %8s %10s %10s %12s %12s %12s %12s %10s\n", "axis", "steps", "time ms", "ideal ms",
+    "max early us", "max late us", "jitter sd us", "max jitter us", "max rate/s");
+
+  for (int axis = 0; axis < axes; axis++)
+  {
+    std::vector<unsigned long long> &stepTimes = stepTimes_InNS[axis];
+    double maxEarly_InUS = 0;
+    double maxLate_InUS = 0;
+    double sumOfJitter = 0;
+    double sumOfSquaredJitter = 0;
+    double maxJitter_InUS = 0;
+    double minPeriod_InUS = 1e30;
+    double error_InUS;
+    double standardDeviation_InUS;
+    long steps = stepTimes.size();
+
+    //
+    // the ideal profile starts at the first step, the time from setting up the move to
+    // the first step is part of the ramp, not jitter
+    //
+    double offset_InUS = (stepTimes.empty() ? 0 : (stepTimes[0] - moveStartTime_InNS) / 1000.0) -
+                         idealStepTime(1) * 1e6;
+
+    for (long step = 1; step <= steps; step++)
+    {
+      time_InUS = (stepTimes[step - 1] - moveStartTime_InNS) / 1000.0 - offset_InUS;
+      idealTime_InUS = idealStepTime(step) * 1e6;
+
+      error_InUS = time_InUS - idealTime_InUS;
+      if (-error_InUS > maxEarly_InUS)
+        maxEarly_InUS = -error_InUS;
+      if (error_InUS > maxLate_InUS)
+        maxLate_InUS = error_InUS;
+
+      if (step == 1)
+      {
+        period_InUS = 0;
+        idealPeriod_InUS = 0;
+        scheduledPeriod_InUS = 0;
+      }
+      else
+      {
+        period_InUS = (stepTimes[step - 1] - stepTimes[step - 2]) / 1000.0;
+        idealPeriod_InUS = idealTime_InUS - idealStepTime(step - 1) * 1e6;
+        scheduledPeriod_InUS = period_InUS;
+        if (step <= (long) referenceStepTimes_InNS.size())
+          scheduledPeriod_InUS = (referenceStepTimes_InNS[step - 1] - referenceStepTimes_InNS[step - 2]) / 1000.0;
+        if (period_InUS < minPeriod_InUS)
+          minPeriod_InUS = period_InUS;
+
+        jitter_InUS = period_InUS - scheduledPeriod_InUS;
+        sumOfJitter += jitter_InUS;
+        sumOfSquaredJitter += jitter_InUS * jitter_InUS;
+        if (fabs(jitter_InUS) > maxJitter_InUS)
+          maxJitter_InUS = fabs(jitter_InUS);
+
+        bucket = (int) floor(jitter_InUS / bucketWidth_InUS + 0.5) + HISTOGRAM_BUCKETS / 2;
+        bucket = constrain(bucket, 0, HISTOGRAM_BUCKETS - 1);
+        histogram[bucket]++;
+      }
+
+      if (traceFile != NULL)
+        fprintf(traceFile, "%d,%ld,%.3f,%.3f,%.3f,%.3f,%.3f\n", axis + 1, step, time_InUS, idealTime_InUS,
+          period_InUS, idealPeriod_InUS, scheduledPeriod_InUS);
+    }
+
+    standardDeviation_InUS = 0;
+    if (steps > 1)
+      standardDeviation_InUS = sqrt(fmax(0.0, sumOfSquaredJitter / (steps - 1) -
+        (sumOfJitter / (steps - 1)) * (sumOfJitter / (steps - 1))));
+
+    printf("  %-5d %8ld %10.1f %10.1f %12.1f %12.1f %12.1f %12.1f %10.0f\n",
+      axis + 1,
+      steps,
+      steps ? (stepTimes[steps - 1] - moveStartTime_InNS) / 1e6 : 0.0,
+      (idealStepTime(distance) * 1e6 + offset_InUS) / 1000.0,
+      maxEarly_InUS,
+      maxLate_InUS,
+      standardDeviation_InUS,
+      maxJitter_InUS,
+      steps > 1 ? 1e6 / minPeriod_InUS : 0.0);
+  }
+
+  //
+  // print the histogram of the period deviations
+  //
+  printf("\n  step period - scheduled step period, all axes\n");
+  for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+  {
+    if (histogram[bucket] > histogramMax)
+      histogramMax = histogram[bucket];
+  }
+  for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+  {
+    double bucketCenter_InUS = (bucket - HISTOGRAM_BUCKETS / 2) * bucketWidth_InUS;
+    int barLength = histogramMax ? (int) (50 * histogram[bucket] / histogramMax) : 0;
+
+    printf("  %s%8.1f us %8ld |%.*s\n",
+      (bucket == 0) ? "<=" : ((bucket == HISTOGRAM_BUCKETS - 1) ? ">=" : "  "),
+      bucketCenter_InUS, histogram[bucket], barLength,
+      "##################################################");
+  }
+
+  //
+  // the time the ISR takes per step sets the highest rate the board can step at
+  //
+  if (timerDriven)
+  {
+    printf("\n  late steps (held back by the %lu steps/s limit or another axis): %lu\n",
+      maximumStepRate, stepperTimer.getLateStepCount());
+
+    statistics = simGetInterruptStatistics(SIM_VECTOR_TIMER1_COMPA);
+    totalSteps = 0;
+    for (int axis = 0; axis < axes; axis++)
+      totalSteps += stepTimes_InNS[axis].size();
+    if ((totalSteps > 0) && (statistics->totalVirtualTime_InNS > 0))
+      printf("  timer ISR time:   %.1f us per step, at most %.0f steps/s over all axes with the CPU doing nothing else\n",
+        statistics->totalVirtualTime_InNS / 1000.0 / totalSteps,
+        1e9 * totalSteps / statistics->totalVirtualTime_InNS);
+  }
+
+  if (traceFile != NULL)
+    fclose(traceFile);
+  return(0);
+}
+
+// -------------------------------------- End --------------------------------------
@@ -0,0 +1,53 @@
+//      ******************************************************************
+//      *                                                                *
+//      *          Host replacement for the Arduino Stream class         *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Only enough of Print and Stream for SerialDebug.h to be included by a sketch,
+// the debug port itself is not simulated.
+//
+
+#ifndef Stream_h
+#define Stream_h
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    size_t write(const char *str)
+    {
+      return(str == NULL ? 0 : write((const uint8_t *) str, strlen(str)));
+    }
+
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+      size_t n = 0;
+      while (size--)
+        n += write(*buffer++);
+      return(n);
+    }
+};
+
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+};
+
+// ------------------------------------ End ---------------------------------
+#endif
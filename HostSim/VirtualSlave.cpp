@@ -0,0 +1,437 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                          VirtualSlave                          *
+//      *                                                                *
+//      *          The Slave sketch behind a Linux pseudo-terminal       *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Runs the Slave sketch on the simulated hardware in real time and connects USART 2 to
+// a pseudo-terminal, so SlaveMaster.py (or anything else that talks to a serial port)
+// can be pointed at it instead of a board.
+//
+// Bytes written by the master are delivered to the RX ISR at the simulated baud rate,
+// and the response is paced the same way, including the 18us RS-485 turnaround in
+// sentResponsePacketToMaster() and any time the callables spend.  Bytes shifted out
+// while the transmitter enable pin is off never reach the master, as on the real line.
+//
+// Usage:
+//    virtualSlave [-b baudRate] [-a slaveAddress] [-l linkPath] [-s seconds] [-v]
+//
+//    -b  baud rate passed to SerialSlave::open() (default 115200)
+//    -a  slave address (default 17, the address in Slave.ino)
+//    -l  create a symbolic link to the pseudo-terminal, i.e. /tmp/ttyVirtualSlave
+//    -s  print statistics every this many seconds
+//    -v  print every byte sent and received
+//
+// Then on the Pi side:
+//        master = SlaveMaster(port="/tmp/ttyVirtualSlave")
+//
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "SimHardware.h"
+#include "SerialSlave.h"
+
+
+const byte SLAVE_RESPONSE_RECEIVED_COMMAND = 0xA9;
+const byte SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA = 0xAC;
+const byte SLAVE_RESPONSE_RESEND_COMMAND = 0xB8;
+
+const byte TRANSMITTER_ENABLE_PIN = 40;
+
+const unsigned long long LOOP_MINIMUM_PERIOD_InNS = 10000ULL;
+
+
+//
+// the sketch
+//
+void setup(void);
+void loop(void);
+
+
+//
+// values for responseParserState
+//
+const byte RESPONSE_STATE_WAITING_FOR_TYPE = 0;
+const byte RESPONSE_STATE_WAITING_FOR_TYPE_REPEAT = 1;
+const byte RESPONSE_STATE_WAITING_FOR_DATA_LENGTH = 2;
+const byte RESPONSE_STATE_WAITING_FOR_DATA = 3;
+
+
+//
+// variables global to this module
+//
+static int ptyFd;
+static unsigned long long wallClockStart_InNS;
+static unsigned long long lastArrivalTime_InNS;
+static volatile sig_atomic_t stopRequested;
+static bool verbose;
+
+static unsigned long bytesReceived;
+static unsigned long bytesSent;
+static unsigned long bytesDropped;
+static unsigned long commandHeaders;
+static unsigned long responsesNoData;
+static unsigned long responsesWithData;
+static unsigned long responsesResend;
+static unsigned long long turnaroundCount;
+static unsigned long long totalTurnaroundTime_InNS;
+static unsigned long long maxTurnaroundTime_InNS;
+
+static byte lastByteReceived;
+static bool waitingForFirstResponseByte;
+static byte responseParserState;
+static byte responseType;
+static int responseBytesRemaining;
+
+
+//
+// read the monotonic wall clock
+//
+static unsigned long long wallClockInNS(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return((unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+
+
+//
+// tally one response byte to count the response packets by type
+//
+static void countResponseByte(byte c)
+{
+  switch(responseParserState)
+  {
+    case RESPONSE_STATE_WAITING_FOR_TYPE:
+    {
+      if ((c == SLAVE_RESPONSE_RECEIVED_COMMAND) || (c == SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA) ||
+          (c == SLAVE_RESPONSE_RESEND_COMMAND))
+      {
+        responseType = c;
+        responseParserState = RESPONSE_STATE_WAITING_FOR_TYPE_REPEAT;
+      }
+      break;
+    }
+
+    case RESPONSE_STATE_WAITING_FOR_TYPE_REPEAT:
+    {
+      responseParserState = RESPONSE_STATE_WAITING_FOR_TYPE;
+      if (c != responseType)
+        break;
+
+      if (c == SLAVE_RESPONSE_RECEIVED_COMMAND)
+        responsesNoData++;
+      else if (c == SLAVE_RESPONSE_RESEND_COMMAND)
+        responsesResend++;
+      else
+        responseParserState = RESPONSE_STATE_WAITING_FOR_DATA_LENGTH;
+      break;
+    }
+
+    case RESPONSE_STATE_WAITING_FOR_DATA_LENGTH:
+    {
+      responseBytesRemaining = c + 1;
+      responseParserState = RESPONSE_STATE_WAITING_FOR_DATA;
+      break;
+    }
+
+    case RESPONSE_STATE_WAITING_FOR_DATA:
+    {
+      responseBytesRemaining--;
+      if (responseBytesRemaining == 0)
+      {
+        responsesWithData++;
+        responseParserState = RESPONSE_STATE_WAITING_FOR_TYPE;
+      }
+      break;
+    }
+  }
+}
+
+
+
+//
+// called by the simulation before the virtual clock moves forward, blocks until the wall
+// clock catches up, scheduling bytes from the master as they come in
+//
+static void waitForWallClock(unsigned long long time_InNS)
+{
+  unsigned long long now_InNS;
+  unsigned long long remaining_InNS;
+  unsigned long long arrivalTime_InNS;
+  struct pollfd pollFd;
+  struct timespec timeout;
+  byte buffer[256];
+  ssize_t count;
+
+  if (stopRequested)
+    return;
+
+  while(true)
+  {
+    now_InNS = wallClockInNS() - wallClockStart_InNS;
+    remaining_InNS = (time_InNS > now_InNS) ? time_InNS - now_InNS : 0;
+
+    pollFd.fd = ptyFd;
+    pollFd.events = POLLIN;
+    timeout.tv_sec = remaining_InNS / 1000000000ULL;
+    timeout.tv_nsec = remaining_InNS % 1000000000ULL;
+    if (ppoll(&pollFd, 1, &timeout, NULL) > 0)
+    {
+      count = read(ptyFd, buffer, sizeof(buffer));
+      if (count > 0)
+      {
+        //
+        // the bytes arrived at the wall clock time, deliver them one byte time apart
+        //
+        arrivalTime_InNS = wallClockInNS() - wallClockStart_InNS;
+        if (arrivalTime_InNS < simGetTimeInNS())
+          arrivalTime_InNS = simGetTimeInNS();
+        if (arrivalTime_InNS < lastArrivalTime_InNS)
+          arrivalTime_InNS = lastArrivalTime_InNS;
+
+        for (ssize_t i = 0; i < count; i++)
+        {
+          arrivalTime_InNS += simUsartGetByteTimeInNS();
+          simUsartReceiveAt(buffer[i], arrivalTime_InNS);
+
+          if ((lastByteReceived == 0xAA) && (buffer[i] == 0x55))
+            commandHeaders++;
+          lastByteReceived = buffer[i];
+          if (verbose)
+            printf("  -> %02X\n", buffer[i]);
+        }
+        lastArrivalTime_InNS = arrivalTime_InNS;
+        bytesReceived += count;
+        waitingForFirstResponseByte = true;
+        return;
+      }
+
+      //
+      // nobody has the terminal open, don't spin on the hang up
+      //
+      if ((count < 0) && (errno == EIO))
+        usleep(1000);
+    }
+
+    if (stopRequested || (wallClockInNS() - wallClockStart_InNS >= time_InNS))
+      return;
+  }
+}
+
+
+
+//
+// called by the simulation each time USART 2 finishes shifting out a byte
+//
+static void sendByteToMaster(uint8_t c, bool driverEnabled, unsigned long long startTime_InNS,
+                             unsigned long long endTime_InNS)
+{
+  unsigned long long turnaround_InNS;
+
+  if (!driverEnabled)
+  {
+    bytesDropped++;
+    return;
+  }
+
+  //
+  // the turnaround is from the end of the last byte received to the start of the response
+  //
+  if (waitingForFirstResponseByte && (startTime_InNS >= lastArrivalTime_InNS))
+  {
+    turnaround_InNS = startTime_InNS - lastArrivalTime_InNS;
+    turnaroundCount++;
+    totalTurnaroundTime_InNS += turnaround_InNS;
+    if (turnaround_InNS > maxTurnaroundTime_InNS)
+      maxTurnaroundTime_InNS = turnaround_InNS;
+    waitingForFirstResponseByte = false;
+  }
+
+  if (write(ptyFd, &c, 1) == 1)
+    bytesSent++;
+  countResponseByte(c);
+  if (verbose)
+    printf("  <- %02X\n", c);
+}
+
+
+
+//
+// print what has happened so far
+//
+static void printStatistics(void)
+{
+  const SimInterruptStatistics *statistics;
+  double seconds;
+
+  seconds = simGetTimeInNS() / 1e9;
+  printf("virtualSlave after %.1f seconds\n", seconds);
+  printf("  bytes:              %lu received, %lu sent, %lu cut off by the transmitter enable\n",
+    bytesReceived, bytesSent, bytesDropped);
+  printf("  command headers:    %lu (%.1f/second)\n", commandHeaders, seconds > 0 ? commandHeaders / seconds : 0.0);
+  printf("  responses:          %lu no data, %lu with data, %lu resend requests\n",
+    responsesNoData, responsesWithData, responsesResend);
+  printf("  receive overruns:   %lu\n", simUsartGetOverrunCount());
+  if (turnaroundCount > 0)
+    printf("  slave turnaround:   %.1f us mean, %.1f us max\n",
+      totalTurnaroundTime_InNS / 1000.0 / turnaroundCount, maxTurnaroundTime_InNS / 1000.0);
+
+  for (int vector = 0; vector < SIM_NUMBER_OF_VECTORS; vector++)
+  {
+    statistics = simGetInterruptStatistics(vector);
+    printf("  %-20s %lu calls, worst %.1f us virtual\n", statistics->name, statistics->count,
+      statistics->maxVirtualTime_InNS / 1000.0);
+  }
+  fflush(stdout);
+}
+
+
+
+static void requestStop(int signalNumber)
+{
+  stopRequested = true;
+  signal(signalNumber, SIG_DFL);
+}
+
+
+
+//
+// open the pseudo-terminal in raw mode
+//  Exit:  file descriptor of the master side returned, -1 on error
+//
+static int openPseudoTerminal(const char *linkPath)
+{
+  int fd;
+  int slaveFd;
+  struct termios settings;
+  const char *slaveName;
+
+  fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0))
+    return(-1);
+
+  tcgetattr(fd, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(fd, TCSANOW, &settings);
+
+  slaveName = ptsname(fd);
+
+  //
+  // hold the slave side open so the master side doesn't see a hang up each time the
+  // master program closes its port
+  //
+  slaveFd = open(slaveName, O_RDWR | O_NOCTTY);
+  if (slaveFd >= 0)
+  {
+    tcgetattr(slaveFd, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(slaveFd, TCSANOW, &settings);
+  }
+
+  if (linkPath != NULL)
+  {
+    unlink(linkPath);
+    if (symlink(slaveName, linkPath) != 0)
+    {
+      perror(linkPath);
+      return(-1);
+    }
+  }
+
+  printf("virtualSlave on %s%s%s\n", slaveName, linkPath ? " -> " : "", linkPath ? linkPath : "");
+  fflush(stdout);
+  return(fd);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  long baudRate = 115200;
+  int slaveAddress = 17;
+  const char *linkPath = NULL;
+  long statisticsPeriod = 0;
+  unsigned long long nextStatisticsTime_InNS;
+  unsigned long long loopStartTime_InNS;
+  int option;
+
+
+  while((option = getopt(argc, argv, "b:a:l:s:v")) != -1)
+  {
+    switch(option)
+    {
+      case 'b': baudRate = atol(optarg); break;
+      case 'a': slaveAddress = atoi(optarg); break;
+      case 'l': linkPath = optarg; break;
+      case 's': statisticsPeriod = atol(optarg); break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-b baudRate] [-a slaveAddress] [-l linkPath] [-s seconds] [-v]\n", argv[0]);
+        return(1);
+    }
+  }
+
+  ptyFd = openPseudoTerminal(linkPath);
+  if (ptyFd < 0)
+  {
+    perror("pseudo-terminal");
+    return(1);
+  }
+  fcntl(ptyFd, F_SETFL, fcntl(ptyFd, F_GETFL) | O_NONBLOCK);
+
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+
+  //
+  // power up the board, then run the sketch in step with the wall clock
+  //
+  simReset();
+  setup();
+  serialSlave.open(baudRate, slaveAddress, TRANSMITTER_ENABLE_PIN);
+  simUsartSetDriverEnablePin(TRANSMITTER_ENABLE_PIN);
+  simUsartSetTransmitHook(sendByteToMaster);
+  simClearInterruptStatistics();
+
+  wallClockStart_InNS = wallClockInNS() - simGetTimeInNS();
+  simSetWaitHook(waitForWallClock);
+
+  nextStatisticsTime_InNS = statisticsPeriod * 1000000000ULL;
+  while(!stopRequested)
+  {
+    loopStartTime_InNS = simGetTimeInNS();
+    loop();
+
+    //
+    // a loop() that takes no virtual time would keep the clock from ever moving
+    //
+    if (simGetTimeInNS() == loopStartTime_InNS)
+      simAdvanceTimeInNS(LOOP_MINIMUM_PERIOD_InNS);
+
+    if ((statisticsPeriod > 0) && (simGetTimeInNS() >= nextStatisticsTime_InNS))
+    {
+      printStatistics();
+      nextStatisticsTime_InNS += statisticsPeriod * 1000000000ULL;
+    }
+  }
+
+  printStatistics();
+  if (linkPath != NULL)
+    unlink(linkPath);
+  return(0);
+}
+
+// -------------------------------------- End --------------------------------------
@@ -0,0 +1,24 @@
+//      ******************************************************************
+//      *                                                                *
+//      *        Host replacement for the Arduino wiring_private.h       *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+
+#ifndef wiring_private_h
+#define wiring_private_h
+
+#include "Arduino.h"
+
+#ifndef cbi
+#define cbi(sfr, bit) ((sfr) &= ~(1 << (bit)))
+#endif
+
+#ifndef sbi
+#define sbi(sfr, bit) ((sfr) |= (1 << (bit)))
+#endif
+
+// ------------------------------------ End ---------------------------------
+#endif
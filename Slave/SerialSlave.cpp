@@ -19,6 +19,11 @@
 //
 const byte MASTER_COMMAND_HEADER_BYTE_1 = 0xAA;
 const byte MASTER_COMMAND_HEADER_BYTE_2 = 0x55;
+const byte MASTER_COMMAND_HEADER_BYTE_2_CRC = 0x5A;
+const byte MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED = 0x56;
+const byte MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED = 0x5B;
+const byte MASTER_COMMAND_BROADCAST_ADDRESS = 0;
+const byte MASTER_COMMAND_BATCH = 0xFF;
 const unsigned long MASTER_COMMAND_TIMEOUT_PERIOD_MS = 100;
 const byte MASTER_COMMAND_MAX_PACKET_BYTES = MASTER_COMMAND_MAX_DATA_BYTES + 4;
 
@@ -29,7 +34,7 @@ const byte MASTER_COMMAND_MAX_PACKET_BYTES = MASTER_COMMAND_MAX_DATA_BYTES + 4;
 const byte SLAVE_RESPONSE_RECEIVED_COMMAND = 0xA9;
 const byte SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA =0xAC;
 const byte SLAVE_RESPONSE_RESEND_COMMAND =0xB8;
-const byte SLAVE_RESPONSE_MAX_PACKET_BYTES = SLAVE_RESPONSE_MAX_DATA_BYTES + 4;
+const byte SLAVE_RESPONSE_MAX_PACKET_BYTES = SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES + 7;  // with a sequence, a CRC and the extra byte sent
 
 
 //
@@ -42,6 +47,155 @@ const byte SLAVE_STATE_WAITING_FOR_COMMAND_BYTE = 3;
 const byte SLAVE_STATE_WAITING_FOR_DATA_LENGTH_BYTE = 4;
 const byte SLAVE_STATE_WAITING_FOR_DATA_BYTES = 5;
 const byte SLAVE_STATE_WAITING_FOR_CHECKSUM_BYTE = 6;
+const byte SLAVE_STATE_WAITING_FOR_CRC_LOW_BYTE = 7;
+const byte SLAVE_STATE_WAITING_FOR_CRC_HIGH_BYTE = 8;
+const byte SLAVE_STATE_WAITING_FOR_SEQUENCE_BYTE = 9;
+
+
+//
+// A packet is checked either with the original 8 bit sum of its bytes, or with a
+// CRC-16 when the master sends MASTER_COMMAND_HEADER_BYTE_2_CRC as the second header
+// byte.  The CRC catches the swapped bytes and most of the bursts that the sum misses.
+// The master picks per slave which one to use, and the slave answers in the same way
+// as the command it got, so old masters and old slaves still work together.
+//
+// The CRC is CRC-16/MODBUS (polynomial 0xA001 reflected, starting from 0xFFFF), sent
+// low byte first after the data.  Run over a packet with its CRC on the end, the CRC
+// comes out 0.  It is worked out a byte at a time from a table kept in flash, which
+// takes about 20 clock cycles a byte on the AVR.
+//
+const uint16_t CRC16_INITIAL_VALUE = 0xFFFF;
+const byte CRC16_BYTE_CYCLES = 20;
+
+static const uint16_t crc16Table[256] PROGMEM = {
+  0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+  0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+  0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+  0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+  0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+  0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+  0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+  0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+  0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+  0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+  0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+  0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+  0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+  0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+  0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+  0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+  0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+  0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+  0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+  0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+  0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+  0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+  0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+  0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+  0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+  0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+  0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+  0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+  0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+  0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+  0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+  0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+
+//
+// When a response is lost the master sends the command again, and without more to go on
+// the slave would run it a second time: a relative move twice is a wrong position.  A
+// master can instead send MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED (or the CRC version) as
+// the second header byte and put a sequence number after the address, counting up by
+// one for each new command and keeping the number when it sends one again.
+//
+// The slave remembers the sequences of the last SEQUENCE_WINDOW_SIZE commands it took.  A
+// command that comes again with one of those sequences isn't run, if its response has
+// gone out the slave sends the saved copy again, if it is still waiting to go out the
+// slave says nothing and sends it once it can.  The response to a sequenced
+// command has the sequence after its two response code bytes (and in its checksum or CRC
+// when it has data), so that the master can tell a late answer to an earlier try from
+// the one it is waiting for.
+//
+// With sequences the master doesn't have to wait for each response before sending the
+// next command, it can send up to SEQUENCE_WINDOW_SIZE of them back to back and then read
+// their responses, which come in the same order.  A sequenced command runs as soon as it
+// is in, but the bus is half duplex, so the slave holds its response until the line is
+// quiet: no packet is coming in, and none has ended nor has the last response for
+// LINE_QUIET_BYTE_TIMES.  The gap after a response also lets the extra byte sent at its
+// end (see sentResponsePacketToMaster()) go out with the transmitter off.  For the same
+// reason a sequenced packet that fails its check is dropped rather than answered with a
+// resend request, the master sends it again when its response doesn't come.  The queue
+// holds two windows, so a window always fits behind the commands whose responses are
+// still held.
+//
+
+
+//
+// A packet sent to MASTER_COMMAND_BROADCAST_ADDRESS is run by every slave, and one sent
+// to a group address by every slave that has joined that group, with joinGroup() or the
+// join_group callable.  A group address is any address that no slave has.  None of the
+// slaves answer these packets, they would all talk at once, so the master can't tell
+// whether they got through.  They are for starting several boards together: each slave
+// runs the command as soon as loop() gets to it, rather than a round trip apart.  A
+// sequence on them is ignored.
+//
+
+
+//
+// A packet with the command MASTER_COMMAND_BATCH carries several commands, so that the
+// master can set up a stepper with one round trip rather than one for each setting.  Its
+// data is a record for each command: the command number, the number of data bytes and
+// the data, up to MASTER_BATCH_MAX_DATA_BYTES in all.  The slave runs them in order and
+// answers once, with data holding a record for each command it ran: a BATCH_RECORD_
+// status, the number of bytes the command returned and those bytes.  A record that runs
+// past the end of the packet stops the batch, as does a response with no room for
+// another record, the master finds the commands that didn't run missing from the end.
+// The batch is checked, sequenced and addressed like any other packet.
+//
+const byte BATCH_RECORD_RAN = 0;
+const byte BATCH_RECORD_NO_SUCH_COMMAND = 1;
+const byte BATCH_RECORD_DATA_DROPPED = 2;      // ran, but its data didn't fit in the response
+
+
+//
+// command packets received by the ISR wait in this queue until service() runs them from
+// loop(), and stay in it until their responses have gone out.  commandQueueRun is the
+// next one to run, it is ahead of commandQueueTail while responses are held.  The ISR
+// only writes commandQueueHead and service() only writes commandQueueRun and
+// commandQueueTail, so neither side needs to disable interrupts.  The indexes count
+// freely and are masked, so the sizes must be powers of 2.  A replay packet is a
+// sequenced command sent again after its response went out, service() sends the saved
+// response.
+//
+const byte SEQUENCE_WINDOW_SIZE = 4;
+const byte COMMAND_QUEUE_SIZE = 2 * SEQUENCE_WINDOW_SIZE;
+const byte LINE_QUIET_BYTE_TIMES = 2;
+
+typedef struct commandPacket {
+  bool respond;
+  bool checkedWithCRC;
+  bool sequenced;
+  bool replay;
+  byte sequence;
+  byte command;
+  byte dataLength;
+  byte dataArray[MASTER_BATCH_MAX_DATA_BYTES];
+} CommandPacket;
+
+
+//
+// the responses to the last sequenced commands, found by the low bits of their sequence
+//
+typedef struct savedResponse {
+  bool valid;
+  bool responseReady;
+  bool responseSent;
+  byte sequence;
+  byte length;
+  byte bytes[SLAVE_RESPONSE_MAX_PACKET_BYTES];
+} SavedResponse;
 
 
 //
@@ -55,10 +209,23 @@ const int RS485_TRANSMIT_DISABLED = LOW;
 // variables global to this module
 //
 byte thisSlavesAddress;
+byte groupAddresses[SLAVE_MAX_GROUPS];
+bool respondToMaster;
 byte slaveState;
 unsigned long startTimeForPacketFromHost;
 byte slaveAddress;
 byte checksum;
+uint16_t crc;
+byte frameCheckState;
+bool respondWithCRC;
+bool sequencedFrame;
+byte sequenceFromMaster;
+bool respondWithSequence;
+byte responseSequence;
+SavedResponse savedResponses[SEQUENCE_WINDOW_SIZE];
+volatile unsigned long sequencedPacketEndTime_InUS;
+volatile unsigned long responseEndTime_InUS;
+unsigned long lineQuietPeriod_InUS;
 byte dataArrayFromMasterIdx;
 byte dataLengthToMaster;
 byte dataArrayToMaster[SLAVE_RESPONSE_MAX_PACKET_BYTES];
@@ -66,7 +233,11 @@ byte dataArrayToMasterIdx;
 byte transmitEnablePin;
 byte commandByteFromMaster;
 byte dataLengthFromMaster;
-byte dataArrayFromMaster[MASTER_COMMAND_MAX_DATA_BYTES];
+byte dataArrayFromMaster[MASTER_BATCH_MAX_DATA_BYTES];
+CommandPacket commandQueue[COMMAND_QUEUE_SIZE];
+volatile byte commandQueueHead;
+volatile byte commandQueueTail;
+byte commandQueueRun;
 
 
 //
@@ -74,6 +245,17 @@ byte dataArrayFromMaster[MASTER_COMMAND_MAX_DATA_BYTES];
 //
 //void sendResendCommandToMaster();
 //void sentResponsePacketToMaster();
+static inline void addToFrameCheck(byte c);
+static inline uint16_t updateCRC16(uint16_t crc, byte c);
+static void queueCommandPacket(bool checkedWithCRC);
+static void saveResponseForReplay(void);
+static void runCommandPacket(CommandPacket *packet);
+static void frameCheckFailed(void);
+static bool lineQuiet(void);
+static bool isGroupMember(byte address);
+static bool runCallable(byte command, byte dataLength, byte dataArray[]);
+static void processBatchFromMaster(byte dataLength, byte dataArray[]);
+static void sendResponse(bool withData, byte dataLength, byte data[]);
 
 
 //
@@ -110,6 +292,8 @@ void SerialSlave::open(long baudRate, byte slaveAddr, byte transmitterEnablePin)
   // remember the address this slave should respond too
   //
   thisSlavesAddress = slaveAddr;
+  for (byte i = 0; i < SLAVE_MAX_GROUPS; i++)
+    groupAddresses[i] = MASTER_COMMAND_BROADCAST_ADDRESS;
   
   //
   // configure but disable transmit
@@ -147,12 +331,141 @@ void SerialSlave::open(long baudRate, byte slaveAddr, byte transmitterEnablePin)
   //
   slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
   startTimeForPacketFromHost = millis();
+  commandQueueHead = 0;
+  commandQueueTail = 0;
+  commandQueueRun = 0;
+  respondWithCRC = false;
+  respondWithSequence = false;
+  respondToMaster = true;
+  for (byte i = 0; i < SEQUENCE_WINDOW_SIZE; i++)
+    savedResponses[i].valid = false;
+  lineQuietPeriod_InUS = LINE_QUIET_BYTE_TIMES * 10 * 1000000L / baudRate;
+}
+
+
+
+//
+// run the commands received from the master and send their responses, call this
+// from loop() as often as possible.  The callables run here rather than in the
+// receive ISR, so they can take as long as they need without blocking interrupts.
+// Nothing runs while a response is still going out.  A sequenced command, or one that
+// isn't answered, runs as soon as it is in, the response to a sequenced one is saved
+// and goes out once the master has stopped sending.  Any other command waits until
+// the responses before it have gone out, then runs and answers at once.
+//
+void SerialSlave::service(void)
+{
+  CommandPacket *packet;
+
+  while(commandQueueTail != commandQueueHead)
+  {
+    if (UCSR2B & (1 << UDRIE2))
+      return;
+
+    //
+    // run the next command if it can run now
+    //
+    if (commandQueueRun != commandQueueHead)
+    {
+      packet = &commandQueue[commandQueueRun & (COMMAND_QUEUE_SIZE - 1)];
+      if (packet->sequenced || !packet->respond || (commandQueueRun == commandQueueTail))
+      {
+        if (!packet->replay)
+          runCommandPacket(packet);
+        commandQueueRun++;
+        continue;
+      }
+    }
+
+    //
+    // send the held response of the oldest command that has run
+    //
+    packet = &commandQueue[commandQueueTail & (COMMAND_QUEUE_SIZE - 1)];
+    if (packet->sequenced)
+    {
+      if (!lineQuiet())
+        return;
+      replayResponse(packet->sequence);
+    }
+    commandQueueTail++;
+  }
+}
+
+
+
+//
+// run a command from the queue, its response goes out now unless it is sequenced,
+// then it is only saved
+//    Enter:  packet -> the command
+//
+static void runCommandPacket(CommandPacket *packet)
+{
+  respondToMaster = packet->respond;
+  respondWithCRC = packet->checkedWithCRC;
+  respondWithSequence = packet->sequenced;
+  responseSequence = packet->sequence;
+  processCommandFromMaster(packet->command, packet->dataLength, packet->dataArray);
 }
 
 
 
 //
-// send response to master indicating the command was received and no data is being sent
+// run the commands sent to a group address as well as those sent to this slave
+//    Enter:  groupAddress = address of the group, not this slave's own address or 0
+//    Exit:   true returned if joined or already a member, false if SLAVE_MAX_GROUPS
+//            groups have been joined already
+//
+bool SerialSlave::joinGroup(byte groupAddress)
+{
+  byte oldSREG = SREG;
+
+  if ((groupAddress == MASTER_COMMAND_BROADCAST_ADDRESS) || (groupAddress == thisSlavesAddress))
+    return(false);
+  if (isGroupMember(groupAddress))
+    return(true);
+
+  for (byte i = 0; i < SLAVE_MAX_GROUPS; i++)
+  {
+    if (groupAddresses[i] == MASTER_COMMAND_BROADCAST_ADDRESS)
+    {
+      cli();
+      groupAddresses[i] = groupAddress;
+      SREG = oldSREG;
+      return(true);
+    }
+  }
+  return(false);
+}
+
+
+
+//
+// stop running the commands sent to a group address
+//    Enter:  groupAddress = address of the group
+//
+void SerialSlave::leaveGroup(byte groupAddress)
+{
+  byte oldSREG = SREG;
+
+  if (groupAddress == MASTER_COMMAND_BROADCAST_ADDRESS)
+    return;
+
+  for (byte i = 0; i < SLAVE_MAX_GROUPS; i++)
+  {
+    if (groupAddresses[i] == groupAddress)
+    {
+      cli();
+      groupAddresses[i] = MASTER_COMMAND_BROADCAST_ADDRESS;
+      SREG = oldSREG;
+    }
+  }
+}
+
+
+
+//
+// send response to master indicating the command was received and no data is being sent,
+// the response to a sequenced command is only saved, service() sends it
 //
 void SerialSlave::respondToCommandSendingNoData()
 {
@@ -162,13 +475,22 @@ void SerialSlave::respondToCommandSendingNoData()
   dataArrayToMaster[0] = SLAVE_RESPONSE_RECEIVED_COMMAND;
   dataArrayToMaster[1] = SLAVE_RESPONSE_RECEIVED_COMMAND;
   dataLengthToMaster = 2;
+  if (respondWithSequence)
+  {
+    dataArrayToMaster[2] = responseSequence;
+    dataLengthToMaster = 3;
+    saveResponseForReplay();
+    return;
+  }
   sentResponsePacketToMaster();
 }
 
 
 
 //
-// send response with additional data to master indicating the command was received
+// send response with additional data to master indicating the command was received,
+// checked with a CRC and carrying the sequence if the command was.  The response to a
+// sequenced command is only saved, service() sends it.
 //    Enter:  dataLength = number of data bytes to transmit to the master
 //            data -> array of bytes to send
 //
@@ -177,6 +499,7 @@ void SerialSlave::respondToCommandSendingWithData(byte dataLength, byte data[])
   int dataArrayToMasterIdx;
   int i;
   byte checksum;
+  uint16_t crc;
   byte c;
   
   //
@@ -187,23 +510,54 @@ void SerialSlave::respondToCommandSendingWithData(byte dataLength, byte data[])
   dataArrayToMasterIdx++;
   dataArrayToMaster[dataArrayToMasterIdx] = SLAVE_RESPONSE_RECEIVED_COMMAND_SENDING_DATA;
   dataArrayToMasterIdx++;
+  checksum = 0;
+  crc = CRC16_INITIAL_VALUE;
+
+  if (respondWithSequence)
+  {
+    dataArrayToMaster[dataArrayToMasterIdx] = responseSequence;
+    dataArrayToMasterIdx++;
+    checksum = responseSequence;
+    if (respondWithCRC)
+      crc = updateCRC16(crc, responseSequence);
+  }
   
   dataArrayToMaster[dataArrayToMasterIdx] = dataLength;
   dataArrayToMasterIdx++;
-  checksum = dataLength;
+  checksum += dataLength;
+  if (respondWithCRC)
+    crc = updateCRC16(crc, dataLength);
   
   for (i = 0; i < dataLength; i++)
   {
     c = data[i];
     dataArrayToMaster[dataArrayToMasterIdx] = c;
     dataArrayToMasterIdx++;
-    checksum += c;
+    if (respondWithCRC)
+      crc = updateCRC16(crc, c);
+    else
+      checksum += c;
   }
   
-  dataArrayToMaster[dataArrayToMasterIdx] = checksum;
-  dataArrayToMasterIdx++;
+  if (respondWithCRC)
+  {
+    dataArrayToMaster[dataArrayToMasterIdx] = crc & 0xff;
+    dataArrayToMasterIdx++;
+    dataArrayToMaster[dataArrayToMasterIdx] = crc >> 8;
+    dataArrayToMasterIdx++;
+  }
+  else
+  {
+    dataArrayToMaster[dataArrayToMasterIdx] = checksum;
+    dataArrayToMasterIdx++;
+  }
   
   dataLengthToMaster = dataArrayToMasterIdx;
+  if (respondWithSequence)
+  {
+    saveResponseForReplay();
+    return;
+  }
   
   //
   // send the packet to the master
@@ -266,8 +620,19 @@ ISR(USART2_RX_vect)
     //
     case SLAVE_STATE_WAITING_FOR_HEADER_BYTE_2:
     {
-      if (c == MASTER_COMMAND_HEADER_BYTE_2)
+      sequencedFrame = (c == MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED) || 
+        (c == MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED);
+
+      if ((c == MASTER_COMMAND_HEADER_BYTE_2) || (c == MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED))
+      {
+        frameCheckState = SLAVE_STATE_WAITING_FOR_CHECKSUM_BYTE;
+        slaveState = SLAVE_STATE_WAITING_FOR_SLAVE_ADDRESS;
+      }
+      else if ((c == MASTER_COMMAND_HEADER_BYTE_2_CRC) || (c == MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED))
+      {
+        frameCheckState = SLAVE_STATE_WAITING_FOR_CRC_LOW_BYTE;
         slaveState = SLAVE_STATE_WAITING_FOR_SLAVE_ADDRESS;
+      }
       else
         slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
       break;
@@ -278,14 +643,25 @@ ISR(USART2_RX_vect)
     //
     case SLAVE_STATE_WAITING_FOR_SLAVE_ADDRESS:
     {
-      if (c != 0)
-      {
-        slaveAddress = c;
-        checksum = c;
-        slaveState = SLAVE_STATE_WAITING_FOR_COMMAND_BYTE;
-      }
+      slaveAddress = c;
+      checksum = 0;
+      crc = CRC16_INITIAL_VALUE;
+      addToFrameCheck(c);
+      if (sequencedFrame)
+        slaveState = SLAVE_STATE_WAITING_FOR_SEQUENCE_BYTE;
       else
-        slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
+        slaveState = SLAVE_STATE_WAITING_FOR_COMMAND_BYTE;
+      break;
+    }
+
+    //
+    // check if waiting for the sequence number of a sequenced packet
+    //
+    case SLAVE_STATE_WAITING_FOR_SEQUENCE_BYTE:
+    {
+      sequenceFromMaster = c;
+      addToFrameCheck(c);
+      slaveState = SLAVE_STATE_WAITING_FOR_COMMAND_BYTE;
       break;
     }
 
@@ -295,7 +671,7 @@ ISR(USART2_RX_vect)
     case SLAVE_STATE_WAITING_FOR_COMMAND_BYTE:
     {
       commandByteFromMaster = c;
-      checksum += c;
+      addToFrameCheck(c);
       slaveState = SLAVE_STATE_WAITING_FOR_DATA_LENGTH_BYTE;
       break;
     }
@@ -306,13 +682,14 @@ ISR(USART2_RX_vect)
     case SLAVE_STATE_WAITING_FOR_DATA_LENGTH_BYTE:
     {
       dataLengthFromMaster = c;
-      checksum += c;
+      addToFrameCheck(c);
       dataArrayFromMasterIdx = 0;
 
       if (dataLengthFromMaster == 0) {
-        slaveState = SLAVE_STATE_WAITING_FOR_CHECKSUM_BYTE;
+        slaveState = frameCheckState;
       }
-      else if (dataLengthFromMaster <= MASTER_COMMAND_MAX_DATA_BYTES)
+      else if ((dataLengthFromMaster <= MASTER_COMMAND_MAX_DATA_BYTES) ||
+        ((commandByteFromMaster == MASTER_COMMAND_BATCH) && (dataLengthFromMaster <= MASTER_BATCH_MAX_DATA_BYTES)))
         slaveState = SLAVE_STATE_WAITING_FOR_DATA_BYTES;
       else
         slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
@@ -326,9 +703,9 @@ ISR(USART2_RX_vect)
     {
       dataArrayFromMaster[dataArrayFromMasterIdx] = c;
       dataArrayFromMasterIdx++;
-      checksum += c;
+      addToFrameCheck(c);
       if (dataArrayFromMasterIdx == dataLengthFromMaster)
-        slaveState = SLAVE_STATE_WAITING_FOR_CHECKSUM_BYTE;
+        slaveState = frameCheckState;
       break;
     }
 
@@ -338,32 +715,214 @@ ISR(USART2_RX_vect)
     case SLAVE_STATE_WAITING_FOR_CHECKSUM_BYTE:
     {
       if (c == checksum)
-      {
-        //
-        // verify this packet is for this slave
-        //
-        if (slaveAddress == thisSlavesAddress)
-        {
-          //
-          // execute the command received from the host if
-          //
-          processCommandFromMaster(commandByteFromMaster, dataLengthFromMaster, dataArrayFromMaster);
-        }
-        
-        slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1; 
-      }
+        queueCommandPacket(false);
       
       else
       {
         //
         // checksum error, request that the command be resent
         //
-        serialSlave.sendResendCommandToMaster();
-        slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
+        frameCheckFailed();
       }
+      slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
+      break;
+    }
+
+    //
+    // check if waiting for the CRC, the CRC of the packet with its CRC on the end is 0
+    //
+    case SLAVE_STATE_WAITING_FOR_CRC_LOW_BYTE:
+    {
+      addToFrameCheck(c);
+      slaveState = SLAVE_STATE_WAITING_FOR_CRC_HIGH_BYTE;
       break;
     }
+
+    case SLAVE_STATE_WAITING_FOR_CRC_HIGH_BYTE:
+    {
+      addToFrameCheck(c);
+      if (crc == 0)
+        queueCommandPacket(true);
+      else
+        frameCheckFailed();
+      slaveState = SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1;
+      break;
+    }
+  }
+}
+
+
+
+//
+// add a received byte to the checksum or CRC of the packet, whichever it is checked with
+//
+static inline void addToFrameCheck(byte c)
+{
+  if (frameCheckState == SLAVE_STATE_WAITING_FOR_CRC_LOW_BYTE)
+    crc = updateCRC16(crc, c);
+  else
+    checksum += c;
+}
+
+
+
+//
+// add a byte to a CRC-16
+//    Enter:  crc = the CRC of the bytes before this one
+//            c = the byte to add
+//    Exit:   the new CRC returned
+//
+static inline uint16_t updateCRC16(uint16_t crc, byte c)
+{
+  AVR_CYCLES(CRC16_BYTE_CYCLES);
+  return((crc >> 8) ^ pgm_read_word(&crc16Table[(crc ^ c) & 0xff]));
+}
+
+
+
+//
+// a packet checked out, if it is for this slave queue it for service() to execute.  If
+// the queue is full ask the master to send it again.  A sequenced packet that is the
+// master trying one again isn't run twice, it is queued to get the saved response if
+// that has gone out already.  A sequenced packet whose place in the window still holds
+// a response that hasn't gone out has overflowed the window, it is dropped like one
+// that finds the queue full, rather than losing that response.
+// A packet for the broadcast address or one of this slave's groups is queued to run
+// without a response.
+//    Enter:  checkedWithCRC = true if the packet came with a CRC, the response gets one
+//
+static void queueCommandPacket(bool checkedWithCRC)
+{
+  CommandPacket *packet;
+  SavedResponse *saved = NULL;
+  bool replay = false;
+  bool respond = true;
+
+  if (slaveAddress != thisSlavesAddress)
+  {
+    if ((slaveAddress != MASTER_COMMAND_BROADCAST_ADDRESS) && !isGroupMember(slaveAddress))
+      return;
+    respond = false;
+    sequencedFrame = false;
+  }
+
+  if (sequencedFrame)
+  {
+    sequencedPacketEndTime_InUS = micros();
+    saved = &savedResponses[sequenceFromMaster & (SEQUENCE_WINDOW_SIZE - 1)];
+    if (saved->valid && !saved->responseSent)
+      return;
+    if (saved->valid && (saved->sequence == sequenceFromMaster))
+      replay = true;
+  }
+
+  if ((byte) (commandQueueHead - commandQueueTail) < COMMAND_QUEUE_SIZE)
+  {
+    if (sequencedFrame && !replay)
+    {
+      saved->valid = true;
+      saved->sequence = sequenceFromMaster;
+      saved->responseReady = false;
+      saved->responseSent = false;
+    }
+
+    packet = &commandQueue[commandQueueHead & (COMMAND_QUEUE_SIZE - 1)];
+    packet->respond = respond;
+    packet->checkedWithCRC = checkedWithCRC;
+    packet->sequenced = sequencedFrame;
+    packet->replay = replay;
+    packet->sequence = sequenceFromMaster;
+    packet->command = commandByteFromMaster;
+    packet->dataLength = dataLengthFromMaster;
+    memcpy(packet->dataArray, dataArrayFromMaster, dataLengthFromMaster);
+    commandQueueHead++;
+  }
+  else if (respond && !sequencedFrame)
+    serialSlave.sendResendCommandToMaster();
+}
+
+
+
+//
+// a packet failed its checksum or CRC, ask the master to send it again if it was for
+// this slave's own address and the master isn't sending more packets behind it.  A
+// packet for any other address is left alone, every slave on the bus sees it and they
+// would all answer at once.
+//
+static void frameCheckFailed(void)
+{
+  if (!sequencedFrame && (slaveAddress == thisSlavesAddress))
+    serialSlave.sendResendCommandToMaster();
+}
+
+
+
+//
+// check if this slave has joined a group
+//    Enter:  address = group address
+//    Exit:   true returned if it has
+//
+static bool isGroupMember(byte address)
+{
+  for (byte i = 0; i < SLAVE_MAX_GROUPS; i++)
+  {
+    if (groupAddresses[i] == address)
+      return(true);
   }
+  return(false);
+}
+
+
+
+//
+// check if the master has stopped sending, so that a response won't run into its packets
+//    Exit:   true returned if no packet is coming in and neither a packet nor a response
+//            ended in the quiet period, a packet that was cut off and has timed out
+//            doesn't count
+//
+static bool lineQuiet(void)
+{
+  unsigned long packetStartTime_InMS;
+  unsigned long packetEndTime_InUS;
+  unsigned long lastResponseEndTime_InUS;
+  unsigned long now_InUS;
+  byte oldSREG = SREG;
+
+  cli();
+  packetStartTime_InMS = startTimeForPacketFromHost;
+  packetEndTime_InUS = sequencedPacketEndTime_InUS;
+  lastResponseEndTime_InUS = responseEndTime_InUS;
+  SREG = oldSREG;
+
+  if ((slaveState != SLAVE_STATE_WAITING_FOR_HEADER_BYTE_1) && 
+    (millis() - packetStartTime_InMS < MASTER_COMMAND_TIMEOUT_PERIOD_MS))
+    return(false);
+
+  now_InUS = micros();
+  return(((now_InUS - packetEndTime_InUS) >= lineQuietPeriod_InUS) &&
+    ((now_InUS - lastResponseEndTime_InUS) >= lineQuietPeriod_InUS));
+}
+
+
+
+//
+// keep a copy of the response to a sequenced command, for when the master sends it again.
+// The ISR doesn't give the place in the window to a newer command until the response
+// has gone out, a response that doesn't match its place isn't kept.  Called with the
+// interrupts off.
+//    Enter:  dataArrayToMaster and dataLengthToMaster hold the response
+//
+static void saveResponseForReplay(void)
+{
+  SavedResponse *saved;
+
+  saved = &savedResponses[responseSequence & (SEQUENCE_WINDOW_SIZE - 1)];
+  if (!saved->valid || (saved->sequence != responseSequence))
+    return;
+
+  memcpy(saved->bytes, dataArrayToMaster, dataLengthToMaster);
+  saved->length = dataLengthToMaster;
+  saved->responseReady = true;
 }
 
 
@@ -387,6 +946,30 @@ void SerialSlave::sendResendCommandToMaster(void)
 
 
 
+//
+// send the saved response to a sequenced command, the first time once the command has
+// run and again each time the master asks, without running the command again
+//    Enter:  sequence = sequence of the command
+//
+void SerialSlave::replayResponse(byte sequence)
+{
+  SavedResponse *saved;
+  byte oldSREG = SREG;
+
+  saved = &savedResponses[sequence & (SEQUENCE_WINDOW_SIZE - 1)];
+  if (!saved->responseReady || (saved->sequence != sequence))
+    return;
+
+  cli();
+  memcpy(dataArrayToMaster, saved->bytes, saved->length);
+  dataLengthToMaster = saved->length;
+  saved->responseSent = true;
+  sentResponsePacketToMaster();
+  SREG = oldSREG;
+}
+
+
+
 //
 // begin sending the response packet to the master
 //    Enter:  dataLengthToMaster = number of data bytes
@@ -440,6 +1023,7 @@ ISR(USART2_UDRE_vect)
     //
     cbi(UCSR2B, UDRIE2);
     digitalWrite(transmitEnablePin, RS485_TRANSMIT_DISABLED);
+    responseEndTime_InUS = micros();
     return;
   }
   
@@ -459,6 +1043,8 @@ Callable internalCallables[] = {
   {"digital_read", _digitalRead},
   {"analog_read", _analogRead},
   {"analog_write", _analogWrite},
+  {"join_group", _joinGroup},
+  {"leave_group", _leaveGroup},
 };
 
 
@@ -479,8 +1065,10 @@ void getNthCallable(byte dataLength, byte *dataArray) {
   byte nth = dataArray[0];
   if(nth < numberOfInternalCallables) {
     returns(internalCallables[nth].shortName);
-  } else {
+  } else if(nth < numberOfInternalCallables + numberOfExternalCallables) {
     returns(callables[nth - numberOfInternalCallables].shortName);
+  } else {
+    returns("");
   }
 }
 
@@ -501,6 +1089,12 @@ void _digitalRead(byte dataLength, byte *dataArray) {
 void _analogWrite(byte dataLength, byte *dataArray) {
   analogWrite(dataArray[0], dataArray[1]*256 + dataArray[2]);
 }
+void _joinGroup(byte dataLength, byte *dataArray) {
+  returns((byte) serialSlave.joinGroup(dataArray[0]));
+}
+void _leaveGroup(byte dataLength, byte *dataArray) {
+  serialSlave.leaveGroup(dataArray[0]);
+}
 void _analogRead(byte dataLength, byte *dataArray) {
   int value = digitalRead(dataArray[0]);
   byte arr[2] = {value%256, value};
@@ -517,7 +1111,8 @@ byte lengthOf(const char* string) {
 }
 
 void returns(const char* string) {
-  returnLength = lengthOf(string);
+  // longer strings are cut off at the end of returnData
+  returnLength = min(lengthOf(string), sizeof(returnData));
   for(byte i = 0; i < returnLength; i++) {
     returnData[i] = string[i];
   }
@@ -525,7 +1120,7 @@ void returns(const char* string) {
 }
 
 void returns(byte dataLength, byte *dataArray) {
-  returnLength = dataLength;
+  returnLength = min(dataLength, sizeof(returnData));
   for(byte i = 0; i < returnLength; i++) {
     returnData[i] = dataArray[i];
   }
@@ -543,24 +1138,109 @@ void processCommandFromMaster(byte commandByteFromMaster,
                               byte dataArrayFromMaster[]){
   //by default we want no data returned
   returnWithData = false;
+  if(commandByteFromMaster == MASTER_COMMAND_BATCH) {
+    processBatchFromMaster(dataLengthFromMaster, dataArrayFromMaster);
+    return;
+  }
+
+  //
+  // no such command is acknowledged without running anything
+  //
+  runCallable(commandByteFromMaster, dataLengthFromMaster, dataArrayFromMaster);
+  respondAccordingly();  
+}
+
+//
+// run a callable, rather than calling through whatever follows the callable table when
+// there is no such command
+//    Exit:   false returned if there is no such command
+//
+static bool runCallable(byte command, byte dataLength, byte dataArray[]) {
   Callable c;
-  if(commandByteFromMaster < numberOfInternalCallables) {
-    c = internalCallables[commandByteFromMaster];
+  if(command < numberOfInternalCallables) {
+    c = internalCallables[command];
+  } else if(command < numberOfInternalCallables + numberOfExternalCallables) {
+    c = callables[command - numberOfInternalCallables];
   } else {
-    c = callables[commandByteFromMaster - numberOfInternalCallables];
+    return false;
   }
-  c.call(dataLengthFromMaster, dataArrayFromMaster);
-  
-  respondAccordingly();  
+  c.call(dataLength, dataArray);
+  return true;
+}
+
+//
+// run the commands in a batch packet in order and send one response with the result of
+// each, see MASTER_COMMAND_BATCH for the records
+//
+static void processBatchFromMaster(byte dataLength, byte dataArray[]) {
+  byte response[SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES];
+  byte responseLength = 0;
+  byte idx = 0;
+  byte recordLength;
+  byte status;
+  byte l;
+
+  while((idx + 2 <= dataLength) && (responseLength + 2 <= SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES)) {
+    recordLength = dataArray[idx + 1];
+    if((recordLength > MASTER_COMMAND_MAX_DATA_BYTES) || (idx + 2 + recordLength > dataLength))
+      break;
+
+    returnWithData = false;
+    if(runCallable(dataArray[idx], recordLength, &dataArray[idx + 2]))
+      status = BATCH_RECORD_RAN;
+    else
+      status = BATCH_RECORD_NO_SUCH_COMMAND;
+    idx += 2 + recordLength;
+
+    l = returnWithData ? min(SLAVE_RESPONSE_MAX_DATA_BYTES, returnLength) : 0;
+    if(responseLength + 2 + l > SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES) {
+      status = BATCH_RECORD_DATA_DROPPED;
+      l = 0;
+    }
+    response[responseLength++] = status;
+    response[responseLength++] = l;
+    memcpy(&response[responseLength], returnData, l);
+    responseLength += l;
+  }
+
+  sendResponse(true, responseLength, response);
 }
 
 void respondAccordingly() {
   if(returnWithData) {
     byte l = min(SLAVE_RESPONSE_MAX_DATA_BYTES, returnLength);
-    serialSlave.respondToCommandSendingWithData(l, returnData);
+    sendResponse(true, l, returnData);
+  } else {
+    sendResponse(false, 0, NULL);
+  }
+}
+
+//
+// send the response to a command, unless it was sent to the broadcast or a group
+// address, those aren't answered.  Called with the interrupts on.
+//
+static void sendResponse(bool withData, byte dataLength, byte data[]) {
+  if (!respondToMaster)
+    return;
+
+  //
+  // the receive ISR can also start a response (asking for a resend) while the command
+  // runs, it is sent from dataArrayToMaster, so wait for it to go out.  Then keep the
+  // ISR out while this one is built and started.
+  //
+  byte oldSREG = SREG;
+  cli();
+  while(UCSR2B & (1 << UDRIE2)) {
+    SREG = oldSREG;
+    delayMicroseconds(1);
+    cli();
+  }
+  if(withData) {
+    serialSlave.respondToCommandSendingWithData(dataLength, data);
   } else {
     serialSlave.respondToCommandSendingNoData();
   }
+  SREG = oldSREG;
 }
 
 // -------------------------------------- End --------------------------------------
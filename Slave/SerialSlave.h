@@ -13,12 +13,33 @@
 
 #include <Arduino.h>
 
+
+//
+// charges the host simulation's virtual clock for the AVR cycles of the CRC, nothing on
+// the board
+//
+#ifndef AVR_CYCLES
+#define AVR_CYCLES(cycles)
+#endif
+
 //
 // maximum packet sizes
 //
 const byte MASTER_COMMAND_MAX_DATA_BYTES = 16;
 const byte SLAVE_RESPONSE_MAX_DATA_BYTES = 16;
 
+//
+// a batch packet carries several commands and its response their results, so both may
+// be longer
+//
+const byte MASTER_BATCH_MAX_DATA_BYTES = 64;
+const byte SLAVE_BATCH_RESPONSE_MAX_DATA_BYTES = 64;
+
+//
+// number of group addresses a slave can join
+//
+const byte SLAVE_MAX_GROUPS = 4;
+
 //
 // the SerialSlave class
 //
@@ -30,6 +51,9 @@ class SerialSlave
     //
     SerialSlave();
     void open(long baudRate, byte slaveAddr, byte transmitterEnablePin);
+    void service(void);
+    bool joinGroup(byte groupAddress);
+    void leaveGroup(byte groupAddress);
     void respondToCommandSendingNoData();
     void respondToCommandSendingWithData(byte dataLength, byte data[]);
     void sendResendCommandToMaster(void);
@@ -39,6 +63,7 @@ class SerialSlave
     // private functions
     //
     void sentResponsePacketToMaster();
+    void replayResponse(byte sequence);
 };
 
 
@@ -57,6 +82,8 @@ Func _digitalWrite;
 Func _digitalRead;
 Func _analogWrite;
 Func _analogRead;
+Func _joinGroup;
+Func _leaveGroup;
 
 
 extern Callable callables[];
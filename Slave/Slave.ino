@@ -8,24 +8,16 @@
 
 #include "SerialSlave.h"
 #include "SpeedyStepper.h"
+#include "StepperTimer.h"
+#include "StepperBank.h"
+#include "StepperGroup.h"
 #include "SerialDebug.h"
 
 #define ADDRESS 17
 
-SpeedyStepper stepper1;
-SpeedyStepper stepper2;
-SpeedyStepper stepper3;
-SpeedyStepper stepper4;
-SpeedyStepper stepper5;
-SpeedyStepper stepper6;
+StepperGroup lineGroup;
 
 bool LED = false;
-bool running1 = false;
-bool running2 = false;
-bool running3 = false;
-bool running4 = false;
-bool running5 = false;
-bool running6 = false;
 double stepperSetting = .25;
 int speedSetting = 500;
 
@@ -38,25 +30,29 @@ void setup() {
 //  stepper1.setSpeedInStepsPerSecond(500);
 //  stepper1.setAccelerationInStepsPerSecondPerSecond(500);
 
-  stepper2.connectToPort(2);
-  stepper2.setSpeedInStepsPerSecond(500);
-  stepper2.setAccelerationInStepsPerSecondPerSecond(500);
-
-  stepper3.connectToPort(3);
-  stepper3.setSpeedInStepsPerSecond(500);
-  stepper3.setAccelerationInStepsPerSecondPerSecond(500);
-
-  stepper4.connectToPort(4);
-  stepper4.setSpeedInStepsPerSecond(500);
-  stepper4.setAccelerationInStepsPerSecondPerSecond(500);
-
-  stepper5.connectToPort(5);
-  stepper5.setSpeedInStepsPerSecond(500);
-  stepper5.setAccelerationInStepsPerSecondPerSecond(500);
+  //
+  // step the motors from the timer interrupt so that serial traffic and callables
+  // don't disturb the motion, stepper1 stays polled by its homing callables.  The fixed
+  // point ramp about halves the ISR time per step.
+  //
+  for (byte axisNumber = 2; axisNumber <= STEPPER_BANK_AXES; axisNumber++) {
+    SpeedyStepper *stepper = stepperBank.getAxis(axisNumber);
+
+    stepper->connectToPort(axisNumber);
+    stepper->setSpeedInStepsPerSecond(500);
+    stepper->setAccelerationInStepsPerSecondPerSecond(500);
+    stepper->useFixedPointRamp(true);
+    stepperTimer.attach(*stepper);
+  }
 
-  stepper6.connectToPort(6);
-  stepper6.setSpeedInStepsPerSecond(500);
-  stepper6.setAccelerationInStepsPerSecondPerSecond(500);
+  //
+  // straight line moves of several axes at once run from the timer as well
+  //
+  lineGroup.setSpeedInStepsPerSecond(500);
+  lineGroup.setAccelerationInStepsPerSecondPerSecond(500);
+  lineGroup.useFixedPointRamp(true);
+  stepperTimer.attach(lineGroup);
+  stepperTimer.begin();
 
   //LEDs for testing pinmodes
 
@@ -67,42 +63,32 @@ void setup() {
 }
 
 void loop() {
-/*
-  if (stepper1.processMovement() && running1) {
-    stepper1.disableStepper();
-    running1 = false;
-  }
-
-  if (stepper2.processMovement() && running1) {
-    stepper2.disableStepper();
-    running2 = false;
-  }
-
-  if (stepper3.processMovement() && running1) {
-    stepper3.disableStepper();
-    running3 = false;
-  }
-
-  if (stepper4.processMovement() && running1) {
-    stepper4.disableStepper();
-    running4 = false;
-  }
-
-  if (stepper5.processMovement() && running1) {
-    stepper5.disableStepper();
-    running5 = false;
-  }
-
-  if (stepper6.processMovement() && running1) {
-    stepper6.disableStepper();
-    running6 = false;
-  }
-  */
-  delay(100);
+  stepperBank.service();
+  serialSlave.service();
 }
 
-  Func moveStepper;
-  Func stopStepper;
+Func moveStepper;
+Func disable;
+Func blinkLED;
+Func toggleLED;
+Func moveStepperToPos;
+Func moveStepperDeg;
+Func moveStepperRev;
+Func moveStepperHome;
+Func moveStepperHome1;
+Func setStepperSpeed;
+Func setStepperAccel;
+Func moveSteppersLine;
+Func setStepperJerk;
+Func queueStepperMove;
+Func getStepperQueue;
+Func retargetStepper;
+Func changeSpeed;
+Func jogStepper;
+Func stopStepper;
+Func getHomeStatus;
+Func homeSteppers;
+Func getHomeStatuses;
 
 
 Callable callables[] = {
@@ -116,7 +102,18 @@ Callable callables[] = {
   {"moveStepperHome", moveStepperHome},
   {"moveStepperHome1", moveStepperHome1},
   {"setStepperSpeed", setStepperSpeed},
-  {"setStepperAccel", setStepperAccel}
+  {"setStepperAccel", setStepperAccel},
+  {"moveSteppersLine", moveSteppersLine},
+  {"setStepperJerk", setStepperJerk},
+  {"queueStepperMove", queueStepperMove},
+  {"getStepperQueue", getStepperQueue},
+  {"retargetStepper", retargetStepper},
+  {"changeSpeed", changeSpeed},
+  {"jogStepper", jogStepper},
+  {"stopStepper", stopStepper},
+  {"getHomeStatus", getHomeStatus},
+  {"homeSteppers", homeSteppers},
+  {"getHomeStatuses", getHomeStatuses}
 };
 
 byte numberOfExternalCallables = sizeof(callables) / sizeof(Callable);
@@ -138,10 +135,6 @@ void moveStepperHome(byte dataLength, byte *dataArray) {
 
   // variables hard-coded:
 
-  stepper1.connectToPort(1);
-  stepper1.setSpeedInStepsPerSecond(500);
-  stepper1.setAccelerationInStepsPerSecondPerSecond(500);
-
   int switchPin = 29;
   byte stepper = 1;
   long maxDistance = 100000;
@@ -149,49 +142,47 @@ void moveStepperHome(byte dataLength, byte *dataArray) {
   float spd = 500;
   if (dir == 0)
     dir = -1;
-    
 
-  
-  switch (stepper) {
-    case 1:
-      stepper1.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
-      break;
-    case 2:
-      stepper2.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
-      break;
-    case 3:
-      stepper3.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
-      break;
-    case 4:
-      stepper4.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
-      break;
-    case 5:
-      stepper5.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
-      break;
-    case 6:
-      stepper6.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
-      break;
-  }
+  SpeedyStepper *axis = stepperBank.getAxis(stepper);
+  if (axis == NULL)
+    return;
+
+  axis->connectToPort(stepper);
+  axis->setSpeedInStepsPerSecond(500);
+  axis->setAccelerationInStepsPerSecondPerSecond(500);
+  stepperBank.home(stepper, dir, spd, maxDistance, switchPin);
 }
 
 void moveStepperHome1(byte dataLength, byte *dataArray) {
-  stepper1.connectToPort(1);
-  // stepper1.setSpeedInStepsPerSecond(500);
-  // stepper1.setAccelerationInStepsPerSecondPerSecond(500);
-
   int switchPin = 29;
   byte stepper = 1;
   long maxDistance = 100000;
   long dir = 1;
   float spd = 500;
+
+  SpeedyStepper *axis = stepperBank.getAxis(stepper);
+  axis->connectToPort(stepper);
+  // axis->setSpeedInStepsPerSecond(500);
+  // axis->setAccelerationInStepsPerSecondPerSecond(500);
+
  // pinMode(10, OUTPUT);
   
  // digitalWrite(10, HIGH);
-  stepper1.moveToHomeInSteps(dir, spd, maxDistance, switchPin);
+  stepperBank.home(stepper, dir, spd, maxDistance, switchPin);
  // digitalWrite(10, LOW);
   
 }
 
+//
+// check if an axis is moving as part of the line that lineGroup is running, the single
+// axis callables leave such an axis alone until the line is done
+//
+bool inRunningLine(byte axisNumber) {
+  SpeedyStepper *axis = stepperBank.getAxis(axisNumber);
+
+  return (axis != NULL) && !lineGroup.motionComplete() && lineGroup.hasAxis(*axis);
+}
+
 void moveStepper(byte dataLength, byte *dataArray) {
 
   byte stepper = dataArray[0];
@@ -200,40 +191,9 @@ void moveStepper(byte dataLength, byte *dataArray) {
     steps *= -1;
   }
 
-  switch (stepper) {
-    case 1:
-      stepper1.enableStepper();
-      stepper1.setupRelativeMoveInSteps(steps);
-      running1 = true;
-      break;
-    case 2:
-      stepper2.enableStepper();
-      stepper2.setupRelativeMoveInSteps(steps);
-      running2 = true;
-      break;
-    case 3:
-      stepper3.enableStepper();
-      stepper3.setupRelativeMoveInSteps(steps);
-      running3 = true;
-      break;
-    case 4:
-      stepper4.enableStepper();
-      stepper4.setupRelativeMoveInSteps(steps);
-      running4 = true;
-    case 5:
-      stepper5.enableStepper();
-      stepper5.setupRelativeMoveInSteps(steps);
-      running5 = true;
-      break;
-    case 6:
-      stepper6.enableStepper();
-      stepper6.setupRelativeMoveInSteps(steps);
-      running6 = true;
-      break;
-  }
-
-  return("Moving Stepper");
-
+  if (inRunningLine(stepper))
+    return;
+  stepperBank.startRelativeMove(stepper, steps);
 }
 
 void blinkLED(byte dataLength, byte *dataArray) {
@@ -275,13 +235,8 @@ void toggleLED(byte dataLength, byte *dataArray) {
 }
 
 
-void disable() {
-  stepper1.disableStepper();
-  stepper2.disableStepper();
-  stepper3.disableStepper();
-  stepper4.disableStepper();
-  stepper5.disableStepper();
-  stepper6.disableStepper();
+void disable(byte dataLength, byte *dataArray) {
+  stepperBank.disableAll();
 }
 
 
@@ -295,41 +250,9 @@ void moveStepperDeg(byte dataLength, byte *dataArray) {
     steps *= -1;
   }
 
-  
-  switch (stepper) {
-    case 1:
-      stepper1.enableStepper();
-      stepper1.setupRelativeMoveInSteps(steps);
-      running1 = true;
-      break;
-    case 2:
-      stepper2.enableStepper();
-      stepper2.setupRelativeMoveInSteps(steps);
-      running2 = true;
-      break;
-    case 3:
-      stepper3.enableStepper();
-      stepper3.setupRelativeMoveInSteps(steps);
-      running3 = true;
-      break;
-    case 4:
-      stepper4.enableStepper();
-      stepper4.setupRelativeMoveInSteps(steps);
-      running4 = true;
-    case 5:
-      stepper5.enableStepper();
-      stepper5.setupRelativeMoveInSteps(steps);
-      running5 = true;
-      break;
-    case 6:
-      stepper6.enableStepper();
-      stepper6.setupRelativeMoveInSteps(steps);
-      running6 = true;
-      break;
-  }
-
-  return("Moving Stepper Degrees");
-
+  if (inRunningLine(stepper))
+    return;
+  stepperBank.startRelativeMove(stepper, steps);
 }
 
 void moveStepperRev(byte dataLength, byte *dataArray) {
@@ -342,67 +265,18 @@ void moveStepperRev(byte dataLength, byte *dataArray) {
     steps *= -1;
   }
 
-  switch (stepper) {
-    case 1:
-      stepper1.enableStepper();
-      stepper1.setupRelativeMoveInSteps(steps);
-      running1 = true;
-      break;
-    case 2:
-      stepper2.enableStepper();
-      stepper2.setupRelativeMoveInSteps(steps);
-      running2 = true;
-      break;
-    case 3:
-      stepper3.enableStepper();
-      stepper3.setupRelativeMoveInSteps(steps);
-      running3 = true;
-      break;
-    case 4:
-      stepper4.enableStepper();
-      stepper4.setupRelativeMoveInSteps(steps);
-      running4 = true;
-    case 5:
-      stepper5.enableStepper();
-      stepper5.setupRelativeMoveInSteps(steps);
-      running5 = true;
-      break;
-    case 6:
-      stepper6.enableStepper();
-      stepper6.setupRelativeMoveInSteps(steps);
-      running6 = true;
-      break;
-  }
-
-  return("Moving Stepper Revolutions");
-
+  if (inRunningLine(stepper))
+    return;
+  stepperBank.startRelativeMove(stepper, steps);
 }
 
 void setStepperSpeed(byte dataLength, byte *dataArray) {
   int speedStepper = ((int *) (dataArray + 2))[0];
-  byte stepper = dataArray[0];
+  SpeedyStepper *axis = stepperBank.getAxis(dataArray[0]);
   speedSetting = speedStepper;
   
-  switch (stepper) {
-    case 1:
-      stepper1.setSpeedInStepsPerSecond(speedStepper);
-      break;
-    case 2:
-      stepper2.setSpeedInStepsPerSecond(speedStepper);
-      break;
-    case 3:
-      stepper3.setSpeedInStepsPerSecond(speedStepper);
-      break;
-    case 4:
-      stepper4.setSpeedInStepsPerSecond(speedStepper);
-      break;
-    case 5:
-      stepper5.setSpeedInStepsPerSecond(speedStepper);
-      break;
-    case 6:
-      stepper6.setSpeedInStepsPerSecond(speedStepper);
-      break;
-  }
+  if (axis != NULL)
+    axis->setSpeedInStepsPerSecond(speedStepper);
 }
 
 //Some parameters hard coded for ease of use
@@ -414,28 +288,10 @@ void setStepperSpeed(byte dataLength, byte *dataArray) {
 
 void setStepperAccel(byte dataLength, byte *dataArray) {
   int accelStepper = ((int *) (dataArray + 2))[0];
-  byte stepper = dataArray[0];
+  SpeedyStepper *axis = stepperBank.getAxis(dataArray[0]);
   
-  switch (stepper) {
-    case 1:
-      stepper1.setAccelerationInStepsPerSecondPerSecond(accelStepper);
-      break;
-    case 2:
-      stepper2.setAccelerationInStepsPerSecondPerSecond(accelStepper);
-      break;
-    case 3:
-      stepper3.setAccelerationInStepsPerSecondPerSecond(accelStepper);
-      break;
-    case 4:
-      stepper4.setAccelerationInStepsPerSecondPerSecond(accelStepper);
-      break;
-    case 5:
-      stepper5.setAccelerationInStepsPerSecondPerSecond(accelStepper);
-      break;
-    case 6:
-      stepper6.setAccelerationInStepsPerSecondPerSecond(accelStepper);
-      break;
-  }
+  if (axis != NULL)
+    axis->setAccelerationInStepsPerSecondPerSecond(accelStepper);
 }
 
 void moveStepperToPos(byte dataLength, byte *dataArray) {
@@ -445,26 +301,11 @@ void moveStepperToPos(byte dataLength, byte *dataArray) {
   int steps2;
   int steps;
   int currentPosSteps;
-  switch (stepper) {
-    case 1:
-      currentPosSteps = stepper1.getCurrentPositionInSteps();
-      break;
-    case 2:
-      currentPosSteps = stepper2.getCurrentPositionInSteps();
-      break;
-    case 3:
-      currentPosSteps = stepper3.getCurrentPositionInSteps();
-      break;
-    case 4:
-      currentPosSteps = stepper4.getCurrentPositionInSteps();
-      break;
-    case 5:
-      currentPosSteps = stepper5.getCurrentPositionInSteps();
-      break;
-    case 6:
-      currentPosSteps = stepper6.getCurrentPositionInSteps();
-      break;
-  }
+  SpeedyStepper *axis = stepperBank.getAxis(stepper);
+  if (axis == NULL)
+    return;
+
+  currentPosSteps = axis->getCurrentPositionInSteps();
   int finalPosSteps = ((int *) (dataArray + 2))[0];
   bool longways = false;
   
@@ -497,39 +338,215 @@ void moveStepperToPos(byte dataLength, byte *dataArray) {
       }
   }
 
-  switch (stepper) {
-    case 1:
-      stepper1.enableStepper();
-      stepper1.setupRelativeMoveInSteps(steps);
-      running1 = true;
-      break;
-    case 2:
-      stepper2.enableStepper();
-      stepper2.setupRelativeMoveInSteps(steps);
-      running2 = true;
-      break;
-    case 3:
-      stepper3.enableStepper();
-      stepper3.setupRelativeMoveInSteps(steps);
-      running3 = true;
-      break;
-    case 4:
-      stepper4.enableStepper();
-      stepper4.setupRelativeMoveInSteps(steps);
-      running4 = true;
-    case 5:
-      stepper5.enableStepper();
-      stepper5.setupRelativeMoveInSteps(steps);
-      running5 = true;
-      break;
-    case 6:
-      stepper6.enableStepper();
-      stepper6.setupRelativeMoveInSteps(steps);
-      running6 = true;
-      break;
+  if (inRunningLine(stepper))
+    return;
+  stepperBank.startRelativeMove(stepper, steps);
+}
+
+//
+// move several axes together in a straight line, the data is a signed 16 bit distance
+// in steps for each axis starting with axis 1, low byte first.  Axes past the end of
+// the data or with a distance of 0 don't move.  The line runs at the speed last set
+// with setStepperSpeed, on its longest axis.  Only the axes stepped from the timer, as
+// the line is, can be in it, not the polled axis 1.  Returns 1 if the line started, 0 if
+// it didn't because an axis can't be in it, or it or one of its axes is still moving.
+//
+void moveSteppersLine(byte dataLength, byte *dataArray) {
+
+  long distances[STEPPER_GROUP_MAX_AXES];
+  byte axisCount = dataLength / 2;
+  if (axisCount > STEPPER_BANK_AXES)
+    axisCount = STEPPER_BANK_AXES;
+
+  if (!lineGroup.motionComplete()) {
+    returns((byte) 0);
+    return;
+  }
+
+  lineGroup.removeAllAxes();
+  for (byte axisNumber = 1; axisNumber <= axisCount; axisNumber++) {
+    int distance = (int16_t) (dataArray[2 * axisNumber - 2] | (dataArray[2 * axisNumber - 1] << 8));
+    if (distance == 0)
+      continue;
+
+    SpeedyStepper *axis = stepperBank.getAxis(axisNumber);
+    if (!stepperTimer.isAttached(*axis)) {
+      lineGroup.removeAllAxes();
+      returns((byte) 0);
+      return;
+    }
+    axis->enableStepper();
+    distances[lineGroup.getAxisCount()] = distance;
+    lineGroup.addAxis(*axis);
   }
 
-  return("Moving Stepper Position");
+  lineGroup.setSpeedInStepsPerSecond(speedSetting);
+  if (!lineGroup.setupLinearMoveInSteps(distances)) {
+    lineGroup.removeAllAxes();
+    returns((byte) 0);
+    return;
+  }
+  returns((byte) 1);
+}
 
+//
+// give an axis an S-curve: dataArray[0] is the axis, dataArray[1] is unused, then the
+// jerk in steps/second/second/second as 4 bytes, little endian, 0 for the trapezoid
+//
+void setStepperJerk(byte dataLength, byte *dataArray) {
+  unsigned long jerkStepper = (unsigned long) dataArray[2] | ((unsigned long) dataArray[3] << 8) |
+    ((unsigned long) dataArray[4] << 16) | ((unsigned long) dataArray[5] << 24);
+  SpeedyStepper *axis = stepperBank.getAxis(dataArray[0]);
+
+  if ((axis != NULL) && (dataLength >= 6))
+    axis->setJerkInStepsPerSecondPerSecondPerSecond(jerkStepper);
+}
+
+//
+// queue a move behind the ones an axis is running, the same data as moveStepper.  Moves
+// that go the same way run into each other without stopping.  Returns the number of
+// moves waiting in the queue, or 255 if it was full and the move was dropped.
+//
+void queueStepperMove(byte dataLength, byte *dataArray) {
+
+  byte stepper = dataArray[0];
+  int steps = ((int *) (dataArray + 2))[0];
+  if (dataArray[1] == 1) {
+    steps *= -1;
+  }
+
+  SpeedyStepper *axis = stepperBank.getAxis(stepper);
+  if ((axis == NULL) || inRunningLine(stepper) || !stepperBank.queueRelativeMove(stepper, steps)) {
+    returns((byte) 255);
+    return;
+  }
+  returns(axis->getMoveQueueDepth());
+}
+
+//
+// return the number of moves waiting in the queue of axis dataArray[0]
+//
+void getStepperQueue(byte dataLength, byte *dataArray) {
+  SpeedyStepper *axis = stepperBank.getAxis(dataArray[0]);
+
+  if (axis == NULL)
+    returns((byte) 0);
+  else
+    returns(axis->getMoveQueueDepth());
+}
+
+//
+// send an axis to a new absolute position while it is moving, dataArray[1] = 1 makes
+// the position negative.  An axis that can't stop in time slows down, stops and comes
+// back to the position.
+//
+void retargetStepper(byte dataLength, byte *dataArray) {
+
+  byte stepper = dataArray[0];
+  long position = ((int *) (dataArray + 2))[0];
+  if (dataArray[1] == 1) {
+    position *= -1;
+  }
+
+  if (inRunningLine(stepper))
+    return;
+  stepperBank.retarget(stepper, position);
+}
+
+//
+// change the speed of an axis while it is moving, the same data as setStepperSpeed
+//
+void changeSpeed(byte dataLength, byte *dataArray) {
+  int speedStepper = ((int *) (dataArray + 2))[0];
+  SpeedyStepper *axis = stepperBank.getAxis(dataArray[0]);
+
+  if ((axis != NULL) && (speedStepper > 0) && !inRunningLine(dataArray[0]))
+    axis->setupSpeedChangeInStepsPerSecond(speedStepper);
+}
+
+//
+// run an axis at a velocity until it is told otherwise, the same data as moveStepper
+// with the speed in steps/second in place of the distance.  A speed of 0 stops it.
+//
+void jogStepper(byte dataLength, byte *dataArray) {
+
+  byte stepper = dataArray[0];
+  int velocity = ((int *) (dataArray + 2))[0];
+  if (dataArray[1] == 1) {
+    velocity *= -1;
+  }
+
+  if (inRunningLine(stepper))
+    return;
+  stepperBank.jog(stepper, velocity);
+}
+
+//
+// decelerate axis dataArray[0] to a stop, from a move or from jogging.  An axis in a
+// running line stops the whole line, it can't leave it.
+//
+void stopStepper(byte dataLength, byte *dataArray) {
+  if (inRunningLine(dataArray[0])) {
+    lineGroup.setupStop();
+    return;
+  }
+  stepperBank.stop(dataArray[0]);
+}
+
+//
+// return how far homing of axis dataArray[0] has got, one of the HOME_STATUS_... values.
+// moveStepperHome only starts homing, this tells when it has succeeded or failed.
+//
+void getHomeStatus(byte dataLength, byte *dataArray) {
+  SpeedyStepper *axis = stepperBank.getAxis(dataArray[0]);
+
+  if (axis == NULL)
+    returns(HOME_STATUS_IDLE);
+  else
+    returns(axis->getHomingStatus());
+}
+
+//
+// home several axes at once, each against its own switch.  The data is 5 bytes for each
+// axis: the axis, 1 to home in the negative direction, the switch pin, then the speed in
+// steps/second as 2 bytes, low byte first.  A packet has room for 3 axes, home more
+// with a second call, or several calls in one batch.  The axes home together, so homing
+// takes as long as the slowest of them.  Axes 2 - 6 are stepped from the timer and need
+// their switch on an external interrupt pin (see setupHomeInSteps()), an axis with its
+// switch on any other pin isn't started.  Returns the number of axes started,
+// getHomeStatuses tells how each of them did.
+//
+void homeSteppers(byte dataLength, byte *dataArray) {
+
+  long maxDistance = 100000;
+  byte started = 0;
+
+  for (byte i = 0; i + 5 <= dataLength; i += 5) {
+    byte stepper = dataArray[i];
+    long dir = 1;
+    int switchPin = dataArray[i + 2];
+    int spd = (int16_t) (dataArray[i + 3] | (dataArray[i + 4] << 8));
+    if (dataArray[i + 1] == 1)
+      dir = -1;
+
+    if ((spd <= 0) || inRunningLine(stepper))
+      continue;
+    if (stepperBank.home(stepper, dir, spd, maxDistance, switchPin))
+      started++;
+  }
+
+  returns(started);
+}
+
+//
+// return how far homing of each axis has got, one HOME_STATUS_... byte for each of axes
+// 1 to 6
+//
+void getHomeStatuses(byte dataLength, byte *dataArray) {
+  byte homeStatus[STEPPER_BANK_AXES];
+
+  for (byte axisNumber = 1; axisNumber <= STEPPER_BANK_AXES; axisNumber++)
+    homeStatus[axisNumber - 1] = stepperBank.getAxis(axisNumber)->getHomingStatus();
+
+  returns(STEPPER_BANK_AXES, homeStatus);
 }
-  
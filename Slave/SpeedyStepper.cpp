@@ -15,14 +15,34 @@
 // interface boards that have a Step and Direction interface.  The motors are 
 // accelerated and decelerated as they travel to the final position.
 //
-// A limitation of this driver is that once a motion starts, you can NOT change the 
-// target position, speed or rate of acceleration until the motion has completed.  
-// The only exception to this is that you can issue a "Stop" at any point in time,
-// which will cause the motor to decelerate until stopped.
-//
-// Because this library doesn't allow making changes while moving, it can generate
-// a faster step rate than a driver that support changing the target position or
-// speed while in motion.
+// Once a motion starts, you can NOT change the rate of acceleration until the motion
+// has completed.  The target position can be changed while moving with
+// setupRetargetInSteps(): the motor carries on to a new target that it can still stop
+// at, otherwise it decelerates to a stop and comes back.  The speed can be changed
+// with setupSpeedChangeInStepsPerSecond(), the motor ramps to the new speed and
+// carries on.  An S-curve move keeps its speed and always stops before a new target.
+// You can also issue a "Stop" at any point in time, which will cause the motor to
+// decelerate until stopped.
+//
+// These changes are worked out once, when they are made, and leave the ramp as it is
+// for a move that was set up that way to begin with, so the step rate is no lower for
+// a move that can be changed.
+//
+// An axis can also run at a velocity with no target, jogging (see
+// setupJogInStepsPerSecond()), which ramps from one velocity to the next with the
+// acceleration set for it.
+//
+// Further moves can be queued while one is running (see queueMoveInSteps()).  Each
+// queued move starts on the step that finishes the one before it, and where they go
+// the same way the motor runs through from one to the next without slowing down more
+// than the moves still in the queue need to stop in.  Speeds are kept as the distance
+// in steps it takes to stop from them, Speed^2 / (2 * Acceleration), so looking ahead
+// through the queue adds up distances and the ramp just compares them each step.
+//
+// Steppers can either be stepped by calling processMovement() from loop(), or handed
+// to StepperTimer which steps them from a timer interrupt (see StepperTimer.cpp).
+// The setup and status functions below can be called either way, they keep the
+// interrupt out while they change or read the move.
 //
 // This library can generate a maximum of about 12,500 steps per second using an 
 // Arduino Uno.  Assuming a system driving only one motor at a time, in full step 
@@ -33,6 +53,15 @@
 // time will reduce the maximum speed.  For example running two motors will reduce
 // the step rate by half or more.
 //
+// The ramp can be computed with floats, or with fixed point integers which is more
+// than twice as fast on the AVR where floats are done in software (see
+// useFixedPointRamp()).
+//
+// Giving an axis a jerk (see setJerkInStepsPerSecondPerSecondPerSecond()) replaces the
+// trapezoid with an S-curve: the acceleration ramps up to its maximum and back down
+// again instead of switching on and off, which lets a heavy load take a higher
+// acceleration without missing steps.  The S-curve is computed with floats.
+//
 // This stepper motor driver is based on Aryeh Elderman's paper "Real Time Stepper  
 // Motor Linear Ramping Just By Addition and Multiplication".  See: 
 //                          www.hwml.com/LeibRamp.pdf
@@ -192,6 +221,144 @@ const int STEPPER_ENABLE_ENABLED = LOW;
 const int STEPPER_ENABLE_DISABLED = HIGH;
 
 
+//
+// step and direction writes land here until the stepper is connected to a pin
+//
+static volatile uint8_t unconnectedPortRegister;
+
+
+//
+// the step pin of each DPEA board port as a register and bit known when compiling, for
+// takeStepOnBoardPort().  Ports H and L are outside the IO space, there is no single
+// instruction that sets a bit in them.
+//
+template <byte stepperMotorNumber> struct BoardStepPin;
+
+#define BOARD_STEP_PIN(stepperMotorNumber, port, bit, inIOSpace)                      \
+  template <> struct BoardStepPin<stepperMotorNumber>                                 \
+  {                                                                                   \
+    static inline volatile uint8_t &portRegister(void) { return(port); }             \
+    static const byte BIT_MASK = (1 << (bit));                                        \
+    static const bool IN_IO_SPACE = inIOSpace;                                        \
+  }
+
+BOARD_STEP_PIN(1, PORTC, 3, true);      // STEPPER_1_STEP_PIN, 34
+BOARD_STEP_PIN(2, PORTC, 6, true);      // STEPPER_2_STEP_PIN, 31
+BOARD_STEP_PIN(3, PORTE, 3, true);      // STEPPER_3_STEP_PIN, 5
+BOARD_STEP_PIN(4, PORTL, 5, false);     // STEPPER_4_STEP_PIN, 44
+BOARD_STEP_PIN(5, PORTH, 4, false);     // STEPPER_5_STEP_PIN, 7
+BOARD_STEP_PIN(6, PORTB, 6, true);      // STEPPER_6_STEP_PIN, 12
+
+
+//
+// fixed point ramp constants, step periods are in us with 12 fraction bits, which
+// covers periods up to about 1 second, the ramp factor is a fraction with 32 bits
+//
+const int STEP_PERIOD_FRACTION_BITS = 12;
+const float STEP_PERIOD_ONE = 4096.0;
+const unsigned long MAXIMUM_STEP_PERIOD_InUSQ12 = 0xFFFFFFFFUL;
+const unsigned long long MAXIMUM_STEP_PERIOD_InUSQ44 = 0xFFFFFFFFFFFFFFFFULL;
+const float MAXIMUM_STEP_PERIOD_InUS = 1048575.0;
+const float RAMP_FACTOR_ONE = 4294967296.0;
+const unsigned long RAMP_FACTOR_ONE_HALF = 0x80000000UL;
+const unsigned long MAXIMUM_RAMP_FACTOR_Q32 = 0xF0000000UL;    // keeps (1 + F)^2 below 4
+const unsigned long RAMP_GROWTH_ONE_Q30 = 0x40000000UL;
+const unsigned long RAMP_GROWTH_ONE_HALF_Q30 = 0x20000000UL;
+
+
+//
+// AVR clock cycles taken by the ramp arithmetic, roughly what avr-libc's software
+// floats and libgcc's 32 x 32 bit multiply take.  Only the host simulation uses them.
+//
+const unsigned long FLOAT_RAMP_STEP_CYCLES = 3 * 125 + 100 + 45;   // 3 multiplies, subtract, compare
+const unsigned long FLOAT_PERIOD_CONVERSION_CYCLES = 60;
+const unsigned long FIXED_POINT_RAMP_STEP_CYCLES = 3 * 85 + 70;    // 3 multiplies, 64 bit adds and shifts
+const unsigned long FLOAT_SCURVE_STEP_CYCLES = 4 * 125 + 2 * 100 + 90;   // 4 multiplies, 2 adds, limits
+const unsigned long FLOAT_SCURVE_STOP_CYCLES = 25 * 125 + 6 * 480 + 2 * 500 + 10 * 100;   // multiplies, divides, square roots, adds
+
+
+//
+// the S-curve ramp factor, acceleration * period^2, is limited while the first few
+// steps are far apart so that the period can't go to zero or below
+//
+const float MAXIMUM_SCURVE_RAMP_FACTOR = 0.5;
+
+
+//
+// a jogging axis runs toward a target this far ahead of it, processMovement() moves
+// the target on again once the axis has covered half of the distance
+//
+const long JOG_DISTANCE_InSteps = 0x40000000L;
+
+
+//
+// homing timing, the home switch must read the same for HOME_SWITCH_CONFIRM_MS before
+// it counts, then after the motor halts on it homing waits for the switch to stop
+// bouncing and the motor to settle before the next move
+//
+const unsigned long HOME_SWITCH_CONFIRM_MS = 1;
+const unsigned long HOME_SWITCH_DEBOUNCE_MS = 80;
+const unsigned long HOME_SWITCH_SETTLE_MS = 100;
+const unsigned long HOME_SLOW_APPROACH_PAUSE_MS = 500;
+
+
+//
+// a home switch on one of the external interrupt pins (2, 3 and 18 - 21 on the Mega)
+// latches the position at its edge, which counts once the switch has been still for
+// LIMIT_SWITCH_DEBOUNCE_US after its last edge
+//
+const byte LIMIT_SWITCH_INTERRUPTS = 6;
+const unsigned long LIMIT_SWITCH_DEBOUNCE_US = 2000;
+
+
+//
+// the stepper homing against each external interrupt
+//
+static SpeedyStepper *limitSwitchSteppers[LIMIT_SWITCH_INTERRUPTS];
+
+
+//
+// convert a step period in us to fixed point, limiting it to the longest period that
+// fits
+//
+static unsigned long stepPeriodToFixedPoint(float stepPeriod_InUS)
+{
+  if (stepPeriod_InUS >= MAXIMUM_STEP_PERIOD_InUS)
+    return(MAXIMUM_STEP_PERIOD_InUSQ12);
+  return((unsigned long) (stepPeriod_InUS * STEP_PERIOD_ONE));
+}
+
+
+
+//
+// multiply a fixed point number by a fraction with 32 fraction bits, rounding to the
+// nearest
+//
+static inline unsigned long multiplyByFraction(unsigned long value, unsigned long fraction_Q32)
+{
+  return((unsigned long) (((unsigned long long) value * fraction_Q32 + 0x80000000UL) >> 32));
+}
+
+
+
+//
+// get the distance an S-curve takes to accelerate from stopped up to a speed, the
+// acceleration ramps up at the jerk, holds at its maximum if there is time, then ramps
+// back down
+//  Enter:  speed = speed to reach, units in steps/second
+//          acceleration = maximum acceleration, units in steps/second/second
+//          jerk = rate the acceleration changes, units in steps/second/second/second
+//  Exit:   distance in steps returned
+//
+static float sCurveAccelerationDistance(float speed, float acceleration, float jerk)
+{
+  if (speed >= acceleration * acceleration / jerk)
+    return(speed * (speed / acceleration + acceleration / jerk) / 2.0);
+  else
+    return(speed * sqrt(speed / jerk));
+}
+
+
 
 
 //
@@ -210,7 +377,30 @@ SpeedyStepper::SpeedyStepper()
   currentPosition_InSteps = 0;
   desiredSpeed_InStepsPerSecond = 200.0;
   acceleration_InStepsPerSecondPerSecond = 200.0;
+  jerk_InStepsPerSecondPerSecondPerSecond = 0.0;
   currentStepPeriod_InUS = 0.0;
+  currentStepPeriod_InUSQ12 = 0;
+  fixedPointRampSelected = false;
+  fixedPointRamp = false;
+  sCurveRamp = false;
+  jogging = false;
+  homingStatus = HOME_STATUS_IDLE;
+  homingPaused = false;
+  homingInterruptNumber = NOT_AN_INTERRUPT;
+  limitSwitchArmed = false;
+  targetPosition_InSteps = 0;
+  direction_Scaler = 1;
+  desiredStoppingDistance_InSteps = 0;
+  ramp_StoppingDistance_InSteps = 0;
+  ramp_ExitStoppingDistance_InSteps = 0;
+  moveQueueHead = 0;
+  moveQueueCount = 0;
+  timerDriven = false;
+  stepPortRegister = &unconnectedPortRegister;
+  stepBitMask = 0;
+  directionPortRegister = &unconnectedPortRegister;
+  directionBitMask = 0;
+  stepFunction = takeStepOnPins;
 }
 
 
@@ -224,6 +414,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
   byte stepPinNumber;
   byte directionPinNumber;
   byte enablePinNumber;
+  StepFunction *boardStepFunction;
   
   switch(stepperMotorNumber)
   {
@@ -232,6 +423,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = STEPPER_1_STEP_PIN;
       directionPinNumber = STEPPER_1_DIRECTION_PIN;
       enablePinNumber = STEPPER_1_ENABLE_PIN;
+      boardStepFunction = takeStepOnBoardPort<1>;
       break;
     }
     
@@ -240,6 +432,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = STEPPER_2_STEP_PIN;
       directionPinNumber = STEPPER_2_DIRECTION_PIN;
       enablePinNumber = STEPPER_2_ENABLE_PIN;
+      boardStepFunction = takeStepOnBoardPort<2>;
       break;
     }
     
@@ -248,6 +441,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = STEPPER_3_STEP_PIN;
       directionPinNumber = STEPPER_3_DIRECTION_PIN;
       enablePinNumber = STEPPER_3_ENABLE_PIN;
+      boardStepFunction = takeStepOnBoardPort<3>;
       break;
     }
     
@@ -256,6 +450,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = STEPPER_4_STEP_PIN;
       directionPinNumber = STEPPER_4_DIRECTION_PIN;
       enablePinNumber = STEPPER_4_ENABLE_PIN;
+      boardStepFunction = takeStepOnBoardPort<4>;
       break;
     }
 
@@ -264,6 +459,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = STEPPER_5_STEP_PIN;
       directionPinNumber = STEPPER_5_DIRECTION_PIN;
       enablePinNumber = STEPPER_5_ENABLE_PIN;
+      boardStepFunction = takeStepOnBoardPort<5>;
       break;
     }
     
@@ -272,6 +468,7 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = STEPPER_6_STEP_PIN;
       directionPinNumber = STEPPER_6_DIRECTION_PIN;
       enablePinNumber = STEPPER_6_ENABLE_PIN;
+      boardStepFunction = takeStepOnBoardPort<6>;
       break;
     }
 
@@ -281,11 +478,43 @@ void SpeedyStepper::connectToPort(byte stepperMotorNumber)
       stepPinNumber = 0;
       directionPinNumber = 0;
       enablePinNumber = 0;
+      boardStepFunction = NULL;
       break;
     }
   }
   
   connectToPins(stepPinNumber, directionPinNumber, enablePinNumber);
+
+  //
+  // the step pin of a board port is known when compiling, so step it with constant
+  // instructions rather than through the port register found by connectToPins()
+  //
+  if (boardStepFunction != NULL)
+    stepFunction = boardStepFunction;
+}
+
+
+
+//
+// find the output port register and bit mask of a pin
+//  Enter:  pin = IO pin number
+//          portRegister -> storage for the port's output register
+//          bitMask -> storage for the pin's bit in the port
+//
+static void lookupPortBit(byte pin, volatile uint8_t **portRegister, byte *bitMask)
+{
+  byte port;
+
+  port = digitalPinToPort(pin);
+  if (port == NOT_A_PIN)
+  {
+    *portRegister = &unconnectedPortRegister;
+    *bitMask = 0;
+    return;
+  }
+
+  *portRegister = portOutputRegister(port);
+  *bitMask = digitalPinToBitMask(pin);
 }
 
 
@@ -305,6 +534,15 @@ void SpeedyStepper::connectToPins(byte stepPinNumber, byte directionPinNumber, b
   stepPin = stepPinNumber;
   directionPin = directionPinNumber;
   enablePin = enablePinNumber;
+
+  //
+  // look up the port register and bit of the step and direction pins once, so that a
+  // step is a single write to the port rather than a digitalWrite() with its table
+  // lookups
+  //
+  lookupPortBit(stepPin, &stepPortRegister, &stepBitMask);
+  lookupPortBit(directionPin, &directionPortRegister, &directionBitMask);
+  stepFunction = takeStepOnPins;
   
   //
   // configure the IO bits
@@ -663,6 +901,21 @@ void SpeedyStepper::disableStepper(void)
 
 
 
+//
+// choose how the acceleration ramp is computed for each step.  Floats follow Aryeh
+// Elderman's formula exactly, fixed point gives the same ramp to within a fraction of
+// a us per step in less than half the time, which raises the maximum step rate.
+// Note: this can only be called when the motor is stopped
+//  Enter:  fixedPoint = true to compute the ramp with fixed point integers, false for
+//          floats
+//
+void SpeedyStepper::useFixedPointRamp(bool fixedPoint)
+{
+  fixedPointRampSelected = fixedPoint;
+}
+
+
+
 //
 // set the current position of the motor in steps, this does not move the motor
 // Note: This function should only be called when the motor is stopped
@@ -670,7 +923,10 @@ void SpeedyStepper::disableStepper(void)
 //
 void SpeedyStepper::setCurrentPositionInSteps(long currentPositionInSteps)
 {
+  byte oldSREG = SREG;
+  cli();
   currentPosition_InSteps = currentPositionInSteps;
+  SREG = oldSREG;
 }
 
 
@@ -682,310 +938,1132 @@ void SpeedyStepper::setCurrentPositionInSteps(long currentPositionInSteps)
 //
 long SpeedyStepper::getCurrentPositionInSteps()
 {
-  return(currentPosition_InSteps);
+  long currentPosition;
+  byte oldSREG = SREG;
+
+  cli();
+  currentPosition = currentPosition_InSteps;
+  SREG = oldSREG;
+  return(currentPosition);
 }
 
 
 
 //
 // setup a "Stop" to begin the process of decelerating from the current velocity to zero, 
-// decelerating requires calls to processMove() until the move is complete
+// decelerating requires calls to processMove() until the move is complete, the moves
+// waiting in the queue are dropped
 // Note: This function can be used to stop a motion initiated in units of steps or revolutions
 //
 void SpeedyStepper::setupStop()
 {
+
   //
-  // move the target position so that the motor will begin deceleration now
+  // stopping gives up on homing
   //
-  if (direction_Scaler > 0)
-    targetPosition_InSteps = currentPosition_InSteps + decelerationDistance_InSteps;
-  else
-    targetPosition_InSteps = currentPosition_InSteps - decelerationDistance_InSteps;
+  if ((homingStatus >= HOME_STATUS_MOVING_TOWARD_SWITCH) && (homingStatus <= HOME_STATUS_APPROACHING_SWITCH_SLOWLY))
+    finishHoming(HOME_STATUS_FAILED);
+
+  setupDecelerationToStop();
 }
 
 
 
 //
-// set the maximum speed, units in steps/second, this is the maximum speed reached while 
-// accelerating
-// Note: this can only be called when the motor is stopped
-//  Enter:  speedInStepsPerSecond = speed to accelerate up to, units in steps/second
+// move the target position so that the motor will begin deceleration now, the moves
+// waiting in the queue are dropped
 //
-void SpeedyStepper::setSpeedInStepsPerSecond(float speedInStepsPerSecond)
+void SpeedyStepper::setupDecelerationToStop(void)
 {
-  desiredSpeed_InStepsPerSecond = speedInStepsPerSecond;
+  long stoppingDistance;
+  byte oldSREG = SREG;
+
+  cli();
+  jogging = false;
+  moveQueueCount = 0;
+  ramp_ExitStoppingDistance_InSteps = 0;
+  if (sCurveRamp)
+    stoppingDistance = planSCurveStop();
+  else
+    stoppingDistance = ramp_StoppingDistance_InSteps;
+  if (direction_Scaler > 0)
+    targetPosition_InSteps = currentPosition_InSteps + stoppingDistance;
+  else
+    targetPosition_InSteps = currentPosition_InSteps - stoppingDistance;
+  SREG = oldSREG;
 }
 
 
 
 //
-// set the rate of acceleration, units in steps/second/second
-// Note: this can only be called when the motor is stopped
-//  Enter:  accelerationInStepsPerSecondPerSecond = rate of acceleration, units in 
-//          steps/second/second
+// plan the deceleration of an S-curve to a stop from the speed and acceleration it has
+// now, rather than from the peak speed of the move, so that a stop while it is still
+// speeding up doesn't carry the motor on for the full distance.  The acceleration ramps
+// down from where it is, through zero to the most the move allows, then back to zero
+// at the stop.  A motor that is already decelerating keeps its target.  Called with
+// the interrupts off.
+//  Exit:   distance to stop returned, the deceleration starts when the motor is that
+//          far from its target
 //
-void SpeedyStepper::setAccelerationInStepsPerSecondPerSecond(float accelerationInStepsPerSecondPerSecond)
+long SpeedyStepper::planSCurveStop(void)
 {
-    acceleration_InStepsPerSecondPerSecond = accelerationInStepsPerSecondPerSecond;
+  float acceleration;
+  float jerk;
+  float speed;
+  float accelerationNow;
+  float rampDownTime;
+  float rampDownDistance;
+  float maximumSpeed;
+  float jerkUpSpeed;
+  long jerkUpDistance;
+  long constantAccelerationDistance;
+  long stoppingDistance;
+
+  if (ramp_StepCount == 0)
+    return(0);
+  if (ramp_Decelerating)
+    return((targetPosition_InSteps - currentPosition_InSteps) * direction_Scaler);
+
+  acceleration = sCurveMaximumAcceleration_InStepsPerUSPerUS * 1E12;
+  jerk = sCurveJerk_InStepsPerUSPerUSPerUS * 1E18;
+  speed = 1000000.0 / ramp_NextStepPeriod_InUS;
+  accelerationNow = sCurveAcceleration_InStepsPerUSPerUS * 1E12;
+  maximumSpeed = 1000000.0 / desiredStepPeriod_InUS;
+
+  //
+  // the motor speeds up a little more while the acceleration ramps down to zero, or
+  // until it reaches the desired speed, which ends the acceleration there
+  //
+  rampDownTime = accelerationNow / jerk;
+  if (speed + accelerationNow * rampDownTime / 2.0 > maximumSpeed)
+  {
+    rampDownTime = (accelerationNow - sqrt(accelerationNow * accelerationNow - 2.0 * jerk * (maximumSpeed - speed))) / jerk;
+    if (!(rampDownTime >= 0.0))
+      rampDownTime = 0.0;
+  }
+  rampDownDistance = rampDownTime * (speed + rampDownTime * (accelerationNow / 2.0 - jerk * rampDownTime / 6.0));
+  speed += rampDownTime * (accelerationNow - jerk * rampDownTime / 2.0);
+
+  //
+  // then it slows from that speed the way setupMoveInSteps() plans the end of a move
+  //
+  if (speed >= acceleration * acceleration / jerk)
+  {
+    jerkUpSpeed = acceleration * acceleration / (2.0 * jerk);
+    jerkUpDistance = (long) round(acceleration * acceleration * acceleration / (6.0 * jerk * jerk));
+    constantAccelerationDistance = jerkUpDistance + (long) round(((speed - jerkUpSpeed) * (speed - jerkUpSpeed) - jerkUpSpeed * jerkUpSpeed) / (2.0 * acceleration));
+  }
+  else
+  {
+    jerkUpDistance = (long) round(speed * sqrt(speed / jerk) / 6.0);
+    constantAccelerationDistance = jerkUpDistance;
+  }
+  stoppingDistance = (long) round(rampDownDistance + sCurveAccelerationDistance(speed, acceleration, jerk));
+
+  decelerationDistance_InSteps = stoppingDistance;
+  sCurveJerkUpDistance_InSteps = jerkUpDistance;
+  sCurveConstantAccelerationDistance_InSteps = constantAccelerationDistance;
+  AVR_CYCLES(FLOAT_SCURVE_STOP_CYCLES);
+  return(stoppingDistance);
 }
 
 
 
 //
-// home the motor by moving until the homing sensor is activated, then set the position to zero
-// with units in steps
-//  Enter:  directionTowardHome = 1 to move in a positive direction, -1 to move in a negative directions 
-//          speedInStepsPerSecond = speed to accelerate up to while moving toward home, units in steps/second
-//          maxDistanceToMoveInSteps = unsigned maximum distance to move toward home before giving up
-//          homeSwitchPin = pin number of the home switch, switch should be configured to go low when at home
-//  Exit:   true returned if successful, else false
+// change the target of the move while the motor is running, the moves waiting in the
+// queue are dropped.  If the new target is ahead of the motor and far enough away to
+// stop in, the move just carries on to it.  Otherwise the motor decelerates to a stop,
+// then moves back to the new target.  An S-curve always stops first.
+//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in 
+//          units of steps
 //
-bool SpeedyStepper::moveToHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, 
-  long maxDistanceToMoveInSteps, int homeLimitSwitchPin)
+void SpeedyStepper::setupRetargetInSteps(long absolutePositionToMoveToInSteps)
 {
-  float originalDesiredSpeed_InStepsPerSecond;
-  bool limitSwitchFlag;
-  
+  long stoppingDistance;
+  long distanceAhead;
+  byte oldSREG = SREG;
+
+  cli();
+  jogging = false;
+  if (sCurveRamp)
+    stoppingDistance = planSCurveStop();
+  else
+    stoppingDistance = ramp_StoppingDistance_InSteps;
 
   //
-  // setup the home switch input pin
-  //
-  pinMode(homeLimitSwitchPin, INPUT_PULLUP);
-  
-  //
-  // remember the current speed setting
-  //
-  originalDesiredSpeed_InStepsPerSecond = desiredSpeed_InStepsPerSecond; 
- 
-  pinMode(9, OUTPUT);
-  pinMode(10, OUTPUT);
-  pinMode(3, OUTPUT);
-  pinMode(4, OUTPUT);
-  
- // digitalWrite(10, HIGH);
-  //
-  // if the home switch is not already set, move toward it
+  // a stopped motor just starts the move
   //
-  if (digitalRead(homeLimitSwitchPin) == HIGH)
+  if (((currentPosition_InSteps == targetPosition_InSteps) && (moveQueueCount == 0)) || (stoppingDistance == 0))
   {
-    //
-    // move toward the home switch
-    //
-    setSpeedInStepsPerSecond(speedInStepsPerSecond);
-    setupRelativeMoveInSteps(maxDistanceToMoveInSteps * directionTowardHome);
-    limitSwitchFlag = false;
-    while(!processMovement())
-    {
- //     digitalWrite(3, HIGH); //turns on when looking for switch (switch is HIGH)
-      if (digitalRead(homeLimitSwitchPin) == LOW)
-      {
-        delay(1);
-        if (digitalRead(homeLimitSwitchPin) == LOW)
-        {
-          delay(80);                // allow time for the switch to debounce
-          limitSwitchFlag = true;
-          delay(100);
-       //   digitalWrite(10, LOW);
-          break;
-        }
-      }
-    }
-    
-    //
-    // check if switch never detected
-    //
-    if (limitSwitchFlag == false)
-      return(false);
+    moveQueueCount = 0;
+    SREG = oldSREG;
+    setupMoveInSteps(absolutePositionToMoveToInSteps);
+    return;
   }
 
-
   //
-  // the switch has been detected, now move away from the switch
+  // the stopping distance the ramp keeps, from the speed it is at now, says whether the
+  // motor can stop at the new target
   //
-  setupRelativeMoveInSteps(maxDistanceToMoveInSteps * directionTowardHome * -1);
-//  digitalWrite(9, HIGH);
-  limitSwitchFlag = false;
-  while(!processMovement())
+  moveQueueCount = 0;
+  distanceAhead = (absolutePositionToMoveToInSteps - currentPosition_InSteps) * direction_Scaler;
+  if (!sCurveRamp && (distanceAhead >= stoppingDistance))
+    targetPosition_InSteps = absolutePositionToMoveToInSteps;
+  else
   {
-    if (digitalRead(homeLimitSwitchPin) == HIGH)
+    targetPosition_InSteps = currentPosition_InSteps + stoppingDistance * direction_Scaler;
+    if (absolutePositionToMoveToInSteps != targetPosition_InSteps)
     {
-      delay(1);
-      if (digitalRead(homeLimitSwitchPin) == HIGH)
-      {
-        delay(80);                // allow time for the switch to debounce
-        limitSwitchFlag = true;
-     //   digitalWrite(10, HIGH);
-        break;
-      }
+      moveQueue_InSteps[moveQueueHead] = absolutePositionToMoveToInSteps;
+      moveQueueCount = 1;
     }
   }
-  
-  //
-  // check if switch never detected
-  //
-  if (limitSwitchFlag == false)
-    return(false);
+  ramp_ExitStoppingDistance_InSteps = planExitStoppingDistance();
+  SREG = oldSREG;
+}
 
 
+
+//
+// change the maximum speed while the motor is running, units in steps/second.  The
+// trapezoid accelerates or decelerates to the new speed and carries on, an S-curve
+// keeps the speed it set out with.  The speed also applies to the moves that follow.
+//  Enter:  speedInStepsPerSecond = speed to change to, units in steps/second
+//
+void SpeedyStepper::setupSpeedChangeInStepsPerSecond(float speedInStepsPerSecond)
+{
+  float stepPeriod_InUS;
+  unsigned long stepPeriod_InUSQ12;
+  unsigned long desiredRampFactor;
+  float rampFactor;
+  long desiredStoppingDistance;
+  byte oldSREG;
+
+  desiredSpeed_InStepsPerSecond = speedInStepsPerSecond;
+
   //
-  // have now moved off the switch, move toward it again but slower
+  // work out the ramp's values for the new speed the same way setupMoveInSteps() does
   //
-  setSpeedInStepsPerSecond(speedInStepsPerSecond/8);
-  setupRelativeMoveInSteps(maxDistanceToMoveInSteps * directionTowardHome);
-  delay(500);
- // digitalWrite(9, LOW);
-  limitSwitchFlag = false;
-  while(!processMovement())
+  stepPeriod_InUS = 1000000.0 / speedInStepsPerSecond;
+  stepPeriod_InUSQ12 = stepPeriodToFixedPoint(stepPeriod_InUS);
+  rampFactor = acceleration_InStepsPerSecondPerSecond / (speedInStepsPerSecond * speedInStepsPerSecond);
+  if (rampFactor * RAMP_FACTOR_ONE >= MAXIMUM_RAMP_FACTOR_Q32)
+    desiredRampFactor = MAXIMUM_RAMP_FACTOR_Q32;
+  else
+    desiredRampFactor = (unsigned long) (rampFactor * RAMP_FACTOR_ONE);
+  desiredStoppingDistance = (long) round((speedInStepsPerSecond * speedInStepsPerSecond) / (2.0 * acceleration_InStepsPerSecondPerSecond));
+
+  oldSREG = SREG;
+  cli();
+  if (!sCurveRamp)
   {
-    if (digitalRead(homeLimitSwitchPin) == LOW)
-    {
-      delay(1);
-      if (digitalRead(homeLimitSwitchPin) == LOW)
-      {    
-        delay(80);                // allow time for the switch to debounce
-        limitSwitchFlag = true;
-      //  digitalWrite(10, LOW);
-        break;
-      }
-    }
+    desiredStepPeriod_InUS = stepPeriod_InUS;
+    desiredStepPeriod_InUSQ12 = stepPeriod_InUSQ12;
+    desiredRampFactor_Q32 = desiredRampFactor;
+    desiredStoppingDistance_InSteps = desiredStoppingDistance;
+    ramp_ExitStoppingDistance_InSteps = planExitStoppingDistance();
   }
-  
-  //
-  // check if switch never detected
-  //
-  if (limitSwitchFlag == false)
-    return(false);
+  SREG = oldSREG;
+}
 
 
+
+//
+// run the motor at a velocity with no end, or ramp a jogging motor to a new velocity.
+// The motor accelerates or decelerates with the acceleration set for it, a change of
+// direction slows to a stop first.  A velocity of 0 stops the motor, as does
+// setupStop(), and so does starting a move.  Call processMovement() from time to time,
+// even for a motor driven by StepperTimer, to keep the motor going.
+//  Enter:  velocityInStepsPerSecond = signed velocity, units in steps/second
+//
+void SpeedyStepper::setupJogInStepsPerSecond(float velocityInStepsPerSecond)
+{
+  long jogTarget_InSteps;
+  byte oldSREG;
+
+  if (velocityInStepsPerSecond == 0.0)
+  {
+    setupStop();
+    return;
+  }
+
   //
-  // successfully homed, set the current position to 0
-  //
-  setCurrentPositionInSteps(0L);
- // digitalWrite(4, HIGH);    
- // delay(1000);
-  //
-  // restore original velocity
+  // change the speed, then send the motor off toward a target too far away to reach
   //
-  setSpeedInStepsPerSecond(originalDesiredSpeed_InStepsPerSecond);
- // digitalWrite(3, LOW);
- // digitalWrite(4, LOW);
-  return(true);
+  setupSpeedChangeInStepsPerSecond(fabs(velocityInStepsPerSecond));
+  if (velocityInStepsPerSecond > 0.0)
+    jogTarget_InSteps = getCurrentPositionInSteps() + JOG_DISTANCE_InSteps;
+  else
+    jogTarget_InSteps = getCurrentPositionInSteps() - JOG_DISTANCE_InSteps;
+  setupRetargetInSteps(jogTarget_InSteps);
+
+  oldSREG = SREG;
+  cli();
+  jogging = true;
+  SREG = oldSREG;
 }
 
 
 
 //
-// move relative to the current position, units are in steps, this function does not return
-// until the move is complete
-//  Enter:  distanceToMoveInSteps = signed distance to move relative to the current position 
-//          in steps
+// check if the motor is jogging
+//  Exit:   true returned if jogging, false if stopped or on a move
 //
-void SpeedyStepper::moveRelativeInSteps(long distanceToMoveInSteps)
+bool SpeedyStepper::isJogging(void)
 {
-  setupRelativeMoveInSteps(distanceToMoveInSteps);
-  
-  while(!processMovement())
-    ;
+  return(jogging);
 }
 
 
 
 //
-// setup a move relative to the current position, units are in steps, no motion occurs until 
-// processMove() is called
+// set the maximum speed, units in steps/second, this is the maximum speed reached while 
+// accelerating
 // Note: this can only be called when the motor is stopped
-//  Enter:  distanceToMoveInSteps = signed distance to move relative to the current position 
-//          in steps
+//  Enter:  speedInStepsPerSecond = speed to accelerate up to, units in steps/second
 //
-void SpeedyStepper::setupRelativeMoveInSteps(long distanceToMoveInSteps)
+void SpeedyStepper::setSpeedInStepsPerSecond(float speedInStepsPerSecond)
 {
-  setupMoveInSteps(currentPosition_InSteps + distanceToMoveInSteps);
+  desiredSpeed_InStepsPerSecond = speedInStepsPerSecond;
 }
 
 
 
 //
-// move to the given absolute position, units are in steps, this function does not return
-// until the move is complete
-//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in units 
-//          of steps
+// set the rate of acceleration, units in steps/second/second
+// Note: this can only be called when the motor is stopped
+//  Enter:  accelerationInStepsPerSecondPerSecond = rate of acceleration, units in 
+//          steps/second/second
 //
-void SpeedyStepper::moveToPositionInSteps(long absolutePositionToMoveToInSteps)
+void SpeedyStepper::setAccelerationInStepsPerSecondPerSecond(float accelerationInStepsPerSecondPerSecond)
 {
-  setupMoveInSteps(absolutePositionToMoveToInSteps);
-  
-  while(!processMovement())
-    ;
+    acceleration_InStepsPerSecondPerSecond = accelerationInStepsPerSecondPerSecond;
 }
 
 
 
 //
-// setup a move, units are in steps, no motion occurs until processMove() is called
+// set the jerk, the rate at which the acceleration changes, units in 
+// steps/second/second/second.  With a jerk the motor follows an S-curve rather than a
+// trapezoid, the acceleration set above becomes the most it reaches.  The S-curve is
+// computed with floats even if useFixedPointRamp() was chosen.
 // Note: this can only be called when the motor is stopped
-//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in 
-//          units of steps
+//  Enter:  jerkInStepsPerSecondPerSecondPerSecond = rate of change of acceleration,
+//          units in steps/second/second/second, 0 for the trapezoid
 //
-void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps)
+void SpeedyStepper::setJerkInStepsPerSecondPerSecondPerSecond(float jerkInStepsPerSecondPerSecondPerSecond)
 {
-  long distanceToTravel_InSteps;
-  
-  
-  //
-  // save the target location
-  //
-  targetPosition_InSteps = absolutePositionToMoveToInSteps;
-  
+  jerk_InStepsPerSecondPerSecondPerSecond = jerkInStepsPerSecondPerSecondPerSecond;
+}
 
-  //
-  // determine the period in US of the first step
-  //
-  ramp_InitialStepPeriod_InUS =  1000000.0 / sqrt(2.0 * acceleration_InStepsPerSecondPerSecond);
-    
-    
-  //
-  // determine the period in US between steps when going at the desired velocity
-  //
-  desiredStepPeriod_InUS = 1000000.0 / desiredSpeed_InStepsPerSecond;
 
 
-  //
+//
+// home the motor by moving until the homing sensor is activated, then set the position to zero
+// with units in steps.  This function does not return until homing is done, see
+// setupHomeInSteps() to home without waiting.
+//  Enter:  directionTowardHome = 1 to move in a positive direction, -1 to move in a negative directions 
+//          speedInStepsPerSecond = speed to accelerate up to while moving toward home, units in steps/second
+//          maxDistanceToMoveInSteps = unsigned maximum distance to move toward home before giving up
+//          homeSwitchPin = pin number of the home switch, switch should be configured to go low when at home
+//  Exit:   true returned if successful, else false
+//
+bool SpeedyStepper::moveToHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, 
+  long maxDistanceToMoveInSteps, int homeLimitSwitchPin)
+{
+  setupHomeInSteps(directionTowardHome, speedInStepsPerSecond, maxDistanceToMoveInSteps, homeLimitSwitchPin);
+
+  while(!processMovement())
+    ;
+
+  return(homingStatus == HOME_STATUS_SUCCEEDED);
+}
+
+
+
+//
+// start homing the motor, no motion occurs until processMovement() is called.  Homing
+// moves toward the switch, backs off it, then comes back to it at 1/8 of the speed and
+// sets the position there to zero.  It goes on a little each time processMovement() is
+// called, which returns true once homing is over, and getHomingStatus() tells how
+// far it has got and whether it succeeded.
+//
+// A switch on an external interrupt pin (2, 3 or 18 - 21 on the Mega) homes in a single
+// pass at full speed instead: the interrupt latches the position at the edge of the
+// switch and starts the motor decelerating to a stop past it, and the position is set
+// so that zero is where the switch went low.  An axis stepped by StepperTimer must have
+// its switch on an interrupt pin, the timer goes on stepping it while loop() is held up
+// and only the interrupt is sure to stop it at the switch.  Homing such an axis against
+// any other pin fails at once.
+//  Enter:  directionTowardHome = 1 to move in a positive direction, -1 to move in a negative directions 
+//          speedInStepsPerSecond = speed to accelerate up to while moving toward home, units in steps/second
+//          maxDistanceToMoveInSteps = unsigned maximum distance to move toward home before giving up
+//          homeSwitchPin = pin number of the home switch, switch should be configured to go low when at home
+//
+void SpeedyStepper::setupHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, 
+  long maxDistanceToMoveInSteps, int homeLimitSwitchPin)
+{
+  //
+  // setup the home switch input pin
+  //
+  pinMode(homeLimitSwitchPin, INPUT_PULLUP);
+
+  //
+  // remember the current speed setting, it is put back when homing is over
+  //
+  homingOriginalSpeed_InStepsPerSecond = desiredSpeed_InStepsPerSecond;
+  homingDirection = directionTowardHome;
+  homingSpeed_InStepsPerSecond = speedInStepsPerSecond;
+  homingMaxDistance_InSteps = maxDistanceToMoveInSteps;
+  homingSwitchPin = homeLimitSwitchPin;
+  homingSwitchSeen = false;
+  homingPaused = false;
+  homingStopping = false;
+  attachLimitSwitch();
+
+  if (timerDriven && (homingInterruptNumber == NOT_AN_INTERRUPT))
+  {
+    finishHoming(HOME_STATUS_FAILED);
+    return;
+  }
+
+  //
+  // if the home switch is already set, start by moving away from it
+  //
+  if (digitalRead(homeLimitSwitchPin) == HIGH)
+    homingStatus = HOME_STATUS_MOVING_TOWARD_SWITCH;
+  else
+    homingStatus = HOME_STATUS_BACKING_OFF_SWITCH;
+  startHomingMove();
+}
+
+
+
+//
+// get how far homing has got
+//  Exit:   HOME_STATUS_IDLE if homing hasn't been started, one of the
+//          HOME_STATUS_... values while homing, then HOME_STATUS_SUCCEEDED or
+//          HOME_STATUS_FAILED once it is over
+//
+byte SpeedyStepper::getHomingStatus(void)
+{
+  return(homingStatus);
+}
+
+
+
+//
+// start the move for the part of homing in homingStatus, with the switch on an
+// interrupt the edge it is looking for stops it
+//
+void SpeedyStepper::startHomingMove(void)
+{
+  byte oldSREG;
+
+  switch(homingStatus)
+  {
+    case HOME_STATUS_MOVING_TOWARD_SWITCH:
+      setSpeedInStepsPerSecond(homingSpeed_InStepsPerSecond);
+      setupRelativeMoveInSteps(homingMaxDistance_InSteps * homingDirection);
+      break;
+
+    case HOME_STATUS_BACKING_OFF_SWITCH:
+      setSpeedInStepsPerSecond(homingSpeed_InStepsPerSecond);
+      setupRelativeMoveInSteps(homingMaxDistance_InSteps * homingDirection * -1);
+      break;
+
+    case HOME_STATUS_APPROACHING_SWITCH_SLOWLY:
+      setSpeedInStepsPerSecond(homingSpeed_InStepsPerSecond / 8);
+      setupRelativeMoveInSteps(homingMaxDistance_InSteps * homingDirection);
+      break;
+  }
+
+  homingStopping = false;
+  oldSREG = SREG;
+  cli();
+  limitSwitchLatched = false;
+  limitSwitchArmed = (homingInterruptNumber != NOT_AN_INTERRUPT);
+  SREG = oldSREG;
+}
+
+
+
+//
+// take homing a step further, called by processMovement() while homing.  The switch
+// has to read the same for HOME_SWITCH_CONFIRM_MS before it counts, and after the
+// motor halts on it the next move waits for the switch and the motor to settle.
+//  Enter:  moveComplete = true if the move for this part of homing has run its full
+//          distance
+//
+void SpeedyStepper::serviceHoming(bool moveComplete)
+{
+  unsigned long currentTime_InMS;
+  int switchLevel;
+  bool latched;
+  unsigned long edgeTime_InUS;
+  byte oldSREG;
+
+  currentTime_InMS = millis();
+
+  //
+  // wait out a pause, then start the next part
+  //
+  if (homingPaused)
+  {
+    if (currentTime_InMS - homingTime_InMS >= homingPause_InMS)
+    {
+      homingPaused = false;
+      startHomingMove();
+    }
+    return;
+  }
+
+  //
+  // check for the switch, it is low on the switch, high off it
+  //
+  if (homingStatus == HOME_STATUS_BACKING_OFF_SWITCH)
+    switchLevel = HIGH;
+  else
+    switchLevel = LOW;
+
+  //
+  // with the switch on an interrupt, the edge it was looking for latched the position
+  // and started the motor decelerating.  Once the switch has stopped bouncing and the
+  // motor has stopped, make the latched position zero, or after backing off the switch
+  // go back toward it.  An edge that doesn't leave the switch where it should be was
+  // noise, the move starts again once the motor has stopped.
+  //
+  if (homingInterruptNumber != NOT_AN_INTERRUPT)
+  {
+    if (homingStopping)
+    {
+      if (!moveComplete)
+        return;
+
+      if (homingStatus == HOME_STATUS_BACKING_OFF_SWITCH)
+      {
+        haltMotion();
+        homingStatus = HOME_STATUS_MOVING_TOWARD_SWITCH;
+        homingPaused = true;
+        homingPause_InMS = HOME_SWITCH_DEBOUNCE_MS;
+        homingTime_InMS = currentTime_InMS;
+        return;
+      }
+      setCurrentPositionInSteps(getCurrentPositionInSteps() - limitSwitchPosition_InSteps);
+      haltMotion();
+      finishHoming(HOME_STATUS_SUCCEEDED);
+      return;
+    }
+
+    oldSREG = SREG;
+    cli();
+    latched = limitSwitchLatched;
+    edgeTime_InUS = limitSwitchEdgeTime_InUS;
+    SREG = oldSREG;
+
+    if (latched)
+    {
+      if (micros() - edgeTime_InUS < LIMIT_SWITCH_DEBOUNCE_US)
+        return;
+
+      if (digitalRead(homingSwitchPin) == switchLevel)
+      {
+        limitSwitchArmed = false;
+        homingStopping = true;
+      }
+      else if (moveComplete)
+        startHomingMove();
+      return;
+    }
+
+    if (moveComplete)
+      finishHoming(HOME_STATUS_FAILED);
+    return;
+  }
+
+  if (digitalRead(homingSwitchPin) == switchLevel)
+  {
+    if (!homingSwitchSeen)
+    {
+      homingSwitchSeen = true;
+      homingTime_InMS = currentTime_InMS;
+      return;
+    }
+    if (currentTime_InMS - homingTime_InMS < HOME_SWITCH_CONFIRM_MS)
+      return;
+
+    haltMotion();
+    homingSwitchSeen = false;
+    homingPaused = true;
+    homingTime_InMS = currentTime_InMS;
+
+    switch(homingStatus)
+    {
+      case HOME_STATUS_MOVING_TOWARD_SWITCH:
+        homingStatus = HOME_STATUS_BACKING_OFF_SWITCH;
+        homingPause_InMS = HOME_SWITCH_DEBOUNCE_MS + HOME_SWITCH_SETTLE_MS;
+        break;
+
+      case HOME_STATUS_BACKING_OFF_SWITCH:
+        homingStatus = HOME_STATUS_APPROACHING_SWITCH_SLOWLY;
+        homingPause_InMS = HOME_SWITCH_DEBOUNCE_MS + HOME_SLOW_APPROACH_PAUSE_MS;
+        break;
+
+      case HOME_STATUS_APPROACHING_SWITCH_SLOWLY:
+        //
+        // successfully homed, set the current position to 0
+        //
+        setCurrentPositionInSteps(0L);
+        haltMotion();
+        finishHoming(HOME_STATUS_SUCCEEDED);
+        break;
+    }
+    return;
+  }
+  homingSwitchSeen = false;
+
+  //
+  // check if switch never detected
+  //
+  if (moveComplete)
+    finishHoming(HOME_STATUS_FAILED);
+}
+
+
+
+//
+// end homing and restore the original velocity
+//  Enter:  homingResult = HOME_STATUS_SUCCEEDED or HOME_STATUS_FAILED
+//
+void SpeedyStepper::finishHoming(byte homingResult)
+{
+  detachLimitSwitch();
+  homingPaused = false;
+  homingStatus = homingResult;
+  setSpeedInStepsPerSecond(homingOriginalSpeed_InStepsPerSecond);
+}
+
+
+
+//
+// if the home switch is on an external interrupt pin, have its edges latch the position
+//
+void SpeedyStepper::attachLimitSwitch(void)
+{
+  static void (*const interruptFunctions[LIMIT_SWITCH_INTERRUPTS])(void) = {
+    limitSwitchInterrupt<0>, limitSwitchInterrupt<1>, limitSwitchInterrupt<2>,
+    limitSwitchInterrupt<3>, limitSwitchInterrupt<4>, limitSwitchInterrupt<5>};
+
+  detachLimitSwitch();
+
+  homingInterruptNumber = digitalPinToInterrupt(homingSwitchPin);
+  if ((homingInterruptNumber < 0) || (homingInterruptNumber >= LIMIT_SWITCH_INTERRUPTS))
+  {
+    homingInterruptNumber = NOT_AN_INTERRUPT;
+    return;
+  }
+
+  limitSwitchArmed = false;
+  limitSwitchLatched = false;
+  limitSwitchSteppers[homingInterruptNumber] = this;
+  attachInterrupt(homingInterruptNumber, interruptFunctions[homingInterruptNumber], CHANGE);
+}
+
+
+
+//
+// stop the home switch interrupt
+//
+void SpeedyStepper::detachLimitSwitch(void)
+{
+  if (homingInterruptNumber == NOT_AN_INTERRUPT)
+    return;
+
+  detachInterrupt(homingInterruptNumber);
+  limitSwitchSteppers[homingInterruptNumber] = NULL;
+  limitSwitchArmed = false;
+  homingInterruptNumber = NOT_AN_INTERRUPT;
+}
+
+
+
+//
+// external interrupt handler, passes the interrupt on to the stepper homing with it
+//
+template <byte interruptNumber> void SpeedyStepper::limitSwitchInterrupt(void)
+{
+  SpeedyStepper *stepper = limitSwitchSteppers[interruptNumber];
+
+  if (stepper != NULL)
+    stepper->latchLimitSwitch();
+}
+
+
+
+//
+// called from the external interrupt on each edge of the home switch.  The first edge
+// that takes the switch low, or high when backing off it, latches the position and
+// starts the motor decelerating, so it stops even while loop() is held up.  Every edge
+// restarts the debounce time.
+//
+void SpeedyStepper::latchLimitSwitch(void)
+{
+  int switchLevel;
+
+  limitSwitchEdgeTime_InUS = micros();
+  if (!limitSwitchArmed || limitSwitchLatched)
+    return;
+
+  if (homingStatus == HOME_STATUS_BACKING_OFF_SWITCH)
+    switchLevel = HIGH;
+  else
+    switchLevel = LOW;
+
+  if (digitalRead(homingSwitchPin) == switchLevel)
+  {
+    limitSwitchPosition_InSteps = currentPosition_InSteps;
+    limitSwitchLatched = true;
+    setupDecelerationToStop();
+  }
+}
+
+
+
+//
+// move relative to the current position, units are in steps, this function does not return
+// until the move is complete
+//  Enter:  distanceToMoveInSteps = signed distance to move relative to the current position 
+//          in steps
+//
+void SpeedyStepper::moveRelativeInSteps(long distanceToMoveInSteps)
+{
+  setupRelativeMoveInSteps(distanceToMoveInSteps);
+  
+  while(!processMovement())
+    ;
+}
+
+
+
+//
+// setup a move relative to the current position, units are in steps, no motion occurs until 
+// processMove() is called
+// Note: this can only be called when the motor is stopped
+//  Enter:  distanceToMoveInSteps = signed distance to move relative to the current position 
+//          in steps
+//
+void SpeedyStepper::setupRelativeMoveInSteps(long distanceToMoveInSteps)
+{
+  setupMoveInSteps(currentPosition_InSteps + distanceToMoveInSteps);
+}
+
+
+
+//
+// move to the given absolute position, units are in steps, this function does not return
+// until the move is complete
+//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in units 
+//          of steps
+//
+void SpeedyStepper::moveToPositionInSteps(long absolutePositionToMoveToInSteps)
+{
+  setupMoveInSteps(absolutePositionToMoveToInSteps);
+  
+  while(!processMovement())
+    ;
+}
+
+
+
+//
+// setup a move, units are in steps, no motion occurs until processMove() is called.
+// A jogging motor stops jogging.
+// Note: this can only be called when the motor is stopped
+//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in 
+//          units of steps
+//
+void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps)
+{
+  byte oldSREG = SREG;
+
+  cli();
+  jogging = false;
+  SREG = oldSREG;
+  startMoveInSteps(absolutePositionToMoveToInSteps);
+}
+
+
+
+//
+// start a move from a stop, for setupMoveInSteps() and for the moves the motor goes on
+// to by itself, such as the next one in the queue of an S-curve.  Those keep a jogging
+// motor jogging, a jog that reverses on an S-curve stops and starts again this way.
+//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in 
+//          units of steps
+//
+void SpeedyStepper::startMoveInSteps(long absolutePositionToMoveToInSteps)
+{
+  long distanceToTravel_InSteps;
+  float initialStepPeriod_InUS;
+  float stepPeriod_InUS;
+  long decelerationDistance;
+  int directionScaler;
+  unsigned long initialStepPeriod_InUSQ12;
+  unsigned long stepPeriod_InUSQ12;
+  unsigned long desiredRampFactor;
+  float rampFactor;
+  long desiredStoppingDistance;
+  bool sCurve;
+  float peakSpeed;
+  float halfDistance;
+  float jerkUpSpeed;
+  float sCurveInitialStepPeriod_InUS;
+  long jerkUpDistance;
+  long constantAccelerationDistance;
+  byte oldSREG;
+  
+
+  //
+  // determine the period in US of the first step
+  //
+  initialStepPeriod_InUS =  1000000.0 / sqrt(2.0 * acceleration_InStepsPerSecondPerSecond);
+    
+    
+  //
+  // determine the period in US between steps when going at the desired velocity
+  //
+  stepPeriod_InUS = 1000000.0 / desiredSpeed_InStepsPerSecond;
+
+
+  //
   // determine the number of steps needed to go from the desired velocity down to a velocity of 0
   // Steps = Velocity^2 / (2 * Accelleration)
   //
-  decelerationDistance_InSteps = (long) round((desiredSpeed_InStepsPerSecond * desiredSpeed_InStepsPerSecond) / (2.0 * acceleration_InStepsPerSecondPerSecond));
+  decelerationDistance = (long) round((desiredSpeed_InStepsPerSecond * desiredSpeed_InStepsPerSecond) / (2.0 * acceleration_InStepsPerSecondPerSecond));
+  desiredStoppingDistance = decelerationDistance;
+
+
+  //
+  // convert the periods for the fixed point ramp.  The ramp factor is acceleration * 
+  // period^2 in steps and us, the ramp starts with a factor of 1/2 at the initial period
+  // and reaches acceleration / speed^2 at the desired speed.
+  //
+  initialStepPeriod_InUSQ12 = stepPeriodToFixedPoint(initialStepPeriod_InUS);
+  stepPeriod_InUSQ12 = stepPeriodToFixedPoint(stepPeriod_InUS);
+  rampFactor = acceleration_InStepsPerSecondPerSecond / (desiredSpeed_InStepsPerSecond * desiredSpeed_InStepsPerSecond);
+  if (rampFactor * RAMP_FACTOR_ONE >= MAXIMUM_RAMP_FACTOR_Q32)
+    desiredRampFactor = MAXIMUM_RAMP_FACTOR_Q32;
+  else
+    desiredRampFactor = (unsigned long) (rampFactor * RAMP_FACTOR_ONE);
   
   
   //
   // determine the distance and direction to travel
   //
+  distanceToTravel_InSteps = absolutePositionToMoveToInSteps - getCurrentPositionInSteps();
+  if (distanceToTravel_InSteps < 0) 
+  {
+    distanceToTravel_InSteps = -distanceToTravel_InSteps;
+    directionScaler = -1;
+  }
+  else
+    directionScaler = 1;
+
+
+  //
+  // with a jerk the move follows an S-curve.  Find the fastest speed it can reach in
+  // the distance, then how far into the move the acceleration stops ramping up, stops
+  // holding at its maximum, and is back to zero at the peak speed.  Deceleration is
+  // the same in reverse.
+  //
+  sCurve = (jerk_InStepsPerSecondPerSecondPerSecond > 0.0);
+  jerkUpDistance = 0;
+  constantAccelerationDistance = 0;
+  if (sCurve)
+  {
+    float acceleration = acceleration_InStepsPerSecondPerSecond;
+    float jerk = jerk_InStepsPerSecondPerSecondPerSecond;
+
+    peakSpeed = desiredSpeed_InStepsPerSecond;
+    halfDistance = distanceToTravel_InSteps / 2.0;
+    if (sCurveAccelerationDistance(peakSpeed, acceleration, jerk) > halfDistance)
+    {
+      peakSpeed = pow(halfDistance * sqrt(jerk), 2.0 / 3.0);
+      if (peakSpeed > acceleration * acceleration / jerk)
+        peakSpeed = (sqrt(acceleration * acceleration / (jerk * jerk) + 8.0 * halfDistance / acceleration) - acceleration / jerk) * acceleration / 2.0;
+    }
+
+    if (peakSpeed >= acceleration * acceleration / jerk)
+    {
+      jerkUpSpeed = acceleration * acceleration / (2.0 * jerk);
+      jerkUpDistance = (long) round(acceleration * acceleration * acceleration / (6.0 * jerk * jerk));
+      constantAccelerationDistance = jerkUpDistance + (long) round(((peakSpeed - jerkUpSpeed) * (peakSpeed - jerkUpSpeed) - jerkUpSpeed * jerkUpSpeed) / (2.0 * acceleration));
+    }
+    else
+    {
+      jerkUpDistance = (long) round(peakSpeed * sqrt(peakSpeed / jerk) / 6.0);
+      constantAccelerationDistance = jerkUpDistance;
+    }
+    decelerationDistance = (long) round(sCurveAccelerationDistance(peakSpeed, acceleration, jerk));
+
+    //
+    // the first step comes when the jerk has moved the motor one step from stopped
+    //
+    sCurveInitialStepPeriod_InUS = 1000000.0 * pow(6.0 / jerk, 1.0 / 3.0);
+    if (sCurveInitialStepPeriod_InUS > initialStepPeriod_InUS)
+      initialStepPeriod_InUS = sCurveInitialStepPeriod_InUS;
+  }
+
+
+  //
+  // check if travel distance is too short to accelerate up to the desired velocity
+  //
+  if (distanceToTravel_InSteps <= (decelerationDistance * 2L))
+    decelerationDistance = (distanceToTravel_InSteps / 2L);
+  if (constantAccelerationDistance > decelerationDistance)
+    constantAccelerationDistance = decelerationDistance;
+  if (jerkUpDistance > constantAccelerationDistance)
+    jerkUpDistance = constantAccelerationDistance;
+
+
+  //
+  // save the new move and start the acceleration ramp at the beginning, all at once so 
+  // that the timer interrupt never sees half of it
+  //
+  oldSREG = SREG;
+  cli();
+  targetPosition_InSteps = absolutePositionToMoveToInSteps;
+  ramp_InitialStepPeriod_InUS = initialStepPeriod_InUS;
+  desiredStepPeriod_InUS = stepPeriod_InUS;
+  decelerationDistance_InSteps = decelerationDistance;
+  direction_Scaler = directionScaler;
+  if (directionScaler < 0)
+    setPortBits(directionPortRegister, directionBitMask);
+  else
+    clearPortBits(directionPortRegister, directionBitMask);
+  ramp_NextStepPeriod_InUS = ramp_InitialStepPeriod_InUS;
+  acceleration_InStepsPerUSPerUS = acceleration_InStepsPerSecondPerSecond / 1E12;
+  desiredStepPeriod_InUSQ12 = stepPeriod_InUSQ12;
+  ramp_InitialStepPeriod_InUSQ12 = initialStepPeriod_InUSQ12;
+  ramp_NextStepPeriod_InUSQ12 = initialStepPeriod_InUSQ12;
+  ramp_NextStepPeriodFraction = 0;
+  ramp_Factor_Q32 = RAMP_FACTOR_ONE_HALF;
+  desiredRampFactor_Q32 = desiredRampFactor;
+  ramp_Decelerating = false;
+  sCurveRamp = sCurve;
+  fixedPointRamp = fixedPointRampSelected && !sCurve;
+  ramp_StepCount = 0;
+  sCurveJerkUpDistance_InSteps = jerkUpDistance;
+  sCurveConstantAccelerationDistance_InSteps = constantAccelerationDistance;
+  sCurveAcceleration_InStepsPerUSPerUS = 0.0;
+  sCurveMaximumAcceleration_InStepsPerUSPerUS = acceleration_InStepsPerSecondPerSecond / 1E12;
+  sCurveJerk_InStepsPerUSPerUSPerUS = jerk_InStepsPerSecondPerSecondPerSecond / 1E18;
+  desiredStoppingDistance_InSteps = desiredStoppingDistance;
+  ramp_StoppingDistance_InSteps = 0;
+  ramp_ExitStoppingDistance_InSteps = planExitStoppingDistance();
+  startNewMove = true;
+  SREG = oldSREG;
+}
+
+
+
+//
+// add a move to the end of the queue, units are in steps.  If the motor is stopped
+// the move starts now, otherwise it starts as the moves ahead of it finish.  Where the
+// moves go the same way the motor carries its speed from one into the next.
+//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in 
+//          units of steps
+//  Exit:   true returned if the move was queued, false if the queue is full
+//
+bool SpeedyStepper::queueMoveInSteps(long absolutePositionToMoveToInSteps)
+{
+  long lastTarget_InSteps;
+  byte oldSREG = SREG;
+
+  cli();
+
+  //
+  // a stopped motor with nothing waiting just starts the move
+  //
+  if ((moveQueueCount == 0) && (currentPosition_InSteps == targetPosition_InSteps))
+  {
+    SREG = oldSREG;
+    setupMoveInSteps(absolutePositionToMoveToInSteps);
+    return(true);
+  }
+
+  if (moveQueueCount >= MOVE_QUEUE_SIZE)
+  {
+    SREG = oldSREG;
+    return(false);
+  }
+
+  //
+  // a move that goes nowhere would only break the run through the moves around it
+  //
+  if (moveQueueCount == 0)
+    lastTarget_InSteps = targetPosition_InSteps;
+  else
+    lastTarget_InSteps = moveQueue_InSteps[(moveQueueHead + moveQueueCount - 1) & (MOVE_QUEUE_SIZE - 1)];
+  if (absolutePositionToMoveToInSteps != lastTarget_InSteps)
+  {
+    moveQueue_InSteps[(moveQueueHead + moveQueueCount) & (MOVE_QUEUE_SIZE - 1)] = absolutePositionToMoveToInSteps;
+    moveQueueCount++;
+    ramp_ExitStoppingDistance_InSteps = planExitStoppingDistance();
+  }
+  SREG = oldSREG;
+  return(true);
+}
+
+
+
+//
+// add a move to the end of the queue, relative to where the move ahead of it ends
+//  Enter:  distanceToMoveInSteps = signed distance to move in units of steps
+//  Exit:   true returned if the move was queued, false if the queue is full
+//
+bool SpeedyStepper::queueRelativeMoveInSteps(long distanceToMoveInSteps)
+{
+  long lastTarget_InSteps;
+  byte oldSREG = SREG;
+
+  cli();
+  if (moveQueueCount == 0)
+    lastTarget_InSteps = targetPosition_InSteps;
+  else
+    lastTarget_InSteps = moveQueue_InSteps[(moveQueueHead + moveQueueCount - 1) & (MOVE_QUEUE_SIZE - 1)];
+  SREG = oldSREG;
+
+  return(queueMoveInSteps(lastTarget_InSteps + distanceToMoveInSteps));
+}
+
+
+
+//
+// get the number of moves waiting in the queue, not counting the one running now
+//  Exit:  number of moves waiting returned
+//
+byte SpeedyStepper::getMoveQueueDepth(void)
+{
+  return(moveQueueCount);
+}
+
+
+
+//
+// work out the speed the running move can leave with, as a stopping distance, by
+// looking back from the end of the queue where the motor has to stop.  A move can be
+// entered as fast as the speed it leaves with plus its length, where the next move goes
+// the other way the motor has to stop between them.
+// Note: call with interrupts off
+//  Exit:   stopping distance in steps at the end of the running move returned
+//
+long SpeedyStepper::planExitStoppingDistance(void)
+{
+  long exitStoppingDistance;
+  long moveStart_InSteps;
+  long moveEnd_InSteps;
+  long moveDistance_InSteps;
+  long previousDirection;
+  byte i;
+
+  exitStoppingDistance = 0;
+  for (i = moveQueueCount; i > 0; i--)
+  {
+    moveEnd_InSteps = moveQueue_InSteps[(moveQueueHead + i - 1) & (MOVE_QUEUE_SIZE - 1)];
+    if (i > 1)
+    {
+      moveStart_InSteps = moveQueue_InSteps[(moveQueueHead + i - 2) & (MOVE_QUEUE_SIZE - 1)];
+      if (i > 2)
+        previousDirection = moveStart_InSteps - moveQueue_InSteps[(moveQueueHead + i - 3) & (MOVE_QUEUE_SIZE - 1)];
+      else
+        previousDirection = moveStart_InSteps - targetPosition_InSteps;
+    }
+    else
+    {
+      moveStart_InSteps = targetPosition_InSteps;
+      previousDirection = direction_Scaler;
+    }
+
+    moveDistance_InSteps = moveEnd_InSteps - moveStart_InSteps;
+    if ((moveDistance_InSteps > 0) != (previousDirection > 0))
+      exitStoppingDistance = 0;
+    else
+    {
+      exitStoppingDistance += labs(moveDistance_InSteps);
+      if (exitStoppingDistance > desiredStoppingDistance_InSteps)
+        exitStoppingDistance = desiredStoppingDistance_InSteps;
+    }
+  }
+
+  return(exitStoppingDistance);
+}
+
+
+
+//
+// start the next move in the queue on the step that finishes the running one, carrying
+// on at the speed the ramp is at.  The ramp starts over from stopped if the motor
+// did stop, which it does where the move goes the other way.
+// Note: call with interrupts off, only the trapezoid ramp runs through queued moves
+//
+void SpeedyStepper::startQueuedMove(void)
+{
+  long distanceToTravel_InSteps;
+
+  targetPosition_InSteps = moveQueue_InSteps[moveQueueHead];
+  moveQueueHead = (moveQueueHead + 1) & (MOVE_QUEUE_SIZE - 1);
+  moveQueueCount--;
+
   distanceToTravel_InSteps = targetPosition_InSteps - currentPosition_InSteps;
-  if (distanceToTravel_InSteps < 0) 
+  if (distanceToTravel_InSteps < 0)
   {
-    distanceToTravel_InSteps = -distanceToTravel_InSteps;
     direction_Scaler = -1;
-    digitalWrite(directionPin, HIGH);
+    setPortBits(directionPortRegister, directionBitMask);
   }
   else
   {
     direction_Scaler = 1;
-    digitalWrite(directionPin, LOW);
+    clearPortBits(directionPortRegister, directionBitMask);
   }
 
+  if (ramp_StoppingDistance_InSteps == 0)
+  {
+    if (ramp_Decelerating)
+    {
+      acceleration_InStepsPerUSPerUS = -acceleration_InStepsPerUSPerUS;
+      ramp_Decelerating = false;
+    }
+    ramp_NextStepPeriod_InUS = ramp_InitialStepPeriod_InUS;
+    ramp_NextStepPeriod_InUSQ12 = ramp_InitialStepPeriod_InUSQ12;
+    ramp_NextStepPeriodFraction = 0;
+    ramp_Factor_Q32 = RAMP_FACTOR_ONE_HALF;
+  }
 
-  //
-  // check if travel distance is too short to accelerate up to the desired velocity
-  //
-  if (distanceToTravel_InSteps <= (decelerationDistance_InSteps * 2L))
-    decelerationDistance_InSteps = (distanceToTravel_InSteps / 2L);
+  ramp_ExitStoppingDistance_InSteps = planExitStoppingDistance();
+}
 
 
-  //
-  // start the acceleration ramp at the beginning
-  //
-  ramp_NextStepPeriod_InUS = ramp_InitialStepPeriod_InUS;
-  acceleration_InStepsPerUSPerUS = acceleration_InStepsPerSecondPerSecond / 1E12;
-  startNewMove = true;
+
+//
+// if it is time, move one step, and take homing further if it was started with
+// setupHomeInSteps()
+//  Exit:  true returned if movement complete, false returned not a final target position yet
+//         or still homing
+//
+bool SpeedyStepper::processMovement(void)
+{ 
+  bool moveComplete;
+
+  moveComplete = processSteps();
+
+  if ((homingStatus >= HOME_STATUS_MOVING_TOWARD_SWITCH) && (homingStatus <= HOME_STATUS_APPROACHING_SWITCH_SLOWLY))
+  {
+    serviceHoming(moveComplete);
+    return(homingStatus > HOME_STATUS_APPROACHING_SWITCH_SLOWLY);
+  }
+
+  return(moveComplete);
 }
 
 
@@ -994,29 +2072,57 @@ void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps)
 // if it is time, move one step
 //  Exit:  true returned if movement complete, false returned not a final target position yet
 //
-bool SpeedyStepper::processMovement(void)
+bool SpeedyStepper::processSteps(void)
 { 
   unsigned long currentTime_InUS;
   unsigned long periodSinceLastStep_InUS;
-  long distanceToTarget_InSteps;
+  long nextTarget_InSteps;
+  byte oldSREG;
+
+  //
+  // an S-curve stops at the end of each move, start the next one in the queue
+  //
+  if (sCurveRamp && (moveQueueCount > 0) && (getCurrentPositionInSteps() == targetPosition_InSteps))
+  {
+    oldSREG = SREG;
+    cli();
+    nextTarget_InSteps = moveQueue_InSteps[moveQueueHead];
+    moveQueueHead = (moveQueueHead + 1) & (MOVE_QUEUE_SIZE - 1);
+    moveQueueCount--;
+    SREG = oldSREG;
+    startMoveInSteps(nextTarget_InSteps);
+  }
+
+  //
+  // move the target of a jogging motor on before it gets near enough to slow down for,
+  // not while it is stopping to change direction
+  //
+  if (jogging && (moveQueueCount == 0))
+  {
+    oldSREG = SREG;
+    cli();
+    if ((targetPosition_InSteps - currentPosition_InSteps) * direction_Scaler < JOG_DISTANCE_InSteps / 2)
+      targetPosition_InSteps += direction_Scaler * (JOG_DISTANCE_InSteps / 2);
+    SREG = oldSREG;
+  }
 
-  digitalWrite(10, HIGH);
-  delay(2000);
+  //
+  // a stepper driven by StepperTimer steps itself, only report if it has finished
+  //
+  if (timerDriven)
+    return(motionComplete());
 
   //
   // check if already at the target position
   //
-  if (currentPosition_InSteps == targetPosition_InSteps) { //if it is at home
-    digitalWrite(10, LOW);
+  if (currentPosition_InSteps == targetPosition_InSteps)
     return(true);
-  }
 
   //
   // check if this is the first call to start this new move
   //
   if (startNewMove)
   {
-    digitalWrite(4, HIGH);   
     ramp_LastStepTime_InUS = micros();
     startNewMove = false;
   }
@@ -1031,10 +2137,129 @@ bool SpeedyStepper::processMovement(void)
   //
   // if it is not time for the next step, return
   //
-  if (periodSinceLastStep_InUS < (unsigned long) ramp_NextStepPeriod_InUS) {
+  if (fixedPointRamp)
+  {
+    if (periodSinceLastStep_InUS < (ramp_NextStepPeriod_InUSQ12 >> STEP_PERIOD_FRACTION_BITS))
+      return(false);
+  }
+  else
+  {
+    AVR_CYCLES(FLOAT_PERIOD_CONVERSION_CYCLES);
+    if (periodSinceLastStep_InUS < (unsigned long) ramp_NextStepPeriod_InUS)
+      return(false);
+  }
+
+  //
+  // step and update the acceleration ramp
+  //
+  takeStep();
+  ramp_LastStepTime_InUS = currentTime_InUS;
+ 
+  //
+  // check if the move has reached its final target position, return true if all done,
+  // an S-curve with more moves queued starts the next one on the following call
+  //
+  if (currentPosition_InSteps == targetPosition_InSteps)
+    return(moveQueueCount == 0);
     
-    return(false);
+  return(false);
+}
+
+
+
+//
+// stop at once without decelerating, the same as a polled move does when the caller
+// stops calling processMovement()
+//
+void SpeedyStepper::haltMotion(void)
+{
+  byte oldSREG = SREG;
+
+  cli();
+  targetPosition_InSteps = currentPosition_InSteps;
+  currentStepPeriod_InUS = 0.0;
+  currentStepPeriod_InUSQ12 = 0;
+  ramp_StoppingDistance_InSteps = 0;
+  moveQueueCount = 0;
+  jogging = false;
+  SREG = oldSREG;
+}
+
+
+
+//
+// move one step toward the target and compute the period until the next step, called
+// through takeStep() when it is time for the step.  This one writes the step pin
+// through the port register that connectToPins() found.
+//  Enter:  stepper -> the stepper to step
+//
+void SpeedyStepper::takeStepOnPins(SpeedyStepper *stepper)
+{
+  //
+  // execute the step on the rising edge
+  //
+  setPortBits(stepper->stepPortRegister, stepper->stepBitMask);
+  delayMicroseconds(2);        // set to almost nothing because there is so much code between rising and falling edges
+
+  stepper->advanceOneStep();
+
+  //
+  // return the step line low
+  //
+  clearPortBits(stepper->stepPortRegister, stepper->stepBitMask);
+}
+
+
+
+//
+// the same as takeStepOnPins() for the step pin of a DPEA board port, the register
+// and bit are constants so a step pin in the IO space is written with a single sbi /
+// cbi instruction, which also can't be interrupted
+//  Enter:  stepper -> the stepper to step
+//
+template <byte stepperMotorNumber>
+void SpeedyStepper::takeStepOnBoardPort(SpeedyStepper *stepper)
+{
+  typedef BoardStepPin<stepperMotorNumber> StepPin;
+
+  //
+  // execute the step on the rising edge
+  //
+  if (StepPin::IN_IO_SPACE)
+  {
+    StepPin::portRegister() |= StepPin::BIT_MASK;
+    AVR_CYCLES(IO_PORT_WRITE_CYCLES);
+  }
+  else
+    setPortBits(&StepPin::portRegister(), StepPin::BIT_MASK);
+  delayMicroseconds(2);        // set to almost nothing because there is so much code between rising and falling edges
+
+  stepper->advanceOneStep();
+
+  //
+  // return the step line low
+  //
+  if (StepPin::IN_IO_SPACE)
+  {
+    StepPin::portRegister() &= ~StepPin::BIT_MASK;
+    AVR_CYCLES(IO_PORT_WRITE_CYCLES);
   }
+  else
+    clearPortBits(&StepPin::portRegister(), StepPin::BIT_MASK);
+}
+
+
+
+//
+// update the position and the acceleration ramp for a step, without touching the step
+// line.  StepperTimer calls this directly when it pulses the step lines of several
+// axes at once.
+//
+void SpeedyStepper::advanceOneStep(void)
+{
+  long distanceToTarget_InSteps;
+  bool decelerate;
+  byte oldSREG;
 
   //
   // determine the distance from the current position to the target
@@ -1045,64 +2270,245 @@ bool SpeedyStepper::processMovement(void)
   }
 
   //
-  // test if it is time to start decelerating, if so change from accelerating to decelerating
-  //
-  if (distanceToTarget_InSteps == decelerationDistance_InSteps)
-    acceleration_InStepsPerUSPerUS = -acceleration_InStepsPerUSPerUS;
-  
-  //
-  // execute the step on the rising edge
+  // test if it is time to start decelerating, if so change from accelerating to
+  // decelerating.  The trapezoid decelerates once the distance left is what it takes to
+  // slow from the speed now to the speed it leaves the move with, or while it is going
+  // faster than a new lower speed, and goes back to accelerating if a move queued since
+  // lets it leave faster.
   //
-  digitalWrite(9, HIGH);
-  digitalWrite(stepPin, HIGH);
+  if (sCurveRamp)
+  {
+    if (distanceToTarget_InSteps == decelerationDistance_InSteps)
+    {
+      acceleration_InStepsPerUSPerUS = -acceleration_InStepsPerUSPerUS;
+      ramp_Decelerating = !ramp_Decelerating;
+    }
+  }
+  else
+  {
+    decelerate = (distanceToTarget_InSteps <= ramp_StoppingDistance_InSteps - ramp_ExitStoppingDistance_InSteps) ||
+                 (ramp_StoppingDistance_InSteps > desiredStoppingDistance_InSteps);
+    if (decelerate != ramp_Decelerating)
+    {
+      acceleration_InStepsPerUSPerUS = -acceleration_InStepsPerUSPerUS;
+      ramp_Decelerating = decelerate;
+    }
 
-  delay(2000);
+    if (decelerate)
+    {
+      if (ramp_StoppingDistance_InSteps > 0)
+        ramp_StoppingDistance_InSteps--;
+    }
+    else if (ramp_StoppingDistance_InSteps < desiredStoppingDistance_InSteps)
+      ramp_StoppingDistance_InSteps++;
+  }
 
-  delayMicroseconds(2);        // set to almost nothing because there is so much code between rising and falling edges
-  digitalWrite(9, LOW);
   //
-  // update the current position and speed
+  // update the current position.  The timer runs this with interrupts on, so the home
+  // switch interrupt is kept from latching the position halfway through the update.
   //
+  oldSREG = SREG;
+  cli();
   currentPosition_InSteps += direction_Scaler;
-  currentStepPeriod_InUS = ramp_NextStepPeriod_InUS;
+  SREG = oldSREG;
 
 
   //
-  // compute the period for the next step
-  // StepPeriodInUS = LastStepPeriodInUS * (1 - AccelerationInStepsPerUSPerUS * LastStepPeriodInUS^2)
+  // update the speed and compute the period for the next step, clipping the speed so that
+  // it does not accelerate beyond the desired velocity
   //
-  ramp_NextStepPeriod_InUS = ramp_NextStepPeriod_InUS * (1.0 - acceleration_InStepsPerUSPerUS * ramp_NextStepPeriod_InUS * ramp_NextStepPeriod_InUS);
+  if (sCurveRamp)
+  {
+    currentStepPeriod_InUS = ramp_NextStepPeriod_InUS;
+    computeNextSCurveStepPeriod(distanceToTarget_InSteps - 1);
+  }
+  else if (fixedPointRamp)
+  {
+    currentStepPeriod_InUSQ12 = ramp_NextStepPeriod_InUSQ12;
+    computeNextFixedPointStepPeriod();
+  }
+  else
+  {
+    //
+    // StepPeriodInUS = LastStepPeriodInUS * (1 - AccelerationInStepsPerUSPerUS * LastStepPeriodInUS^2)
+    //
+    currentStepPeriod_InUS = ramp_NextStepPeriod_InUS;
+    ramp_NextStepPeriod_InUS = ramp_NextStepPeriod_InUS * (1.0 - acceleration_InStepsPerUSPerUS * ramp_NextStepPeriod_InUS * ramp_NextStepPeriod_InUS);
+    if (!ramp_Decelerating && (ramp_NextStepPeriod_InUS < desiredStepPeriod_InUS))
+      ramp_NextStepPeriod_InUS = desiredStepPeriod_InUS;
+    AVR_CYCLES(FLOAT_RAMP_STEP_CYCLES);
+  }
 
 
   //
-  // return the step line high
+  // the motor is stopped once it gets to the target, unless there is another move in
+  // the queue to run on into
   //
-  digitalWrite(stepPin, LOW);
- 
- 
+  if (currentPosition_InSteps == targetPosition_InSteps)
+  {
+    if ((moveQueueCount > 0) && !sCurveRamp)
+      startQueuedMove();
+    else
+    {
+      currentStepPeriod_InUS = 0.0;
+      currentStepPeriod_InUSQ12 = 0;
+    }
+  }
+}
+
+
+
+//
+// compute the period for the next step with fixed point integers.  This is the same
+// recurrence as the float ramp, written in terms of the ramp factor
+// F = Acceleration * StepPeriod^2 (steps and us):
+//          NextStepPeriod = StepPeriod * (1 - F)
+//          NextF = F * (1 - F)^2
+// When decelerating 1 - F becomes 1 + F.  Keeping F from step to step, rather than
+// squaring the period, needs just three 32 bit multiplies and no divides.  The period
+// carries 32 more fraction bits from step to step, without them the rounding of the
+// small change in period each step adds up over a long ramp.
+//
+void SpeedyStepper::computeNextFixedPointStepPeriod(void)
+{
+  unsigned long factor;
+  unsigned long factorSquared;
+  unsigned long factorGrowth_Q30;
+  unsigned long long period;
+  unsigned long long periodChange;
+  unsigned long long nextFactor;
+
+  factor = ramp_Factor_Q32;
+  factorSquared = multiplyByFraction(factor, factor);
+  period = ((unsigned long long) ramp_NextStepPeriod_InUSQ12 << 32) | ramp_NextStepPeriodFraction;
+  periodChange = (unsigned long long) ramp_NextStepPeriod_InUSQ12 * factor;
+
   //
-  // clip the speed so that it does not accelerate beyond the desired velocity
+  // (1 -/+ F)^2 = 1 -/+ 2F + F^2, with 30 fraction bits so that it can go up to 4
   //
-  if (ramp_NextStepPeriod_InUS < desiredStepPeriod_InUS)
-    ramp_NextStepPeriod_InUS = desiredStepPeriod_InUS;
+  if (!ramp_Decelerating)
+  {
+    period -= periodChange;
+    factorGrowth_Q30 = RAMP_GROWTH_ONE_Q30 - ((factor >> 1) + (factor & 1)) + ((factorSquared >> 2) + ((factorSquared >> 1) & 1));
+  }
+  else
+  {
+    if (period > MAXIMUM_STEP_PERIOD_InUSQ44 - periodChange)
+      period = MAXIMUM_STEP_PERIOD_InUSQ44;
+    else
+      period += periodChange;
+    factorGrowth_Q30 = RAMP_GROWTH_ONE_Q30 + ((factor >> 1) + (factor & 1)) + ((factorSquared >> 2) + ((factorSquared >> 1) & 1));
+  }
 
+  nextFactor = ((unsigned long long) factor * factorGrowth_Q30 + RAMP_GROWTH_ONE_HALF_Q30) >> 30;
+  if (nextFactor > MAXIMUM_RAMP_FACTOR_Q32)
+    nextFactor = MAXIMUM_RAMP_FACTOR_Q32;
+
+  ramp_NextStepPeriod_InUSQ12 = (unsigned long) (period >> 32);
+  ramp_NextStepPeriodFraction = (unsigned long) period;
+  ramp_Factor_Q32 = (unsigned long) nextFactor;
 
   //
-  // update the acceleration ramp
+  // clip the speed so that it does not accelerate beyond the desired velocity, while
+  // slowing to a new lower speed it is still above it
   //
-  ramp_LastStepTime_InUS = currentTime_InUS;
- 
- 
+  if (!ramp_Decelerating && (ramp_NextStepPeriod_InUSQ12 < desiredStepPeriod_InUSQ12))
+  {
+    ramp_NextStepPeriod_InUSQ12 = desiredStepPeriod_InUSQ12;
+    ramp_NextStepPeriodFraction = 0;
+    ramp_Factor_Q32 = desiredRampFactor_Q32;
+  }
+
+  AVR_CYCLES(FIXED_POINT_RAMP_STEP_CYCLES);
+}
+
+
+
+//
+// compute the period for the next step of an S-curve.  The acceleration changes by
+// Jerk * StepPeriod each step while it ramps, then the period follows the same
+// recurrence as the trapezoid:
+//          NextStepPeriod = StepPeriod * (1 - Acceleration * StepPeriod^2)
+// Where the acceleration ramps up or down was worked out when the move was set up, so
+// each step only compares its distance with those points, which is one multiply more
+// than the trapezoid.
+//  Enter:  distanceToTarget_InSteps = steps left to go after this step
+//
+void SpeedyStepper::computeNextSCurveStepPeriod(long distanceToTarget_InSteps)
+{
+  float acceleration;
+  float jerkChange;
+  float rampFactor;
+
+  acceleration = sCurveAcceleration_InStepsPerUSPerUS;
+  jerkChange = sCurveJerk_InStepsPerUSPerUSPerUS * ramp_NextStepPeriod_InUS;
+  ramp_StepCount++;
+
+  if (!ramp_Decelerating)
+  {
+    //
+    // accelerating: ramp the acceleration up, hold it, then ramp it down to reach the
+    // peak speed
+    //
+    if (ramp_StepCount < sCurveJerkUpDistance_InSteps)
+    {
+      acceleration += jerkChange;
+      if (acceleration > sCurveMaximumAcceleration_InStepsPerUSPerUS)
+        acceleration = sCurveMaximumAcceleration_InStepsPerUSPerUS;
+    }
+    else if (ramp_StepCount < sCurveConstantAccelerationDistance_InSteps)
+      acceleration = sCurveMaximumAcceleration_InStepsPerUSPerUS;
+    else if (ramp_StepCount < decelerationDistance_InSteps)
+    {
+      acceleration -= jerkChange;
+      if (acceleration < 0.0)
+        acceleration = 0.0;
+    }
+    else
+      acceleration = 0.0;
+  }
+  else
+  {
+    //
+    // decelerating: the same steps in reverse, counted back from the target
+    //
+    if (distanceToTarget_InSteps >= sCurveConstantAccelerationDistance_InSteps)
+    {
+      acceleration -= jerkChange;
+      if (acceleration < -sCurveMaximumAcceleration_InStepsPerUSPerUS)
+        acceleration = -sCurveMaximumAcceleration_InStepsPerUSPerUS;
+    }
+    else if (distanceToTarget_InSteps >= sCurveJerkUpDistance_InSteps)
+      acceleration = -sCurveMaximumAcceleration_InStepsPerUSPerUS;
+    else
+    {
+      acceleration += jerkChange;
+      if (acceleration > 0.0)
+        acceleration = 0.0;
+    }
+  }
+
+  rampFactor = acceleration * ramp_NextStepPeriod_InUS * ramp_NextStepPeriod_InUS;
+  if (rampFactor > MAXIMUM_SCURVE_RAMP_FACTOR)
+    rampFactor = MAXIMUM_SCURVE_RAMP_FACTOR;
+  ramp_NextStepPeriod_InUS = ramp_NextStepPeriod_InUS * (1.0 - rampFactor);
+
   //
-  // check if the move has reached its final target position, return true if all done
+  // clip the speed so that it does not accelerate beyond the desired velocity, a motor
+  // held there isn't accelerating, nor slow below the speed of the first step while it
+  // decelerates
   //
-  if (currentPosition_InSteps == targetPosition_InSteps)
+  if (ramp_NextStepPeriod_InUS < desiredStepPeriod_InUS)
   {
-    currentStepPeriod_InUS = 0.0;
-    return(true);
+    ramp_NextStepPeriod_InUS = desiredStepPeriod_InUS;
+    if (acceleration > 0.0)
+      acceleration = 0.0;
   }
-    
-  return(false);
+  if (ramp_NextStepPeriod_InUS > ramp_InitialStepPeriod_InUS)
+    ramp_NextStepPeriod_InUS = ramp_InitialStepPeriod_InUS;
+  sCurveAcceleration_InStepsPerUSPerUS = acceleration;
+
+  AVR_CYCLES(FLOAT_SCURVE_STEP_CYCLES);
 }
 
 
@@ -1119,14 +2525,24 @@ bool SpeedyStepper::processMovement(void)
 //
 float SpeedyStepper::getCurrentVelocityInStepsPerSecond()
 {
-  if (currentStepPeriod_InUS == 0.0)
+  float stepPeriod_InUS;
+  byte oldSREG = SREG;
+
+  cli();
+  if (fixedPointRamp)
+    stepPeriod_InUS = currentStepPeriod_InUSQ12 / STEP_PERIOD_ONE;
+  else
+    stepPeriod_InUS = currentStepPeriod_InUS;
+  SREG = oldSREG;
+
+  if (stepPeriod_InUS == 0.0)
     return(0);
   else
   {
     if (direction_Scaler > 0)
-      return(1000000.0 / currentStepPeriod_InUS);
+      return(1000000.0 / stepPeriod_InUS);
     else
-      return(-1000000.0 / currentStepPeriod_InUS);
+      return(-1000000.0 / stepPeriod_InUS);
   }
 }
 
@@ -1134,14 +2550,17 @@ float SpeedyStepper::getCurrentVelocityInStepsPerSecond()
 
 //
 // check if the motor has competed its move to the target position
-//  Exit:  true returned if the stepper is at the target position
+//  Exit:  true returned if the stepper is at the target position with no moves queued
 //
 bool SpeedyStepper::motionComplete()
 {
-  if (currentPosition_InSteps == targetPosition_InSteps)
-    return(true);
-  else
-    return(false);
+  bool complete;
+  byte oldSREG = SREG;
+
+  cli();
+  complete = (currentPosition_InSteps == targetPosition_InSteps) && (moveQueueCount == 0);
+  SREG = oldSREG;
+  return(complete);
 }
 
 // -------------------------------------- End --------------------------------------
@@ -15,6 +15,40 @@
 #include <stdlib.h>
 
 
+//
+// the host simulation defines this to charge the virtual clock for arithmetic that
+// takes many AVR clock cycles, on the board it compiles to nothing
+//
+#ifndef AVR_CYCLES
+#define AVR_CYCLES(cycles)
+#endif
+
+
+//
+// AVR clock cycles to set or clear port bits with interrupts held off, and to set or
+// clear a bit in the IO space with a single sbi / cbi instruction
+//
+const byte PORT_WRITE_CYCLES = 8;
+const byte IO_PORT_WRITE_CYCLES = 2;
+
+
+//
+// number of moves that can wait in the queue of each stepper, a power of 2
+//
+const byte MOVE_QUEUE_SIZE = 8;
+
+
+//
+// progress of homing, from getHomingStatus()
+//
+const byte HOME_STATUS_IDLE = 0;
+const byte HOME_STATUS_MOVING_TOWARD_SWITCH = 1;
+const byte HOME_STATUS_BACKING_OFF_SWITCH = 2;
+const byte HOME_STATUS_APPROACHING_SWITCH_SLOWLY = 3;
+const byte HOME_STATUS_SUCCEEDED = 4;
+const byte HOME_STATUS_FAILED = 5;
+
+
 //
 // the SpeedyStepper class
 //
@@ -55,30 +89,121 @@ class SpeedyStepper
 
     void enableStepper(void);
     void disableStepper(void);
+    void useFixedPointRamp(bool fixedPoint);
     void setCurrentPositionInSteps(long currentPositionInSteps);
     long getCurrentPositionInSteps();
     void setupStop();
+    void setupRetargetInSteps(long absolutePositionToMoveToInSteps);
+    void setupSpeedChangeInStepsPerSecond(float speedInStepsPerSecond);
+    void setupJogInStepsPerSecond(float velocityInStepsPerSecond);
+    bool isJogging(void);
     void setSpeedInStepsPerSecond(float speedInStepsPerSecond);
     void setAccelerationInStepsPerSecondPerSecond(float accelerationInStepsPerSecondPerSecond);
+    void setJerkInStepsPerSecondPerSecondPerSecond(float jerkInStepsPerSecondPerSecondPerSecond);
     bool moveToHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeSwitchPin);
+    void setupHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeSwitchPin);
+    byte getHomingStatus(void);
     void moveRelativeInSteps(long distanceToMoveInSteps);
     void setupRelativeMoveInSteps(long distanceToMoveInSteps);
     void moveToPositionInSteps(long absolutePositionToMoveToInSteps);
     void setupMoveInSteps(long absolutePositionToMoveToInSteps);
+    bool queueMoveInSteps(long absolutePositionToMoveToInSteps);
+    bool queueRelativeMoveInSteps(long distanceToMoveInSteps);
+    byte getMoveQueueDepth(void);
     bool motionComplete();
     float getCurrentVelocityInStepsPerSecond(); 
     bool processMovement(void);
 
 
   private:
+    //
+    // StepperTimer runs the ramp from its timer ISR, StepperGroup steps its axes along
+    // with its own ramp
+    //
+    friend class StepperTimer;
+    friend class StepperGroup;
+
+    //
+    // private functions
+    //
+    void advanceOneStep(void);
+    bool processSteps(void);
+    void serviceHoming(bool moveComplete);
+    void startHomingMove(void);
+    void finishHoming(byte homingResult);
+    void setupDecelerationToStop(void);
+    long planSCurveStop(void);
+    void startMoveInSteps(long absolutePositionToMoveToInSteps);
+
+    //
+    // a home switch on an external interrupt pin latches the position at its edge and
+    // starts the stop there, limitSwitchInterrupt() passes the interrupt on to the
+    // stepper homing with it
+    //
+    template <byte interruptNumber> static void limitSwitchInterrupt(void);
+    void attachLimitSwitch(void);
+    void detachLimitSwitch(void);
+    void latchLimitSwitch(void);
+
+    //
+    // pulse the step line and update the ramp, through the pin's port register found
+    // by connectToPins(), or through the constant register of a DPEA board port chosen
+    // by connectToPort()
+    //
+    typedef void StepFunction(SpeedyStepper *stepper);
+    static void takeStepOnPins(SpeedyStepper *stepper);
+    template <byte stepperMotorNumber> static void takeStepOnBoardPort(SpeedyStepper *stepper);
+
+    inline void takeStep(void)
+    {
+      stepFunction(this);
+    }
+    void computeNextFixedPointStepPeriod(void);
+    void computeNextSCurveStepPeriod(long distanceToTarget_InSteps);
+    void startQueuedMove(void);
+    long planExitStoppingDistance(void);
+    void haltMotion(void);
+
+    //
+    // set or clear bits of an output port, the interrupts are held off so that an ISR
+    // writing other bits of the same port in the middle can't be undone
+    //
+    static inline void setPortBits(volatile uint8_t *portRegister, byte bitMask)
+    {
+      byte oldSREG = SREG;
+
+      cli();
+      *portRegister |= bitMask;
+      SREG = oldSREG;
+      AVR_CYCLES(PORT_WRITE_CYCLES);
+    }
+
+    static inline void clearPortBits(volatile uint8_t *portRegister, byte bitMask)
+    {
+      byte oldSREG = SREG;
+
+      cli();
+      *portRegister &= ~bitMask;
+      SREG = oldSREG;
+      AVR_CYCLES(PORT_WRITE_CYCLES);
+    }
+
     //
     // private member variables
     //
+    bool timerDriven;
+    bool jogging;
+    StepFunction *stepFunction;
     byte stepPin;
     byte directionPin;
     byte enablePin;
+    volatile uint8_t *stepPortRegister;
+    byte stepBitMask;
+    volatile uint8_t *directionPortRegister;
+    byte directionBitMask;
     float desiredSpeed_InStepsPerSecond;
     float acceleration_InStepsPerSecondPerSecond;
+    float jerk_InStepsPerSecondPerSecondPerSecond;
     long targetPosition_InSteps;
     float stepsPerMillimeter;
     float stepsPerRevolution;
@@ -87,11 +212,54 @@ class SpeedyStepper
     long decelerationDistance_InSteps;
     int direction_Scaler;
     float ramp_InitialStepPeriod_InUS;
+    unsigned long ramp_InitialStepPeriod_InUSQ12;
     float ramp_NextStepPeriod_InUS;
     unsigned long ramp_LastStepTime_InUS;
     float acceleration_InStepsPerUSPerUS;
     float currentStepPeriod_InUS;
     long currentPosition_InSteps;
+
+    bool fixedPointRampSelected;
+    bool fixedPointRamp;
+    bool ramp_Decelerating;
+    unsigned long desiredStepPeriod_InUSQ12;
+    unsigned long ramp_NextStepPeriod_InUSQ12;
+    unsigned long ramp_NextStepPeriodFraction;
+    unsigned long currentStepPeriod_InUSQ12;
+    unsigned long ramp_Factor_Q32;
+    unsigned long desiredRampFactor_Q32;
+
+    bool sCurveRamp;
+    long ramp_StepCount;
+    long sCurveJerkUpDistance_InSteps;
+    long sCurveConstantAccelerationDistance_InSteps;
+    float sCurveAcceleration_InStepsPerUSPerUS;
+    float sCurveMaximumAcceleration_InStepsPerUSPerUS;
+    float sCurveJerk_InStepsPerUSPerUSPerUS;
+
+    long desiredStoppingDistance_InSteps;
+    long ramp_StoppingDistance_InSteps;
+    long ramp_ExitStoppingDistance_InSteps;
+    long moveQueue_InSteps[MOVE_QUEUE_SIZE];
+    byte moveQueueHead;
+    byte moveQueueCount;
+
+    byte homingStatus;
+    bool homingPaused;
+    bool homingSwitchSeen;
+    unsigned long homingTime_InMS;
+    unsigned long homingPause_InMS;
+    long homingDirection;
+    float homingSpeed_InStepsPerSecond;
+    float homingOriginalSpeed_InStepsPerSecond;
+    long homingMaxDistance_InSteps;
+    int homingSwitchPin;
+    int homingInterruptNumber;
+    bool homingStopping;
+    volatile bool limitSwitchArmed;
+    volatile bool limitSwitchLatched;
+    volatile long limitSwitchPosition_InSteps;
+    volatile unsigned long limitSwitchEdgeTime_InUS;
 };
 
 // ------------------------------------ End ---------------------------------
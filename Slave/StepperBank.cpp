@@ -0,0 +1,260 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                          StepperBank                           *
+//      *                                                                *
+//      *            The six stepper axes of the board, by number        *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The callables name a motor by its port number on the board.  Rather than a global
+// SpeedyStepper for each port and a switch on the number in every callable, the bank
+// keeps the six steppers in one array and looks an axis up by indexing it.  A number
+// that is out of range gives NULL, so a bad packet can't move the wrong motor.
+//
+// The bank also keeps one bit per axis that is moving, so that service() can run
+// through just the moving axes in a single loop from loop().  Axes that are attached
+// to StepperTimer step themselves, for them service() only notices that the move has
+// finished.
+//
+// Usage:
+//    Set up the axes in setup():
+//        stepperBank.getAxis(2)->connectToPort(2);
+//
+//    Start moves from a callable, or queue them behind the moves already running:
+//        stepperBank.startRelativeMove(axisNumber, steps);
+//        stepperBank.queueRelativeMove(axisNumber, steps);
+//
+//    Home an axis, getAxis(axisNumber)->getHomingStatus() tells when it is done:
+//        stepperBank.home(axisNumber, 1, 500, 100000, homeSwitchPin);
+//
+//    And service the moving axes from loop():
+//        stepperBank.service();
+//
+
+#include "StepperBank.h"
+
+
+//
+// global bank object
+//
+StepperBank stepperBank;
+
+
+
+//
+// constructor for the stepper bank
+//
+StepperBank::StepperBank()
+{
+  runningAxes = 0;
+}
+
+
+
+//
+// get a stepper by the number of its port on the board
+//  Enter:  axisNumber = port number, 1 - 6
+//  Exit:   the stepper returned, NULL if there is no such axis
+//
+SpeedyStepper *StepperBank::getAxis(byte axisNumber)
+{
+  if ((axisNumber < 1) || (axisNumber > STEPPER_BANK_AXES))
+    return(NULL);
+
+  return(&axes[axisNumber - 1]);
+}
+
+
+
+//
+// enable an axis and start it moving relative to where it is now
+//  Enter:  axisNumber = port number, 1 - 6
+//          distanceToMoveInSteps = signed distance to move
+//  Exit:   true returned on success, false if there is no such axis
+//
+bool StepperBank::startRelativeMove(byte axisNumber, long distanceToMoveInSteps)
+{
+  SpeedyStepper *stepper;
+
+  stepper = getAxis(axisNumber);
+  if (stepper == NULL)
+    return(false);
+
+  stepper->enableStepper();
+  stepper->setupRelativeMoveInSteps(distanceToMoveInSteps);
+  runningAxes |= (1 << (axisNumber - 1));
+  return(true);
+}
+
+
+
+//
+// enable an axis and queue a move relative to where the moves ahead of it end, the
+// move starts now if the axis is stopped
+//  Enter:  axisNumber = port number, 1 - 6
+//          distanceToMoveInSteps = signed distance to move
+//  Exit:   true returned on success, false if there is no such axis or its queue is full
+//
+bool StepperBank::queueRelativeMove(byte axisNumber, long distanceToMoveInSteps)
+{
+  SpeedyStepper *stepper;
+
+  stepper = getAxis(axisNumber);
+  if (stepper == NULL)
+    return(false);
+
+  stepper->enableStepper();
+  if (!stepper->queueRelativeMoveInSteps(distanceToMoveInSteps))
+    return(false);
+  runningAxes |= (1 << (axisNumber - 1));
+  return(true);
+}
+
+
+
+//
+// enable an axis and send it to a new target, whether or not it is moving
+//  Enter:  axisNumber = port number, 1 - 6
+//          absolutePositionToMoveToInSteps = signed absolute position to move to
+//  Exit:   true returned on success, false if there is no such axis
+//
+bool StepperBank::retarget(byte axisNumber, long absolutePositionToMoveToInSteps)
+{
+  SpeedyStepper *stepper;
+
+  stepper = getAxis(axisNumber);
+  if (stepper == NULL)
+    return(false);
+
+  stepper->enableStepper();
+  stepper->setupRetargetInSteps(absolutePositionToMoveToInSteps);
+  runningAxes |= (1 << (axisNumber - 1));
+  return(true);
+}
+
+
+
+//
+// enable an axis and run it at a velocity until told otherwise, service() keeps it going
+//  Enter:  axisNumber = port number, 1 - 6
+//          velocityInStepsPerSecond = signed velocity, 0 to stop
+//  Exit:   true returned on success, false if there is no such axis
+//
+bool StepperBank::jog(byte axisNumber, float velocityInStepsPerSecond)
+{
+  SpeedyStepper *stepper;
+
+  stepper = getAxis(axisNumber);
+  if (stepper == NULL)
+    return(false);
+
+  stepper->enableStepper();
+  stepper->setupJogInStepsPerSecond(velocityInStepsPerSecond);
+  runningAxes |= (1 << (axisNumber - 1));
+  return(true);
+}
+
+
+
+//
+// decelerate an axis to a stop, from a move or from jogging
+//  Enter:  axisNumber = port number, 1 - 6
+//  Exit:   true returned on success, false if there is no such axis
+//
+bool StepperBank::stop(byte axisNumber)
+{
+  SpeedyStepper *stepper;
+
+  stepper = getAxis(axisNumber);
+  if (stepper == NULL)
+    return(false);
+
+  stepper->setupStop();
+  return(true);
+}
+
+
+
+//
+// enable an axis and start homing it, service() takes homing on from there and the
+// other axes keep moving meanwhile
+//  Enter:  axisNumber = port number, 1 - 6
+//          directionTowardHome = 1 to move in a positive direction, -1 to move in a negative direction
+//          speedInStepsPerSecond = speed to move toward home at, units in steps/second
+//          maxDistanceToMoveInSteps = unsigned maximum distance to move toward home before giving up
+//          homeSwitchPin = pin number of the home switch, low when at home
+//  Exit:   true returned on success, false if there is no such axis or homing failed
+//          at once, as it does for an axis attached to StepperTimer with its switch
+//          on a pin that isn't an external interrupt
+//
+bool StepperBank::home(byte axisNumber, long directionTowardHome, float speedInStepsPerSecond, 
+  long maxDistanceToMoveInSteps, int homeSwitchPin)
+{
+  SpeedyStepper *stepper;
+
+  stepper = getAxis(axisNumber);
+  if (stepper == NULL)
+    return(false);
+
+  stepper->enableStepper();
+  stepper->setupHomeInSteps(directionTowardHome, speedInStepsPerSecond, maxDistanceToMoveInSteps, homeSwitchPin);
+  if (stepper->getHomingStatus() == HOME_STATUS_FAILED)
+    return(false);
+  runningAxes |= (1 << (axisNumber - 1));
+  return(true);
+}
+
+
+
+//
+// check if an axis has a move that hasn't finished yet
+//  Enter:  axisNumber = port number, 1 - 6
+//  Exit:   true returned if the axis is moving
+//
+bool StepperBank::isRunning(byte axisNumber)
+{
+  if ((axisNumber < 1) || (axisNumber > STEPPER_BANK_AXES))
+    return(false);
+
+  return((runningAxes & (1 << (axisNumber - 1))) != 0);
+}
+
+
+
+//
+// turn off the drivers of every axis
+//
+void StepperBank::disableAll(void)
+{
+  for (byte i = 0; i < STEPPER_BANK_AXES; i++)
+    axes[i].disableStepper();
+}
+
+
+
+//
+// step the moving axes that are polled and clear the running bit of the ones that have
+// finished, call this from loop()
+//
+void StepperBank::service(void)
+{
+  byte axisBit;
+
+  if (runningAxes == 0)
+    return;
+
+  axisBit = 1;
+  for (byte i = 0; i < STEPPER_BANK_AXES; i++, axisBit <<= 1)
+  {
+    if (!(runningAxes & axisBit))
+      continue;
+
+    if (axes[i].processMovement())
+      runningAxes &= ~axisBit;
+  }
+}
+
+// -------------------------------------- End --------------------------------------
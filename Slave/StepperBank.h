@@ -0,0 +1,57 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                 Header file for StepperBank.cpp                *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+
+#ifndef StepperBank_h
+#define StepperBank_h
+
+#include <Arduino.h>
+#include "SpeedyStepper.h"
+
+
+//
+// number of stepper ports on the board, axes are numbered 1 to 6 after them
+//
+const byte STEPPER_BANK_AXES = 6;
+
+
+//
+// the StepperBank class
+//
+class StepperBank
+{
+  public:
+    //
+    // public functions
+    //
+    StepperBank();
+    SpeedyStepper *getAxis(byte axisNumber);
+    bool startRelativeMove(byte axisNumber, long distanceToMoveInSteps);
+    bool queueRelativeMove(byte axisNumber, long distanceToMoveInSteps);
+    bool retarget(byte axisNumber, long absolutePositionToMoveToInSteps);
+    bool jog(byte axisNumber, float velocityInStepsPerSecond);
+    bool stop(byte axisNumber);
+    bool home(byte axisNumber, long directionTowardHome, float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeSwitchPin);
+    bool isRunning(byte axisNumber);
+    void disableAll(void);
+    void service(void);
+
+  private:
+    //
+    // private member variables
+    //
+    SpeedyStepper axes[STEPPER_BANK_AXES];
+    byte runningAxes;
+};
+
+
+extern StepperBank stepperBank;
+
+
+// ------------------------------------ End ---------------------------------
+#endif
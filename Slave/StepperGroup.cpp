@@ -0,0 +1,272 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                          StepperGroup                          *
+//      *                                                                *
+//      *      Moves several SpeedyStepper axes together on one line     *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Started one at a time, each axis of a gantry move ramps up and down on its own, so
+// the axes finish at different times and the tool follows a bent path.  A StepperGroup
+// moves its axes in a straight line through step space instead.
+//
+// The group is itself a SpeedyStepper with no pins, which runs the acceleration ramp
+// for the axis with the longest distance, the major axis.  Every step of that ramp
+// steps the major axis, and the Bresenham line algorithm picks which of the other
+// axes step along with it: each axis adds its distance to an error term and steps
+// when the error passes the major axis's distance.  All of the axes start and stop
+// together, and there is only one ramp to compute per step of the major axis, no
+// matter how many axes move.
+//
+// The speed and acceleration of the group apply to the major axis, in its steps.
+// Because the group is a SpeedyStepper, it is run either by calling processMovement()
+// from loop() or by attaching it to StepperTimer, and setupStop() brings the whole
+// line to a stop.  A line only starts when every one of its axes is stopped, and the
+// axes in a group must not be given moves of their own while the group is moving, they
+// report motionComplete() true throughout, so check hasAxis() first.  The axes must be
+// run the same way as the group, from StepperTimer or from loop(), not a mix.
+//
+// Usage:
+//        StepperGroup gantry;
+//        long distances[2] = {1000, 250};
+//
+//        gantry.addAxis(stepper1);
+//        gantry.addAxis(stepper2);
+//        gantry.setSpeedInStepsPerSecond(2000);
+//        gantry.setAccelerationInStepsPerSecondPerSecond(4000);
+//        gantry.setupLinearMoveInSteps(distances);
+//
+//    Then call gantry.processMovement() until it returns true, or attach the group to
+//    StepperTimer and wait for gantry.motionComplete().
+//
+
+#include "StepperGroup.h"
+
+
+//
+// AVR clock cycles for the Bresenham update and step count of each axis on every step
+// of the line, only the host simulation uses this
+//
+const unsigned long STEPPER_GROUP_AXIS_CYCLES = 40;
+
+
+
+//
+// constructor for the stepper group
+//
+StepperGroup::StepperGroup()
+{
+  axisCount = 0;
+  lineDistance_InSteps = 0;
+  stepFunction = takeGroupStep;
+}
+
+
+
+//
+// add an axis to the group, call this while the group is stopped
+//  Enter:  stepper = the connected and configured stepper to add
+//  Exit:   true returned on success, false if the group is full
+//
+bool StepperGroup::addAxis(SpeedyStepper &stepper)
+{
+  byte oldSREG;
+
+  if (axisCount >= STEPPER_GROUP_MAX_AXES)
+    return(false);
+
+  oldSREG = SREG;
+  cli();
+  axes[axisCount] = &stepper;
+  axisDistance_InSteps[axisCount] = 0;
+  axisError_InSteps[axisCount] = 0;
+  axisDirection_Scaler[axisCount] = 1;
+  axisCount++;
+  SREG = oldSREG;
+  return(true);
+}
+
+
+
+//
+// remove every axis from the group, call this while the group is stopped
+//
+void StepperGroup::removeAllAxes(void)
+{
+  byte oldSREG = SREG;
+
+  cli();
+  axisCount = 0;
+  SREG = oldSREG;
+}
+
+
+
+//
+// get the number of axes in the group
+//
+byte StepperGroup::getAxisCount(void)
+{
+  return(axisCount);
+}
+
+
+
+//
+// check if a stepper is one of the axes of the group
+//  Enter:  stepper = the stepper
+//  Exit:   true returned if it is
+//
+bool StepperGroup::hasAxis(SpeedyStepper &stepper)
+{
+  for (byte i = 0; i < axisCount; i++)
+  {
+    if (axes[i] == &stepper)
+      return(true);
+  }
+  return(false);
+}
+
+
+
+//
+// setup a straight line move of all of the axes relative to where they are now, no
+// motion occurs until processMovement() is called or the timer runs the group.  The
+// line and an axis's own move would both drive the axis's direction and step pins, so
+// nothing starts unless the group and each of its axes is stopped.
+//  Enter:  distancesToMoveInSteps -> signed distance to move for each axis, in the
+//            order the axes were added
+//  Exit:   true returned if the line started, false if something was still moving
+//
+bool StepperGroup::setupLinearMoveInSteps(const long *distancesToMoveInSteps)
+{
+  long lineDistance;
+  long distance;
+  byte oldSREG;
+  byte homingStatus;
+
+  if (!motionComplete())
+    return(false);
+  for (byte i = 0; i < axisCount; i++)
+  {
+    homingStatus = axes[i]->getHomingStatus();
+    if (!axes[i]->motionComplete() || (homingStatus == HOME_STATUS_MOVING_TOWARD_SWITCH) ||
+      (homingStatus == HOME_STATUS_BACKING_OFF_SWITCH) || (homingStatus == HOME_STATUS_APPROACHING_SWITCH_SLOWLY))
+      return(false);
+  }
+
+  //
+  // the line is as long as the longest axis distance
+  //
+  lineDistance = 0;
+  for (byte i = 0; i < axisCount; i++)
+  {
+    distance = labs(distancesToMoveInSteps[i]);
+    if (distance > lineDistance)
+      lineDistance = distance;
+  }
+
+  //
+  // start each error term half way so that the steps of the shorter axes are centered
+  // between the steps of the major axis
+  //
+  oldSREG = SREG;
+  cli();
+  lineDistance_InSteps = lineDistance;
+  for (byte i = 0; i < axisCount; i++)
+  {
+    distance = distancesToMoveInSteps[i];
+    axisDirection_Scaler[i] = (distance < 0) ? -1 : 1;
+    axisDistance_InSteps[i] = labs(distance);
+    axisError_InSteps[i] = lineDistance / 2;
+
+    if (distance < 0)
+      setPortBits(axes[i]->directionPortRegister, axes[i]->directionBitMask);
+    else
+      clearPortBits(axes[i]->directionPortRegister, axes[i]->directionBitMask);
+  }
+  SREG = oldSREG;
+
+  //
+  // the group's own position counts the steps along the line
+  //
+  setCurrentPositionInSteps(0);
+  setupMoveInSteps(lineDistance);
+  return(true);
+}
+
+
+
+//
+// move all of the axes in a straight line relative to where they are now, this
+// function does not return until the move is complete
+//  Enter:  distancesToMoveInSteps -> signed distance to move for each axis, in the
+//            order the axes were added
+//
+void StepperGroup::moveLinearInSteps(const long *distancesToMoveInSteps)
+{
+  if (!setupLinearMoveInSteps(distancesToMoveInSteps))
+    return;
+
+  while(!processMovement())
+    ;
+}
+
+
+
+//
+// take one step along the line, called through takeStep() when the ramp says it is
+// time.  The step lines of the axes that step are raised together, held high while the
+// ramp computes the next period, then lowered together.
+//  Enter:  stepper -> the group
+//
+void StepperGroup::takeGroupStep(SpeedyStepper *stepper)
+{
+  StepperGroup *group = (StepperGroup *) stepper;
+  SpeedyStepper *axis;
+  byte steppingAxes;
+  byte oldSREG;
+
+  //
+  // find the axes that step with this step of the line
+  //
+  steppingAxes = 0;
+  for (byte i = 0; i < group->axisCount; i++)
+  {
+    group->axisError_InSteps[i] += group->axisDistance_InSteps[i];
+    if (group->axisError_InSteps[i] >= group->lineDistance_InSteps)
+    {
+      group->axisError_InSteps[i] -= group->lineDistance_InSteps;
+      steppingAxes |= (1 << i);
+      setPortBits(group->axes[i]->stepPortRegister, group->axes[i]->stepBitMask);
+    }
+  }
+  delayMicroseconds(2);
+
+  group->advanceOneStep();
+
+  //
+  // return the step lines low and count the steps, each axis stays at its target so that
+  // neither the timer nor processMovement() steps it on its own
+  //
+  for (byte i = 0; i < group->axisCount; i++)
+  {
+    if (!(steppingAxes & (1 << i)))
+      continue;
+
+    axis = group->axes[i];
+    clearPortBits(axis->stepPortRegister, axis->stepBitMask);
+    oldSREG = SREG;
+    cli();
+    axis->currentPosition_InSteps += group->axisDirection_Scaler[i];
+    axis->targetPosition_InSteps = axis->currentPosition_InSteps;
+    SREG = oldSREG;
+  }
+
+  AVR_CYCLES(STEPPER_GROUP_AXIS_CYCLES * group->axisCount);
+}
+
+// -------------------------------------- End --------------------------------------
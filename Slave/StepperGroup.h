@@ -0,0 +1,59 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                 Header file for StepperGroup.cpp               *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+
+#ifndef StepperGroup_h
+#define StepperGroup_h
+
+#include <Arduino.h>
+#include "SpeedyStepper.h"
+
+
+//
+// number of axes that can move together in one group
+//
+const byte STEPPER_GROUP_MAX_AXES = 6;
+
+
+//
+// the StepperGroup class
+//
+class StepperGroup : public SpeedyStepper
+{
+  public:
+    //
+    // public functions
+    //
+    StepperGroup();
+    bool addAxis(SpeedyStepper &stepper);
+    void removeAllAxes(void);
+    byte getAxisCount(void);
+    bool hasAxis(SpeedyStepper &stepper);
+    bool setupLinearMoveInSteps(const long *distancesToMoveInSteps);
+    void moveLinearInSteps(const long *distancesToMoveInSteps);
+
+  private:
+    //
+    // private functions
+    //
+    static void takeGroupStep(SpeedyStepper *stepper);
+
+    //
+    // private member variables
+    //
+    SpeedyStepper *axes[STEPPER_GROUP_MAX_AXES];
+    long axisDistance_InSteps[STEPPER_GROUP_MAX_AXES];
+    long axisError_InSteps[STEPPER_GROUP_MAX_AXES];
+    int axisDirection_Scaler[STEPPER_GROUP_MAX_AXES];
+    byte axisCount;
+    long lineDistance_InSteps;
+};
+
+
+// ------------------------------------ End ---------------------------------
+#endif
@@ -0,0 +1,432 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                          StepperTimer                          *
+//      *                                                                *
+//      *        Steps SpeedyStepper motors from a timer interrupt       *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// When steppers are run by calling processMovement() from loop(), a step can only
+// happen when loop() gets around to it.  While a callable runs, or while the serial ISRs
+// are busy, the steps come late and the motion stutters.  StepperTimer instead steps
+// the motors from the Timer 1 compare interrupt, so each step happens when the
+// acceleration ramp says it should no matter what the rest of the firmware is doing.
+//
+// One timer serves every axis.  The 2560 has four 16 bit timers but the board has six
+// axes, and several of the step pins are also timer output pins, so rather than give
+// each axis its own timer, the ISR keeps a countdown to the next step of every axis and
+// programs the timer for the earliest one.  The timer runs in CTC mode, it restarts
+// from 0 on each compare match, so the time between interrupts is exact even when an
+// ISR starts late.
+//
+// Each step costs CPU time in the ISR, so the total step rate across all axes is
+// limited with setMaximumStepRate().  After taking N steps the ISR waits at least N
+// times the minimum step period before running again, steps that are held back by
+// the limit are late rather than lost, and are counted by getLateStepCount().
+//
+// The ISR enables interrupts while it computes the steps so that the serial receive
+// ISR never waits long enough to overrun the USART.
+//
+// With setGangedStepPulses(true), the step lines of all of the axes that are due are
+// raised together, with one write for each port, before any ramp is computed, and
+// lowered together at the end.  Axes on the same port then step at exactly the same
+// time, and no axis waits for the ramps of the ones ahead of it.  A stepper with no
+// step pin of its own, such as a StepperGroup, still pulses its axes itself.
+//
+// Usage:
+//    Connect and configure the steppers as usual, then in setup():
+//        stepperTimer.attach(stepper1);
+//        stepperTimer.attach(stepper2);
+//        stepperTimer.begin();
+//
+//    Moves are then started with the usual setup functions, for example:
+//        stepper1.setupMoveInSteps(1000);
+//
+//    They run on their own, processMovement() and motionComplete() report when they
+//    are done.  The blocking functions such as moveToPositionInSteps() still work.
+//
+
+#include "StepperTimer.h"
+
+
+//
+// timer constants, Timer 1 is clocked at 16Mhz / 8
+//
+const unsigned long TIMER_TICKS_PER_SECOND = 2000000L;
+const float TIMER_TICKS_PER_US = 2.0;
+const unsigned int TIMER_IDLE_PERIOD_InTicks = 2000;     // check for new moves every 1ms
+const unsigned int TIMER_MINIMUM_LEAD_InTicks = 20;      // time to leave the ISR before the next match
+const unsigned int TIMER_MAXIMUM_PERIOD_InTicks = 60000;
+
+const unsigned long DEFAULT_MAXIMUM_STEP_RATE = 10000L;
+
+
+//
+// AVR clock cycles to scale a float step period to timer ticks, a multiply and a
+// conversion to an integer, only the host simulation uses this
+//
+const unsigned long FLOAT_PERIOD_TO_TICKS_CYCLES = 125 + 60;
+
+
+//
+// global timer object
+//
+StepperTimer stepperTimer;
+
+
+
+//
+// constructor for the stepper timer
+//
+StepperTimer::StepperTimer()
+{
+  stepperCount = 0;
+  groupCount = 0;
+  gangedStepPulses = false;
+  scheduledPeriod_InTicks = TIMER_IDLE_PERIOD_InTicks;
+  lateStepCount = 0;
+  setMaximumStepRate(DEFAULT_MAXIMUM_STEP_RATE);
+}
+
+
+
+//
+// start the timer, call this from setup() once the steppers have been attached
+//
+void StepperTimer::begin(void)
+{
+  byte oldSREG = SREG;
+
+  cli();
+  TCCR1A = 0;
+  TCCR1B = (1 << WGM12) | (1 << CS11);      // CTC mode with TOP = OCR1A, clock / 8
+  TCNT1 = 0;
+  OCR1A = TIMER_IDLE_PERIOD_InTicks - 1;
+  scheduledPeriod_InTicks = TIMER_IDLE_PERIOD_InTicks;
+  TIFR1 = (1 << OCF1A);
+  TIMSK1 |= (1 << OCIE1A);
+  SREG = oldSREG;
+}
+
+
+
+//
+// hand a stepper to the timer, after this it is stepped from the ISR.  Call this while
+// the stepper is stopped.
+//  Enter:  stepper = the stepper to attach
+//  Exit:   true returned on success, false if too many steppers are attached
+//
+bool StepperTimer::attach(SpeedyStepper &stepper)
+{
+  byte oldSREG;
+
+  if (stepper.timerDriven)
+    return(true);
+  if (stepperCount >= STEPPER_TIMER_MAX_STEPPERS)
+    return(false);
+
+  oldSREG = SREG;
+  cli();
+  steppers[stepperCount] = &stepper;
+  timeToNextStep_InTicks[stepperCount] = 0;
+  stepperCount++;
+  stepper.timerDriven = true;
+  groupStepPorts();
+  SREG = oldSREG;
+  return(true);
+}
+
+
+
+//
+// take a stepper back from the timer, after this it must be stepped by calling
+// processMovement() again.  Call this while the stepper is stopped.
+//  Enter:  stepper = the stepper to detach
+//
+void StepperTimer::detach(SpeedyStepper &stepper)
+{
+  byte oldSREG = SREG;
+
+  cli();
+  for (byte i = 0; i < stepperCount; i++)
+  {
+    if (steppers[i] != &stepper)
+      continue;
+
+    for (byte j = i + 1; j < stepperCount; j++)
+    {
+      steppers[j - 1] = steppers[j];
+      timeToNextStep_InTicks[j - 1] = timeToNextStep_InTicks[j];
+    }
+    stepperCount--;
+    stepper.timerDriven = false;
+    groupStepPorts();
+    break;
+  }
+  SREG = oldSREG;
+}
+
+
+
+//
+// check if a stepper is stepped from the timer
+//  Enter:  stepper = the stepper
+//  Exit:   true returned if it is attached
+//
+bool StepperTimer::isAttached(SpeedyStepper &stepper)
+{
+  return(stepper.timerDriven);
+}
+
+
+
+//
+// set the maximum number of steps per second the ISR generates, added up over all of
+// the axes
+//  Enter:  stepsPerSecond = maximum aggregate step rate, 0 for no limit
+//
+void StepperTimer::setMaximumStepRate(unsigned long stepsPerSecond)
+{
+  unsigned long ticksPerStep;
+  byte oldSREG;
+
+  if (stepsPerSecond == 0)
+    ticksPerStep = 0;
+  else
+  {
+    ticksPerStep = TIMER_TICKS_PER_SECOND / stepsPerSecond;
+    if (ticksPerStep > TIMER_MAXIMUM_PERIOD_InTicks)
+      ticksPerStep = TIMER_MAXIMUM_PERIOD_InTicks;
+  }
+
+  oldSREG = SREG;
+  cli();
+  ticksPerStepAtMaximumRate = (unsigned int) ticksPerStep;
+  SREG = oldSREG;
+}
+
+
+
+//
+// choose whether the step pulses of the axes that are due at the same time go out
+// together, with one write for each port
+//  Enter:  ganged = true to pulse the axes together, false to pulse each one as its
+//            step is computed
+//
+void StepperTimer::setGangedStepPulses(bool ganged)
+{
+  byte oldSREG = SREG;
+
+  cli();
+  gangedStepPulses = ganged;
+  SREG = oldSREG;
+}
+
+
+
+//
+// get the number of steps that were taken after they were due, because of the maximum
+// step rate or because several axes were due at nearly the same time
+//
+unsigned long StepperTimer::getLateStepCount(void)
+{
+  unsigned long count;
+  byte oldSREG = SREG;
+
+  cli();
+  count = lateStepCount;
+  SREG = oldSREG;
+  return(count);
+}
+
+
+
+//
+// step every axis that is due, then program the timer for the next one, called from
+// the Timer 1 compare ISR
+//
+void StepperTimer::processInterrupt(void)
+{
+  unsigned int elapsed_InTicks;
+  unsigned long nextPeriod_InTicks;
+  unsigned long minimumPeriod_InTicks;
+  unsigned int leadPeriod_InTicks;
+  byte stepsTaken;
+  byte dueSteppers;
+  byte groupBitMasks[STEPPER_TIMER_MAX_STEPPERS];
+  long timeToNextStep;
+  SpeedyStepper *stepper;
+
+  //
+  // the timer restarted from 0 when it matched, so the time since the last ISR is the
+  // period that was scheduled.  Push the match out of reach while this one is handled,
+  // then let the serial ISRs in.
+  //
+  elapsed_InTicks = scheduledPeriod_InTicks;
+  OCR1A = 0xFFFF;
+  TIMSK1 &= ~(1 << OCIE1A);
+  sei();
+
+  //
+  // count down to each axis's next step and find the ones that are due
+  //
+  dueSteppers = 0;
+  for (byte g = 0; g < groupCount; g++)
+    groupBitMasks[g] = 0;
+
+  for (byte i = 0; i < stepperCount; i++)
+  {
+    stepper = steppers[i];
+
+    //
+    // a new move takes its first step one initial ramp period from now
+    //
+    if (stepper->startNewMove)
+    {
+      stepper->startNewMove = false;
+      timeToNextStep = getNextStepPeriodInTicks(stepper);
+    }
+    else
+      timeToNextStep = timeToNextStep_InTicks[i] - elapsed_InTicks;
+
+    if (stepper->currentPosition_InSteps == stepper->targetPosition_InSteps)
+      timeToNextStep = 0;
+    else if (timeToNextStep <= 0)
+    {
+      dueSteppers |= (1 << i);
+      groupBitMasks[stepPortGroup[i]] |= stepper->stepBitMask;
+    }
+    timeToNextStep_InTicks[i] = timeToNextStep;
+  }
+
+  if (gangedStepPulses)
+  {
+    for (byte g = 0; g < groupCount; g++)
+    {
+      if (groupBitMasks[g] != 0)
+        SpeedyStepper::setPortBits(groupPortRegister[g], groupBitMasks[g]);
+    }
+  }
+
+  //
+  // step the axes that are due, the next step is timed from when this one was due
+  // rather than from now, so a late step doesn't push back the rest of the move
+  //
+  nextPeriod_InTicks = TIMER_IDLE_PERIOD_InTicks;
+  stepsTaken = 0;
+  for (byte i = 0; i < stepperCount; i++)
+  {
+    stepper = steppers[i];
+    timeToNextStep = timeToNextStep_InTicks[i];
+
+    if (dueSteppers & (1 << i))
+    {
+      if (timeToNextStep < 0)
+        lateStepCount++;
+
+      if (gangedStepPulses && (stepper->stepBitMask != 0))
+        stepper->advanceOneStep();
+      else
+        stepper->takeStep();
+      stepsTaken++;
+
+      timeToNextStep += getNextStepPeriodInTicks(stepper);
+      if (timeToNextStep < 1)
+        timeToNextStep = 1;
+      timeToNextStep_InTicks[i] = timeToNextStep;
+    }
+
+    if ((stepper->currentPosition_InSteps != stepper->targetPosition_InSteps) &&
+        ((unsigned long) timeToNextStep < nextPeriod_InTicks))
+      nextPeriod_InTicks = timeToNextStep;
+  }
+
+  if (gangedStepPulses)
+  {
+    for (byte g = 0; g < groupCount; g++)
+    {
+      if (groupBitMasks[g] != 0)
+        SpeedyStepper::clearPortBits(groupPortRegister[g], groupBitMasks[g]);
+    }
+  }
+
+  //
+  // hold to the maximum aggregate step rate
+  //
+  minimumPeriod_InTicks = (unsigned long) stepsTaken * ticksPerStepAtMaximumRate;
+  if (minimumPeriod_InTicks > TIMER_MAXIMUM_PERIOD_InTicks)
+    minimumPeriod_InTicks = TIMER_MAXIMUM_PERIOD_InTicks;
+  if (nextPeriod_InTicks < minimumPeriod_InTicks)
+    nextPeriod_InTicks = minimumPeriod_InTicks;
+
+  //
+  // schedule the next match, it must be far enough past the count for the timer not
+  // to pass it before this ISR has returned
+  //
+  cli();
+  leadPeriod_InTicks = TCNT1 + TIMER_MINIMUM_LEAD_InTicks;
+  if (nextPeriod_InTicks < leadPeriod_InTicks)
+    nextPeriod_InTicks = leadPeriod_InTicks;
+
+  OCR1A = (unsigned int) nextPeriod_InTicks - 1;
+  scheduledPeriod_InTicks = (unsigned int) nextPeriod_InTicks;
+  TIMSK1 |= (1 << OCIE1A);
+}
+
+
+
+//
+// get the period from a stepper's last step to its next one in timer ticks, the fixed
+// point period in us with 12 fraction bits only needs a shift
+//
+long StepperTimer::getNextStepPeriodInTicks(SpeedyStepper *stepper)
+{
+  if (stepper->fixedPointRamp)
+    return((long) (stepper->ramp_NextStepPeriod_InUSQ12 >> 11));
+
+  AVR_CYCLES(FLOAT_PERIOD_TO_TICKS_CYCLES);
+  return((long) (stepper->ramp_NextStepPeriod_InUS * TIMER_TICKS_PER_US));
+}
+
+
+
+//
+// put the attached steppers into groups that share a step port, so that the step
+// pulses of a group can be written all at once, called with interrupts off
+//
+void StepperTimer::groupStepPorts(void)
+{
+  byte g;
+
+  groupCount = 0;
+  for (byte i = 0; i < stepperCount; i++)
+  {
+    for (g = 0; g < groupCount; g++)
+    {
+      if (groupPortRegister[g] == steppers[i]->stepPortRegister)
+        break;
+    }
+
+    if (g == groupCount)
+    {
+      groupPortRegister[g] = steppers[i]->stepPortRegister;
+      groupCount++;
+    }
+    stepPortGroup[i] = g;
+  }
+}
+
+
+
+//
+// interrupt service routine for the Timer 1 compare match
+//
+ISR(TIMER1_COMPA_vect)
+{
+  stepperTimer.processInterrupt();
+}
+
+// -------------------------------------- End --------------------------------------
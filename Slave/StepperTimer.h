@@ -0,0 +1,69 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                 Header file for StepperTimer.cpp               *
+//      *                                                                *
+//      *           Copyright (c) Josh Benson and Pratik Gupta           *
+//      *                                                                *
+//      ******************************************************************
+
+
+#ifndef StepperTimer_h
+#define StepperTimer_h
+
+#include <Arduino.h>
+#include "SpeedyStepper.h"
+
+
+//
+// number of steppers that can be attached to the timer
+//
+const byte STEPPER_TIMER_MAX_STEPPERS = 6;
+
+
+//
+// the StepperTimer class
+//
+class StepperTimer
+{
+  public:
+    //
+    // public functions
+    //
+    StepperTimer();
+    void begin(void);
+    bool attach(SpeedyStepper &stepper);
+    void detach(SpeedyStepper &stepper);
+    bool isAttached(SpeedyStepper &stepper);
+    void setMaximumStepRate(unsigned long stepsPerSecond);
+    void setGangedStepPulses(bool ganged);
+    unsigned long getLateStepCount(void);
+    void processInterrupt(void);
+
+  private:
+    //
+    // private functions
+    //
+    long getNextStepPeriodInTicks(SpeedyStepper *stepper);
+    void groupStepPorts(void);
+
+    //
+    // private member variables
+    //
+    SpeedyStepper *steppers[STEPPER_TIMER_MAX_STEPPERS];
+    long timeToNextStep_InTicks[STEPPER_TIMER_MAX_STEPPERS];
+    byte stepperCount;
+    bool gangedStepPulses;
+    byte stepPortGroup[STEPPER_TIMER_MAX_STEPPERS];
+    volatile uint8_t *groupPortRegister[STEPPER_TIMER_MAX_STEPPERS];
+    byte groupCount;
+    unsigned int ticksPerStepAtMaximumRate;
+    unsigned int scheduledPeriod_InTicks;
+    volatile unsigned long lateStepCount;
+};
+
+
+extern StepperTimer stepperTimer;
+
+
+// ------------------------------------ End ---------------------------------
+#endif
@@ -10,6 +10,7 @@
 from serial import Serial
 from threading import Thread
 from time import time, sleep
+from random import randrange
 from pidev.SlaveMaster import SerialMaster
 from pidev.SlaveMaster import Arduino
 ADDRESS = 15
@@ -25,13 +26,18 @@ M_SLAVE_RESPONSE_MAX_DATA_BYTES = 64
 
 MASTER_COMMAND_HEADER_BYTE_1 = 0xAA
 MASTER_COMMAND_HEADER_BYTE_2 = 0x55
+MASTER_COMMAND_HEADER_BYTE_2_CRC = 0x5A
+MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED = 0x56
+MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED = 0x5B
+BROADCAST_ADDRESS = 0
+MASTER_COMMAND_BATCH = 0xFF
 MASTER_COMMAND_TIMEOUT_PERIOD_S = 0.1
-MASTER_COMMAND_MAX_PACKET_BYTES = M_MASTER_COMMAND_MAX_DATA_BYTES + 5
+MASTER_COMMAND_MAX_PACKET_BYTES = M_MASTER_COMMAND_MAX_DATA_BYTES + 7
 
 SLAVE_RESPONSE_RECIEVED_COMMAND = 0xA9
 SLAVE_RESPONSE_RECIEVED_COMMAND_SENDING_DATA = 0xAC
 SLAVE_RESPONSE_RESEND_COMMAND = 0xB8
-SLAVE_RESPONSE_MAX_PACKET_BYTES = M_SLAVE_RESPONSE_MAX_DATA_BYTES + 4
+SLAVE_RESPONSE_MAX_PACKET_BYTES = M_SLAVE_RESPONSE_MAX_DATA_BYTES + 6
 
 MASTER_STATUS_READY_TO_SEND_COMMAND = 1
 MASTER_STATUS_BUSY_SENDING_COMMAND = 2
@@ -41,9 +47,27 @@ MASTER_STATUS_SENDING_COMMAND_FAILED = 4
 READ_FAILURE = 0
 READ_SUCCESS_NO_DATA = 1
 READ_SUCCESS_DATA = 2
+READ_STALE = 3
+
+# the status of each command in the response to a batch, BATCH_RECORD_ in SerialSlave.cpp
+BATCH_RECORD_RAN = 0
+BATCH_RECORD_NO_SUCH_COMMAND = 1
+BATCH_RECORD_DATA_DROPPED = 2
+
+# most data bytes for one command, in a batch or not, MASTER_COMMAND_MAX_DATA_BYTES in
+# SerialSlave.h
+M_MASTER_RECORD_MAX_DATA_BYTES = 16
 
 SEND_ATTEMPTS = 3
 
+# most sequenced commands a slave takes before the master reads their responses,
+# SEQUENCE_WINDOW_SIZE in SerialSlave.cpp
+SEQUENCE_WINDOW_SIZE = 4
+
+ECHO_COMMAND = 2
+CRC_PROBE_DATA = [0x5A, 0xA5, 0x00, 0xFF]
+SEQUENCE_PROBE_DATA = [0x56, 0xA9]
+
 """
 From slave:
 if no response:
@@ -61,25 +85,115 @@ dataLength
 data where len(data)is dataLength
 checksum
 
+A command sent with MASTER_COMMAND_HEADER_BYTE_2_CRC as its second header byte ends
+with a CRC-16 in place of the checksum, low byte first, and the slave's response
+with data does too.  negotiate_crc() turns this on for a slave whose firmware has it.
+
+A command sent with MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED (or _CRC_SEQUENCED) has a
+sequence byte after the slave address.  Each new command gets the next sequence and a
+command sent again after a lost response keeps its sequence, the slave answers that
+with its saved response rather than running the command twice.  The slave's response
+has the sequence after the two response code bytes, covered by the checksum or CRC when
+there is data.  negotiate_sequence() turns this on for a slave.
+
+With sequences the master can send up to SEQUENCE_WINDOW_SIZE commands back to back
+and then read their responses, which come in the same order: send_command_async()
+returns a CommandFuture and sends the commands a window at a time.  The slave holds its
+responses until the line has been quiet for two byte times, the bus being half duplex.
+
+A command sent to BROADCAST_ADDRESS is run by every slave, and one sent to a group
+address by every slave that has joined the group (the join_group callable).  No slave
+answers them.  send_command_to_group() sends one, the Group class wraps a group.
+
+A command of MASTER_COMMAND_BATCH carries several commands, each as its command number,
+data length and data.  The slave runs them in order and sends one response with each
+command's BATCH_RECORD_ status, data length and data, the commands it didn't run left
+off the end.  send_batch_to_slave() sends one, the Batch class builds one from callable
+names.
+
 """
 
 
+def make_crc16_table():
+    # CRC-16/MODBUS, polynomial 0xA001 reflected, the same table as SerialSlave.cpp
+    table = []
+    for i in range(256):
+        crc = i
+        for bit in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0xA001
+            else:
+                crc >>= 1
+        table.append(crc)
+    return table
+
+
+CRC16_TABLE = make_crc16_table()
+CRC16_INITIAL_VALUE = 0xFFFF
+
+
+def crc16(data, crc=CRC16_INITIAL_VALUE):
+    for byte in data:
+        crc = (crc >> 8) ^ CRC16_TABLE[(crc ^ byte) & 0xFF]
+    return crc
+
+
+class CommandFuture:
+    # the result of a command sent with send_command_async(), what send_command_to_slave()
+    # would have returned: the data, 1 for a response without data, or -1 if it failed.
+    # result() sends the commands still waiting and reads their responses if need be.
+    def __init__(self, master, slave_address, transform=None):
+        self.master = master
+        self.slave_address = slave_address
+        self.transform = transform
+        self.finished = False
+        self.out = None
+
+    def done(self):
+        return self.finished
+
+    def set_result(self, out):
+        self.out = out
+        self.finished = True
+
+    def result(self):
+        if not self.finished:
+            self.master.flush(self.slave_address)
+        if self.transform is not None:
+            return self.transform(self.out)
+        return self.out
+
+
+class PendingCommand:
+    def __init__(self, packet, sequence, use_crc, future):
+        self.packet = packet
+        self.sequence = sequence
+        self.use_crc = use_crc
+        self.future = future
+
+
 class SlaveMaster:
-    def __init__(self, port="/dev/ttyS0", baud=115200):
-        self.port = Serial(port=port, baudrate=baud, timeout=MASTER_COMMAND_TIMEOUT_PERIOD_S)
+    # timeout is how long to wait for a response, with sequenced slaves it can be cut
+    # close to the round trip since trying again never runs a command twice
+    def __init__(self, port="/dev/ttyS0", baud=115200, timeout=MASTER_COMMAND_TIMEOUT_PERIOD_S):
+        self.port = Serial(port=port, baudrate=baud, timeout=timeout)
         self.port.set_input_flow_control(True)
         self.data_from_slave = []
         self.data_length_from_slave = 0
         self.checksum_from_slave = 0
         self.status = MASTER_STATUS_READY_TO_SEND_COMMAND
+        self.crc_slaves = set()
+        self.next_sequences = {}
+        self.pending = {}
 
     def read_byte(self):
         b = self.port.read()
         # print("read_byte", b)
         return int.from_bytes(b, "big")
 
-    # called when we expect a packet
-    def read_packet(self):
+    # called when we expect a packet, use_crc if the command was sent with a CRC and
+    # sequence if it was sent with one, a response for another sequence is READ_STALE
+    def read_packet(self, use_crc=False, sequence=None):
         response_type_first = self.read_byte()
         # make sure 2nd byte is the same
         response_type_repeat = self.read_byte()
@@ -91,26 +205,45 @@ class SlaveMaster:
 
         if response_type_repeat == SLAVE_RESPONSE_RECIEVED_COMMAND:
             self.data_length_from_slave = 0
+            if sequence is not None and self.read_byte() != sequence:
+                return READ_STALE
             # done
             # print("read success")
             return READ_SUCCESS_NO_DATA
         elif response_type_repeat == SLAVE_RESPONSE_RECIEVED_COMMAND_SENDING_DATA:
             # slave is going to send some data with the response code
+            checked = []
+            if sequence is not None:
+                checked.append(self.read_byte())
             data_length = self.read_byte()
+            checked.append(data_length)
             if data_length >= 1 and data_length <= M_SLAVE_RESPONSE_MAX_DATA_BYTES:
                 self.data_length_from_slave = data_length
-                self.checksum = data_length
+                self.checksum = sum(checked)
                 self.data_from_slave = []
                 while len(self.data_from_slave) < self.data_length_from_slave:
                     next_byte = self.read_byte()
                     self.checksum += next_byte
                     self.data_from_slave.append(next_byte)
+                if use_crc:
+                    crc = self.read_byte()
+                    crc |= self.read_byte() << 8
+                    expected_crc = crc16(checked + self.data_from_slave)
+                    if crc != expected_crc:
+                        print("invalid crc: {} vs {}".format(expected_crc, crc))
+                        return READ_FAILURE
+                    if sequence is not None and checked[0] != sequence:
+                        return READ_STALE
+                    return READ_SUCCESS_DATA
+
                 # check checksum
                 checksum = self.read_byte()
                 if self.checksum % 256 != checksum:
                     # problem
                     print("invalid checksum: {} vs {}".format(self.checksum % 256, checksum))
                     return READ_FAILURE
+                elif sequence is not None and checked[0] != sequence:
+                    return READ_STALE
                 else:
                     # print("read success w/ data")
                     return READ_SUCCESS_DATA
@@ -126,23 +259,31 @@ class SlaveMaster:
             print("unexpected response type:", response_type_first)
             return READ_FAILURE
 
-    def send_command_to_slave(self, slave_address, command, command_data, response):
-        if self.status == MASTER_STATUS_BUSY_SENDING_COMMAND:
-            raise RuntimeError("Cannot send command: BUSY")
-        self.status = MASTER_STATUS_BUSY_SENDING_COMMAND
-
+    def check_command_data(self, command_data):
         if len(command_data) > M_MASTER_COMMAND_MAX_DATA_BYTES:
             raise ValueError(
                 "Data length ({}) cannot be greater than {}".format(len(command_data), M_MASTER_COMMAND_MAX_DATA_BYTES))
 
+    # the packet for a command, with a sequence unless it is None
+    def build_packet(self, slave_address, command, command_data, use_crc, sequence):
+        use_sequence = sequence is not None
         packet = []
-        self.packet_to_slave = packet
         data_length = len(command_data)
         checksum = 0
         packet.append(MASTER_COMMAND_HEADER_BYTE_1)
-        packet.append(MASTER_COMMAND_HEADER_BYTE_2)
+        if use_crc and use_sequence:
+            packet.append(MASTER_COMMAND_HEADER_BYTE_2_CRC_SEQUENCED)
+        elif use_crc:
+            packet.append(MASTER_COMMAND_HEADER_BYTE_2_CRC)
+        elif use_sequence:
+            packet.append(MASTER_COMMAND_HEADER_BYTE_2_SEQUENCED)
+        else:
+            packet.append(MASTER_COMMAND_HEADER_BYTE_2)
         packet.append(slave_address)
         checksum += slave_address
+        if use_sequence:
+            packet.append(sequence)
+            checksum += sequence
         packet.append(command)
         checksum += command
         packet.append(data_length)
@@ -152,12 +293,46 @@ class SlaveMaster:
             packet.append(byte)
             checksum += byte
 
-        packet.append(checksum % 256)
+        if use_crc:
+            crc = crc16(packet[2:])
+            packet.append(crc & 0xFF)
+            packet.append(crc >> 8)
+        else:
+            packet.append(checksum % 256)
+        return packet
+
+    # the next sequence for a slave
+    def take_sequence(self, slave_address):
+        sequence = self.next_sequences.get(slave_address, 0)
+        self.next_sequences[slave_address] = (sequence + 1) % 256
+        return sequence
+
+    def send_command_to_slave(self, slave_address, command, command_data, response, use_crc=None,
+                              use_sequence=None):
+        if self.pending:
+            # the commands sent with send_command_async() go first
+            self.flush()
+        if use_crc is None:
+            use_crc = slave_address in self.crc_slaves
+        if use_sequence is None:
+            use_sequence = slave_address in self.next_sequences
+        if self.status == MASTER_STATUS_BUSY_SENDING_COMMAND:
+            raise RuntimeError("Cannot send command: BUSY")
+
+        self.check_command_data(command_data)
+        sequence = None
+        if use_sequence:
+            sequence = self.take_sequence(slave_address)
+        self.packet_to_slave = self.build_packet(slave_address, command, command_data, use_crc, sequence)
+        self.status = MASTER_STATUS_BUSY_SENDING_COMMAND
 
         for attempt_number in range(SEND_ATTEMPTS):
             self.port.write(bytes(self.packet_to_slave))
             # print("writing: " + str(self.packet_to_slave))
-            status = self.read_packet()
+            status = self.read_packet(use_crc, sequence)
+            while status == READ_STALE:
+                # a late answer to the command before, the one to this is behind it
+                status = self.read_packet(use_crc, sequence)
             if status == READ_SUCCESS_DATA:
                 self.status = MASTER_STATUS_SENDING_COMMAND_SUCCEEDED
                 return self.data_from_slave
@@ -168,12 +343,142 @@ class SlaveMaster:
                 # prepare for next by clearing what's waiting on the line
                 # WARNING: this will pause until read timeout
                 print("read attempt", attempt_number, "failed")
-                self.port.read(size=M_SLAVE_RESPONSE_MAX_DATA_BYTES)
+                if use_sequence:
+                    # a late response is told apart by its sequence, no need to wait it out
+                    self.port.reset_input_buffer()
+                else:
+                    self.port.read(size=M_SLAVE_RESPONSE_MAX_DATA_BYTES)
 
         # after SEND_ATTEMPTS attempts
         self.status = MASTER_STATUS_SENDING_COMMAND_FAILED
         return -1
 
+    def negotiate_crc(self, slave_address):
+        # check packets to and from this slave with a CRC-16 if its firmware knows how,
+        # a slave that doesn't ignores the probe and the link stays on the checksum
+        out = self.send_command_to_slave(slave_address, ECHO_COMMAND, CRC_PROBE_DATA, True, use_crc=True)
+        if out == CRC_PROBE_DATA:
+            self.crc_slaves.add(slave_address)
+            return True
+        self.crc_slaves.discard(slave_address)
+        return False
+
+    # the data of a batch packet for a list of (command, data) pairs
+    def build_batch_data(self, commands):
+        batch_data = []
+        for command, command_data in commands:
+            if len(command_data) > M_MASTER_RECORD_MAX_DATA_BYTES:
+                raise ValueError("Data length ({}) of a command in a batch cannot be greater than {}".format(
+                    len(command_data), M_MASTER_RECORD_MAX_DATA_BYTES))
+            batch_data += [command, len(command_data)] + list(command_data)
+        self.check_command_data(batch_data)
+        return batch_data
+
+    def send_batch_to_slave(self, slave_address, commands, use_crc=None):
+        # run a list of (command, data) pairs on a slave with one round trip, returning a
+        # list with a (status, data) pair for each command the slave got to, or -1 if the
+        # batch failed
+        out = self.send_command_to_slave(slave_address, MASTER_COMMAND_BATCH, self.build_batch_data(commands),
+                                         True, use_crc)
+        if isinstance(out, int):
+            return -1
+        results = []
+        idx = 0
+        while idx + 2 <= len(out) and len(results) < len(commands):
+            status = out[idx]
+            data_length = out[idx + 1]
+            results.append((status, out[idx + 2:idx + 2 + data_length]))
+            idx += 2 + data_length
+        return results
+
+    def send_command_to_group(self, group_address, command, command_data, use_crc=False):
+        # send a command that every slave in a group runs, or every slave for
+        # BROADCAST_ADDRESS.  No slave answers, so nothing says whether it got through.
+        if self.pending:
+            self.flush()
+        self.check_command_data(command_data)
+        self.packet_to_slave = self.build_packet(group_address, command, command_data, use_crc, None)
+        self.port.write(bytes(self.packet_to_slave))
+
+    def send_command_async(self, slave_address, command, command_data, use_crc=None, transform=None):
+        # send a command without waiting for its response, returning a CommandFuture.  The
+        # commands to a slave go out SEQUENCE_WINDOW_SIZE at a time, back to back, once the
+        # window fills or a result is asked for.  Without sequences for this slave the
+        # command is sent now and the future comes back done.
+        future = CommandFuture(self, slave_address, transform)
+        if slave_address not in self.next_sequences:
+            future.set_result(self.send_command_to_slave(slave_address, command, command_data, True, use_crc))
+            return future
+        if use_crc is None:
+            use_crc = slave_address in self.crc_slaves
+
+        # only one slave may be answering at a time
+        for other_address in list(self.pending):
+            if other_address != slave_address:
+                self.flush(other_address)
+
+        self.check_command_data(command_data)
+        sequence = self.take_sequence(slave_address)
+        packet = self.build_packet(slave_address, command, command_data, use_crc, sequence)
+        window = self.pending.setdefault(slave_address, [])
+        window.append(PendingCommand(packet, sequence, use_crc, future))
+        if len(window) >= SEQUENCE_WINDOW_SIZE:
+            self.flush(slave_address)
+        return future
+
+    def flush(self, slave_address=None):
+        # send the commands waiting for a slave, or for every slave, back to back and read
+        # their responses in order.  Commands from the first one that isn't answered on are
+        # sent again, the slave only answers the ones that already ran from its saved
+        # responses.
+        if slave_address is None:
+            for address in list(self.pending):
+                self.flush(address)
+            return
+        window = self.pending.pop(slave_address, [])
+        if not window:
+            return
+
+        for attempt_number in range(SEND_ATTEMPTS):
+            self.port.write(bytes([byte for command in window for byte in command.packet]))
+            while window:
+                command = window[0]
+                status = self.read_packet(command.use_crc, command.sequence)
+                while status == READ_STALE:
+                    status = self.read_packet(command.use_crc, command.sequence)
+                if status == READ_SUCCESS_DATA:
+                    command.future.set_result(self.data_from_slave)
+                elif status == READ_SUCCESS_NO_DATA:
+                    command.future.set_result(1)
+                else:
+                    break
+                window.pop(0)
+            if not window:
+                self.status = MASTER_STATUS_SENDING_COMMAND_SUCCEEDED
+                return
+            print("read attempt", attempt_number, "failed")
+            self.port.reset_input_buffer()
+
+        for command in window:
+            command.future.set_result(-1)
+        self.status = MASTER_STATUS_SENDING_COMMAND_FAILED
+
+    def negotiate_sequence(self, slave_address):
+        # number the commands to this slave so that trying one again never runs it twice,
+        # if its firmware knows how.  The slave may still have the response to a sequence
+        # from before this master started saved, the random probe data shows that up and
+        # the next sequence is certain to be new.
+        self.next_sequences[slave_address] = randrange(256)
+        for attempt_number in range(2):
+            probe_data = SEQUENCE_PROBE_DATA + [randrange(256), randrange(256)]
+            out = self.send_command_to_slave(slave_address, ECHO_COMMAND, probe_data, True, use_sequence=True)
+            if out == probe_data:
+                return True
+            if out == -1:
+                break
+        del self.next_sequences[slave_address]
+        return False
+
 
 FORMAT_LIST = 0
 FORMAT_BYTE = 1
@@ -190,20 +495,32 @@ class Callable:
         else:
             self.name = name
 
-    def call(self, data=[], format_out=FORMAT_BYTE):
-        serial = self.arduino.serial
-        to_send = None
+    def data_to_send(self, data):
         if isinstance(data, int):
-            to_send = [data]
+            return [data]
         elif isinstance(data, str):
-            to_send = [ord(c) for c in data]
+            return [ord(c) for c in data]
         else:
-            to_send = data
+            return data
+
+    def call(self, data=[], format_out=FORMAT_BYTE):
+        serial = self.arduino.serial
+        to_send = self.data_to_send(data)
 
         # call
         response = False if format_out == NO_RESPONSE else True
         out = serial.send_command_to_slave(self.arduino.address, self.command, to_send, response)
+        return self.format_result(out, format_out)
 
+    # like call(), but returns a CommandFuture whose result() is what call() returns, the
+    # command goes out with the next window of them
+    def call_async(self, data=[], format_out=FORMAT_BYTE):
+        serial = self.arduino.serial
+        to_send = self.data_to_send(data)
+        return serial.send_command_async(self.arduino.address, self.command, to_send,
+                                         transform=lambda out: self.format_result(out, format_out))
+
+    def format_result(self, out, format_out):
         if isinstance(out, int):
             return 0
 
@@ -217,10 +534,14 @@ class Callable:
 
 
 class Arduino:
-    def __init__(self, serial, address):
+    def __init__(self, serial, address, crc=False, sequenced=False):
         self.serial = serial
         self.address = address
         self.callables = {}
+        if crc:
+            print("CRC-16 link:", self.serial.negotiate_crc(address))
+        if sequenced:
+            print("Sequenced link:", self.serial.negotiate_sequence(address))
         self.add_callable(Callable(self, 0, "num_calls"))
         self.add_callable(Callable(self, 1, "get_nth_call"))
         self.fetch_callables()
@@ -231,6 +552,7 @@ class Arduino:
     def add_callable(self, callable):
         self.callables[callable.name] = callable
         setattr(self, callable.name, callable.call)
+        setattr(self, callable.name + "_async", callable.call_async)
         print("Callable added: {}".format(callable.name))
 
     def fetch_callables(self):
@@ -239,3 +561,70 @@ class Arduino:
         for i in range(len(self.callables), self.callable_count):
             self.add_callable(Callable(self, i))
 
+
+class Batch:
+    # calls to one Arduino collected and sent as a single batch packet, so that setting up
+    # an axis is one round trip.  add() takes a callable name and its data and returns the
+    # place of its result, send() returns a list with what call() would have returned for
+    # each, or None for one the slave didn't run or whose data didn't fit in the response.
+    def __init__(self, arduino):
+        self.arduino = arduino
+        self.commands = []
+        self.formats = []
+        self.length = 0
+
+    def add(self, name, data=[], format_out=FORMAT_BYTE):
+        callable = self.arduino.callables[name]
+        to_send = callable.data_to_send(data)
+        self.arduino.serial.build_batch_data([(callable.command, to_send)])
+        if self.length + 2 + len(to_send) > M_MASTER_COMMAND_MAX_DATA_BYTES:
+            raise ValueError("Batch is full, {} of {} bytes used".format(self.length, M_MASTER_COMMAND_MAX_DATA_BYTES))
+        self.commands.append((callable.command, to_send))
+        self.formats.append((callable, format_out))
+        self.length += 2 + len(to_send)
+        return len(self.commands) - 1
+
+    def send(self):
+        results = [None] * len(self.commands)
+        if not self.commands:
+            return results
+        out = self.arduino.serial.send_batch_to_slave(self.arduino.address, self.commands)
+        if out == -1:
+            return results
+        for i, (status, data) in enumerate(out):
+            if status == BATCH_RECORD_RAN:
+                callable, format_out = self.formats[i]
+                results[i] = callable.format_result(data if data else 1, format_out)
+        return results
+
+
+class Group:
+    # a group address that the Arduinos given join, calling one of its callables runs it
+    # on all of them at once, with no response.  The callables are those of the first
+    # Arduino, the members should have the same firmware.  Group(serial, BROADCAST_ADDRESS,
+    # arduinos) reaches every slave without joining anything.
+    def __init__(self, serial, address, arduinos, crc=False):
+        self.serial = serial
+        self.address = address
+        self.crc = crc
+        self.members = []
+        for arduino in arduinos:
+            if address == BROADCAST_ADDRESS or arduino.join_group(address) == 1:
+                self.members.append(arduino)
+            else:
+                print("Arduino at {} could not join group {}".format(arduino.address, address))
+        if arduinos:
+            for name, callable in arduinos[0].callables.items():
+                setattr(self, name, self.make_call(callable))
+
+    def make_call(self, callable):
+        def call(data=[]):
+            to_send = callable.data_to_send(data)
+            self.serial.send_command_to_group(self.address, callable.command, to_send, self.crc)
+        return call
+
+    def leave(self):
+        if self.address != BROADCAST_ADDRESS:
+            for arduino in self.members:
+                arduino.leave_group(self.address)
+        self.members = []